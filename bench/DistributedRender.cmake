@@ -0,0 +1,48 @@
+# Renders the default view locally, through MIG --coordinate with one MIG --work and by MIG --merge of that worker's tile file in directories
+# below WORK_DIRECTORY, and fails unless all three images are the same bytes. Run by ctest, see CMakeLists.txt:
+#     cmake -DMIG=path/to/MIG -DWORK_DIRECTORY=directory -DPORT=port -P DistributedRender.cmake
+# With -DWORKER=1 it only waits for the coordinator to listen and then works for it, as the second command of the coordinator's pipeline
+cmake_minimum_required(VERSION 3.25)
+
+# Few iterations keep the test short, the renders only have to agree
+set(iterations 200)
+
+if(WORKER)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 2)
+  execute_process(COMMAND ${MIG} --work 127.0.0.1:${PORT} --tiles ${WORK_DIRECTORY}/worker.mtf OUTPUT_QUIET RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "MIG --work failed: ${result}")
+  endif()
+  return()
+endif()
+
+file(REMOVE_RECURSE ${WORK_DIRECTORY})
+foreach(directory local coordinator merge)
+  file(MAKE_DIRECTORY ${WORK_DIRECTORY}/${directory})
+endforeach()
+
+execute_process(COMMAND ${MIG} --quiet --iterations ${iterations} WORKING_DIRECTORY ${WORK_DIRECTORY}/local OUTPUT_QUIET RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "local render failed: ${result}")
+endif()
+
+# Both commands of a pipeline run at once. The worker comes first, it writes nothing the coordinator would have to read
+execute_process(COMMAND ${CMAKE_COMMAND} -DWORKER=1 -DMIG=${MIG} -DWORK_DIRECTORY=${WORK_DIRECTORY} -DPORT=${PORT} -P ${CMAKE_CURRENT_LIST_FILE}
+                COMMAND ${MIG} --quiet --iterations ${iterations} --coordinate ${PORT}
+                WORKING_DIRECTORY ${WORK_DIRECTORY}/coordinator OUTPUT_QUIET TIMEOUT 600 RESULTS_VARIABLE results)
+if(NOT results STREQUAL "0;0")
+  message(FATAL_ERROR "distributed render failed: ${results}")
+endif()
+
+execute_process(COMMAND ${MIG} --quiet --merge ${WORK_DIRECTORY}/worker.mtf WORKING_DIRECTORY ${WORK_DIRECTORY}/merge OUTPUT_QUIET RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "MIG --merge failed: ${result}")
+endif()
+
+foreach(directory coordinator merge)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIRECTORY}/local/mandelbrotset/image.png ${WORK_DIRECTORY}/${directory}/mandelbrotset/image.png
+                  RESULT_VARIABLE different)
+  if(different)
+    message(FATAL_ERROR "the ${directory} image differs from the local one")
+  endif()
+endforeach()
@@ -0,0 +1,645 @@
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "CostModel.hpp"
+#include "Mandelbrotset.hpp"
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+#include "TileGenerator.hpp"
+
+/*
+mig_bench measures the two compute layers of MIG on fixed reference views, independent of coloring, PNG encoding and the sample store:
+    computeIterationsVector: every 8 pixel group of the image, one call each, no lane refilling.
+    tileGenerator:           every tile through prepareTile and threadTileGenerator, exactly what a worker of TileScheduler runs.
+
+Usage: mig_bench [--repetitions n] [--filter name] [--double] [--distances] [--json path] [--verify] [--cost] [--saves directory]
+    Every benchmark runs n times (default 3) and reports its fastest run. The kernel is chosen like in MIG, MIG_KERNEL overrides it.
+    --double sets DoublePrecisionRender, so tiles shallow enough for single precision are iterated in double anyway.
+    --distances sets DistanceRender, tileGenerator then tracks dz/dc for the distance estimate (computeIterationsVector never does).
+    --json writes the results to path as JSON, so two commits can be compared with a plain diff of their files.
+    --verify benchmarks nothing, it renders every reference view with and without MarianiSilverRender and fails on any sample that differs.
+             ctest runs it, see CMakeLists.txt
+    --cost benchmarks nothing, it ranks the tiles of every reference view on a costTileGrid x costTileGrid grid by their CostEstimate and by the fastest
+           of n tileGenerator runs, and fails if the Spearman rank correlation of a view is below minCostCorrelation. ctest runs it as well
+    --saves benchmarks nothing, it saves the configurations and a journaled progress configuration into directory, damages them like crashes
+            and other versions would and fails unless every intact part loads back exactly and every damaged one is rejected. ctest runs it as well
+
+Reported per benchmark:
+    pixelsPerSecond        image pixels divided by the run time
+    iterationsPerSecond    sum of every pixel's iteration count divided by the run time, the work the set itself demands.
+                           Pixels stopped early by periodicity checks or the cardioid and bulb test count as maxIterations
+    laneOccupancy          computeIterationsVector only: fraction of lane iterations doing useful work, a vector of lanes
+                           iterates until its slowest pixel finishes and every other lane idles meanwhile
+    threadImbalance        tileGenerator only: slowest thread tile of a tile divided by the tile's mean thread tile, averaged over tiles,
+                           the time a barrier per tile would waste
+    poolImbalance          tileGenerator only: the measured thread tiles dealt in submission order to pConfig.threadsUsed workers,
+                           each taking the next one when idle, makespan divided by the perfectly balanced one
+    singlePrecisionTiles   tileGenerator only: tiles prepareTile picked single precision for
+*/
+
+// Configurations every benchmark runs with, the main thread is bound to it
+static RenderState renderState = {
+    .mConfig = {
+        .startReal = -20.0L / 9.0L,
+        .endReal = 20.0L / 9.0L,
+        .startImag = 1.25L,
+        .endImag = -1.25L,
+
+        .maxIterations = 1000LL,
+        .bailoutRadius = 1 << 8,
+        .periodicityPrecision2 = 1E-14L,
+        .periodicitySavePeriod = 200,
+
+        .renderFlags = 0,
+        .centerRealHi = 0.0,
+        .centerRealLo = 0.0,
+        .centerImagHi = 0.0,
+        .centerImagLo = 0.0,
+        .zoom = 1.0,
+
+        .formula = MandelbrotFormula,
+        .juliaReal = 0.0,
+        .juliaImag = 0.0
+    },
+    .tConfig = {
+        .imageWidth = 1024ULL,
+        .imageHeight = 768ULL,
+
+        .tileGridWidth = 4ULL,
+        .tileGridHeight = 4ULL,
+
+        .threadGridWidth = 8ULL,
+        .threadGridHeight = 8ULL
+    },
+    // The completion arrays are allocated for tConfig's grids by resetProgressConfiguration at the start of main
+    .pConfig = {
+        .threadsUsed = 8ULL,
+        .currentTile = 0ULL,
+        .tileCount = 0ULL,
+        .threadCount = 0ULL,
+        .tileCompletion = nullptr,
+        .threadCompletion = nullptr,
+        .tileBudgets = nullptr
+    },
+    .savePath = "mandelbrotset/",
+    .budgetHistory = {},
+    .sharedReferenceOrbit = nullptr,
+    .progressJournalMutex = {},
+    .progressJournal = {},
+    .progressJournalPath = {},
+    .telemetry = {}
+};
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+// Region of the complex plane every benchmark is run on
+struct ReferenceView {
+    const char *name;
+    double startReal;
+    double endReal;
+    double startImag;
+    double endImag;
+    int64_t maxIterations;
+};
+
+// Cheap to expensive: escape dominated, boundary dominated with deep spirals, interior dominated outside of the analytically rejected
+// cardioid and period-2 bulb (the period-3 bulb, caught by periodicity checks), and a thin strip crossing the boundary many times
+static const ReferenceView referenceViews[] = {
+    {"full", -20.0 / 9.0, 20.0 / 9.0, 1.25, -1.25, 1000},
+    {"seahorse", -0.76, -0.72, 0.12, 0.09, 5000},
+    {"interior", -0.135, -0.110, 0.755, 0.735, 5000},
+    {"boundaryStrip", 0.25, 0.40, 0.012, 0.0, 3000}
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::string view;
+    std::string function;
+    uint64_t pixels;
+    uint64_t iterations;
+    double seconds;
+    // Negative when the metric doesn't apply to function
+    double laneOccupancy;
+    double threadImbalance;
+    double poolImbalance;
+    int64_t singlePrecisionTiles;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Lanes of one vector of the kernel computeIterationsVector dispatches to, its 8 pixels are iterated in groups of this many
+static uint64_t kernelLanes(KernelType type) {
+    switch (type) {
+        case ScalarKernel: return 1;
+        case SSE2Kernel: return 2;
+        case AVX2Kernel: return 4;
+        case AVX512Kernel: return 8;
+    }
+    return 1;
+}
+
+static void loadView(const ReferenceView &view, uint64_t renderFlags) {
+    mConfig = {
+        .startReal = view.startReal,
+        .endReal = view.endReal,
+        .startImag = view.startImag,
+        .endImag = view.endImag,
+
+        .maxIterations = view.maxIterations,
+        .bailoutRadius = mConfig.bailoutRadius,
+        .periodicityPrecision2 = mConfig.periodicityPrecision2,
+        .periodicitySavePeriod = mConfig.periodicitySavePeriod,
+
+        .renderFlags = renderFlags,
+        .centerRealHi = 0.0,
+        .centerRealLo = 0.0,
+        .centerImagHi = 0.0,
+        .centerImagLo = 0.0,
+        .zoom = 1.0,
+
+        .formula = mConfig.formula,
+        .juliaReal = mConfig.juliaReal,
+        .juliaImag = mConfig.juliaImag
+    };
+}
+
+static BenchmarkResult benchmarkVector(const ReferenceView &view, uint64_t repetitions) {
+    const uint64_t lanes = kernelLanes(selectedKernel());
+    BenchmarkResult result = {std::string(view.name) + "/computeIterationsVector", view.name, "computeIterationsVector", 0, 0, 0, 0, -1, -1, -1};
+
+    Sample samples[8];
+    for (uint64_t repetition = 0; repetition < repetitions; repetition++) {
+        uint64_t iterations = 0;
+        uint64_t laneIterations = 0;
+        const Clock::time_point start = Clock::now();
+        for (uint64_t y = 0; y < tConfig.imageHeight; y++) {
+            for (uint64_t x = 0; x + 8 <= tConfig.imageWidth; x += 8) {
+                computeIterationsVector(x, y, samples);
+                for (uint64_t group = 0; group < 8; group += lanes) {
+                    int64_t slowest = 0;
+                    for (uint64_t lane = group; lane < group + lanes; lane++) {
+                        iterations += samples[lane].iterations;
+                        slowest = std::max(slowest, samples[lane].iterations);
+                    }
+                    laneIterations += slowest * lanes;
+                }
+            }
+        }
+        const double seconds = secondsSince(start);
+
+        if (repetition == 0 || seconds < result.seconds) result.seconds = seconds;
+        result.pixels = tConfig.imageHeight * (tConfig.imageWidth / 8 * 8);
+        result.iterations = iterations;
+        result.laneOccupancy = laneIterations == 0 ? 1.0 : static_cast<double>(iterations) / laneIterations;
+    }
+    return result;
+}
+
+static BenchmarkResult benchmarkTiles(const ReferenceView &view, uint64_t repetitions) {
+    BenchmarkResult result = {std::string(view.name) + "/tileGenerator", view.name, "tileGenerator", 0, 0, 0, -1, 0, 0, 0};
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    const uint64_t samplesPerTile = tConfig.tileWidth() * tConfig.tileHeight();
+
+    std::vector<StoredSample> tileSamples(samplesPerTile);
+    std::vector<double> threadTileSeconds(pConfig.threadCount);
+    std::vector<double> workerBusy(std::max<uint64_t>(pConfig.threadsUsed, 1));
+    PreparedTile tile;
+    for (uint64_t repetition = 0; repetition < repetitions; repetition++) {
+        uint64_t iterations = 0;
+        double seconds = 0;
+        double imbalanceSum = 0;
+        int64_t singlePrecisionTiles = 0;
+        std::fill(workerBusy.begin(), workerBusy.end(), 0.0);
+
+        for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) {
+            const Clock::time_point start = Clock::now();
+            prepareTile(tileIndex, tile);
+            seconds += secondsSince(start);
+            if (tile.context.precision == SinglePrecision) singlePrecisionTiles++;
+
+            for (uint64_t threadIndex = 0; threadIndex < pConfig.threadCount; threadIndex++) {
+                const Clock::time_point threadStart = Clock::now();
+                threadTileGenerator(tileIndex, threadIndex, tile, tileSamples.data(), allPasses, nullptr);
+                threadTileSeconds[threadIndex] = secondsSince(threadStart);
+                seconds += threadTileSeconds[threadIndex];
+
+                // The earliest idle worker takes the next thread tile
+                *std::min_element(workerBusy.begin(), workerBusy.end()) += threadTileSeconds[threadIndex];
+            }
+
+            double slowest = 0;
+            double total = 0;
+            for (const double threadSeconds : threadTileSeconds) {
+                slowest = std::max(slowest, threadSeconds);
+                total += threadSeconds;
+            }
+            imbalanceSum += total == 0 ? 1.0 : slowest / (total / threadTileSeconds.size());
+            for (const StoredSample &sample : tileSamples) iterations += sample.iterations;
+        }
+
+        double makespan = 0;
+        double busy = 0;
+        for (const double workerSeconds : workerBusy) {
+            makespan = std::max(makespan, workerSeconds);
+            busy += workerSeconds;
+        }
+
+        if (repetition == 0 || seconds < result.seconds) {
+            result.seconds = seconds;
+            result.threadImbalance = imbalanceSum / tileCount;
+            result.poolImbalance = busy == 0 ? 1.0 : makespan / (busy / workerBusy.size());
+        }
+        result.pixels = tileCount * samplesPerTile;
+        result.iterations = iterations;
+        result.singlePrecisionTiles = singlePrecisionTiles;
+    }
+    return result;
+}
+
+// Samples of the view loaded that differ between a plain and a MarianiSilverRender render, compared bit for bit
+static uint64_t verifyMarianiSilver(const ReferenceView &view, uint64_t renderFlags) {
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    const uint64_t samplesPerTile = tConfig.tileWidth() * tConfig.tileHeight();
+
+    std::vector<StoredSample> plainSamples(samplesPerTile);
+    std::vector<StoredSample> subdividedSamples(samplesPerTile);
+    PreparedTile tile;
+    uint64_t differences = 0;
+    for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) {
+        for (const bool subdivided : {false, true}) {
+            loadView(view, subdivided ? renderFlags | MarianiSilverRender : renderFlags & ~MarianiSilverRender);
+            prepareTile(tileIndex, tile);
+            StoredSample *output = subdivided ? subdividedSamples.data() : plainSamples.data();
+            for (uint64_t threadIndex = 0; threadIndex < pConfig.threadCount; threadIndex++) threadTileGenerator(tileIndex, threadIndex, tile, output, allPasses, nullptr);
+        }
+        for (uint64_t i = 0; i < samplesPerTile; i++) {
+            if (std::memcmp(&plainSamples[i], &subdividedSamples[i], sizeof(StoredSample)) != 0) differences++;
+        }
+    }
+    return differences;
+}
+
+// Tile grid the cost estimate is checked on, and the rank correlation with the measured tile times it has to reach on every reference view.
+// Views whose slowest tile takes less than minCostSpread times as long as their fastest have nothing to rank but timing noise and always pass
+static constexpr uint64_t costTileGrid = 16;
+static constexpr double minCostCorrelation = 0.7;
+static constexpr double minCostSpread = 2;
+
+// Rank of every value, ties get the mean of the ranks they span
+static std::vector<double> ranks(const std::vector<double> &values) {
+    std::vector<uint64_t> order(values.size());
+    for (uint64_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&values](uint64_t a, uint64_t b) { return values[a] < values[b]; });
+    std::vector<double> result(values.size());
+    for (uint64_t first = 0; first < order.size();) {
+        uint64_t last = first;
+        while (last + 1 < order.size() && values[order[last + 1]] == values[order[first]]) last++;
+        for (uint64_t i = first; i <= last; i++) result[order[i]] = (first + last) / 2.0;
+        first = last + 1;
+    }
+    return result;
+}
+
+// Spearman rank correlation of a and b, the Pearson correlation of their ranks
+static double rankCorrelation(const std::vector<double> &a, const std::vector<double> &b) {
+    const std::vector<double> rankA = ranks(a);
+    const std::vector<double> rankB = ranks(b);
+    const double mean = (a.size() - 1) / 2.0;
+    double covariance = 0, varianceA = 0, varianceB = 0;
+    for (uint64_t i = 0; i < a.size(); i++) {
+        covariance += (rankA[i] - mean) * (rankB[i] - mean);
+        varianceA += (rankA[i] - mean) * (rankA[i] - mean);
+        varianceB += (rankB[i] - mean) * (rankB[i] - mean);
+    }
+    return varianceA == 0 || varianceB == 0 ? 0 : covariance / std::sqrt(varianceA * varianceB);
+}
+
+// Rank correlation between the CostEstimate of every tile of the view loaded and the fastest of repetitions tileGenerator runs of it,
+// on a costTileGrid x costTileGrid tile grid. The estimate only has to rank the tiles, see CostModel.hpp. uniform tells whether the tile times spread less than minCostSpread
+static double verifyCostEstimate(uint64_t repetitions, bool &uniform) {
+    const TileConfiguration benchmarkGrid = tConfig;
+    tConfig.tileGridWidth = costTileGrid;
+    tConfig.tileGridHeight = costTileGrid;
+    tConfig.threadGridWidth = 1;
+    tConfig.threadGridHeight = 1;
+    const uint64_t tileCount = costTileGrid * costTileGrid;
+    resetProgressConfiguration(tileCount, 1);
+
+    const SampleStore store("");
+    const CostEstimate estimate(store, 1);
+    std::vector<StoredSample> tileSamples(tConfig.tileWidth() * tConfig.tileHeight());
+    std::vector<double> tileSeconds(tileCount, 0);
+    PreparedTile tile;
+    for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) {
+        for (uint64_t repetition = 0; repetition < repetitions; repetition++) {
+            const Clock::time_point start = Clock::now();
+            prepareTile(tileIndex, tile);
+            threadTileGenerator(tileIndex, 0, tile, tileSamples.data(), allPasses, nullptr);
+            const double seconds = secondsSince(start);
+            if (repetition == 0 || seconds < tileSeconds[tileIndex]) tileSeconds[tileIndex] = seconds;
+        }
+    }
+
+    uniform = *std::max_element(tileSeconds.begin(), tileSeconds.end()) < minCostSpread * *std::min_element(tileSeconds.begin(), tileSeconds.end());
+    tConfig = benchmarkGrid;
+    resetProgressConfiguration(tConfig.tileGridWidth * tConfig.tileGridHeight, tConfig.threadGridWidth * tConfig.threadGridHeight);
+    return estimate.empty() ? 0 : rankCorrelation(estimate.tileCosts(), tileSeconds);
+}
+
+// Everything a ".mpc" file holds of pConfig, comparable
+struct ProgressSnapshot {
+    uint64_t threadsUsed;
+    uint64_t currentTile;
+    std::vector<unsigned char> tileCompletion;
+    std::vector<unsigned char> threadCompletion;
+    std::vector<int64_t> tileBudgets;
+
+    bool operator==(const ProgressSnapshot &) const = default;
+};
+
+static ProgressSnapshot progressSnapshot() {
+    return {
+        .threadsUsed = pConfig.threadsUsed,
+        .currentTile = pConfig.currentTile,
+        .tileCompletion = std::vector<unsigned char>(pConfig.tileCompletion, pConfig.tileCompletion + (pConfig.tileCount + 7) / 8),
+        .threadCompletion = std::vector<unsigned char>(pConfig.threadCompletion, pConfig.threadCompletion + (pConfig.threadCount + 7) / 8),
+        .tileBudgets = std::vector<int64_t>(pConfig.tileBudgets, pConfig.tileBudgets + pConfig.tileCount)
+    };
+}
+
+// Marks the tile complete for budget in pConfig and journals it, like TileScheduler does
+static void completeTile(uint64_t tileIndex, int64_t budget) {
+    pConfig.tileCompletion[tileIndex / 8] |= static_cast<unsigned char>(1 << (tileIndex % 8));
+    pConfig.tileBudgets[tileIndex] = budget;
+    journalTileCompletion(tileIndex);
+}
+
+static std::vector<unsigned char> readFile(const std::filesystem::path &filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) throw std::system_error(errno, std::generic_category(), filepath.string());
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::filesystem::path &filepath, const std::vector<unsigned char> &contents) {
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(contents.data()), contents.size())) throw std::system_error(errno, std::generic_category(), filepath.string());
+}
+
+// Loads the ".mpc" file at filepath into a pConfig cleared first, whether it was valid and gave expected
+static bool loadsAs(const std::filesystem::path &filepath, const ProgressSnapshot &expected) {
+    resetProgressConfiguration(pConfig.tileCount, pConfig.threadCount);
+    pConfig.threadsUsed = 1;
+    if (!detectConfiguration(filepath, Progress)) return false;
+    loadConfiguration(filepath, Progress);
+    return progressSnapshot() == expected;
+}
+
+// Saves, journals and damages the configuration files in directory the way crashes and other versions would, one line per check.
+// Returns the number of failed checks
+static uint64_t verifySaves(const std::filesystem::path &directory) {
+    uint64_t failedChecks = 0;
+    const auto check = [&failedChecks](const char *name, bool passed) {
+        std::cout << std::left << std::setw(40) << name << (passed ? "passes" : "fails") << std::endl;
+        if (!passed) failedChecks++;
+    };
+    std::filesystem::create_directories(directory);
+    const std::filesystem::path progressPath = directory / "save.mpc";
+
+    // The configurations come back exactly as they were saved
+    std::vector<unsigned char> savedFields;
+    putConfigurationFields(savedFields, mConfig);
+    putConfigurationFields(savedFields, tConfig);
+    saveConfiguration(directory / "save.mc", Mandelbrotset);
+    saveConfiguration(directory / "save.mtc", Tile);
+    mConfig.maxIterations++;
+    tConfig.imageWidth++;
+    loadConfiguration(directory / "save.mc", Mandelbrotset);
+    loadConfiguration(directory / "save.mtc", Tile);
+    std::vector<unsigned char> loadedFields;
+    putConfigurationFields(loadedFields, mConfig);
+    putConfigurationFields(loadedFields, tConfig);
+    check("configuration round trip", loadedFields == savedFields);
+
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    pConfig.threadsUsed = 3;
+    pConfig.currentTile = tileCount / 2;
+    for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex += 3) {
+        pConfig.tileCompletion[tileIndex / 8] |= static_cast<unsigned char>(1 << (tileIndex % 8));
+        pConfig.tileBudgets[tileIndex] = mConfig.maxIterations + static_cast<int64_t>(tileIndex);
+    }
+    pConfig.threadCompletion[0] = 0x21;
+    saveConfiguration(progressPath, Progress);
+    const ProgressSnapshot snapshot = progressSnapshot();
+    check("progress round trip", loadsAs(progressPath, snapshot));
+
+    // Tiles journaled after the snapshot are replayed over it, the last record torn by a crash is dropped
+    loadConfiguration(progressPath, Progress);
+    openProgressJournal(progressPath);
+    completeTile(1, 2 * mConfig.maxIterations);
+    completeTile(2, 2 * mConfig.maxIterations);
+    const ProgressSnapshot journaled = progressSnapshot();
+    completeTile(4, 2 * mConfig.maxIterations);
+    closeProgressJournal();
+    std::vector<unsigned char> contents = readFile(progressPath);
+    const uint64_t journalOffset = contents.size() - 3 * 20;
+    contents.resize(contents.size() - 10);
+    writeFile(progressPath, contents);
+    check("journal replay, torn last record", loadsAs(progressPath, journaled));
+
+    // Replay stops at the first record whose checksum fails, even if whole records follow it
+    std::vector<unsigned char> damaged = contents;
+    damaged[journalOffset] ^= 1;
+    writeFile(progressPath, damaged);
+    check("journal replay, damaged record", loadsAs(progressPath, snapshot));
+
+    // A damaged snapshot or one of another version isn't loaded at all, and leaves pConfig as it was
+    damaged = contents;
+    damaged[16] ^= 1;
+    writeFile(progressPath, damaged);
+    const ProgressSnapshot before = progressSnapshot();
+    bool rejected = !detectConfiguration(progressPath, Progress);
+    detectLoadConfiguration(progressPath);
+    check("damaged snapshot rejected", rejected && progressSnapshot() == before);
+
+    // The checksum covers the version, it is computed again so only the version is off
+    damaged = contents;
+    damaged[2]++;
+    uint64_t checksumOffset = 8;
+    for (uint64_t i = 0; i < 4; i++) checksumOffset += static_cast<uint64_t>(damaged[4 + i]) << (8 * i);
+    const uint32_t checksum = static_cast<uint32_t>(crc32(0, damaged.data(), static_cast<uInt>(checksumOffset)));
+    for (uint64_t i = 0; i < 4; i++) damaged[checksumOffset + i] = static_cast<unsigned char>(checksum >> (8 * i));
+    writeFile(progressPath, damaged);
+    rejected = !detectConfiguration(progressPath, Progress);
+    try {
+        loadConfiguration(progressPath, Progress);
+        rejected = false;
+    } catch (const std::invalid_argument &) {
+    }
+    check("other version rejected", rejected);
+    return failedChecks;
+}
+
+struct BenchmarkFunction {
+    const char *name;
+    BenchmarkResult (*run)(const ReferenceView &view, uint64_t repetitions);
+};
+
+static const BenchmarkFunction benchmarkFunctions[] = {
+    {"computeIterationsVector", &benchmarkVector},
+    {"tileGenerator", &benchmarkTiles}
+};
+
+static void writeJson(const std::filesystem::path &filepath, const std::vector<BenchmarkResult> &results) {
+    std::ofstream json(filepath);
+    if (!json) throw std::system_error(errno, std::generic_category(), "Couldn't open " + filepath.string());
+    json << std::setprecision(9);
+
+    json << "{\n";
+    json << "  \"context\": {\n";
+    json << "    \"kernel\": \"" << kernelName(selectedKernel()) << "\",\n";
+    json << "    \"imageWidth\": " << tConfig.imageWidth << ",\n";
+    json << "    \"imageHeight\": " << tConfig.imageHeight << ",\n";
+    json << "    \"tileGridWidth\": " << tConfig.tileGridWidth << ",\n";
+    json << "    \"tileGridHeight\": " << tConfig.tileGridHeight << ",\n";
+    json << "    \"threadGridWidth\": " << tConfig.threadGridWidth << ",\n";
+    json << "    \"threadGridHeight\": " << tConfig.threadGridHeight << ",\n";
+    json << "    \"threadsUsed\": " << pConfig.threadsUsed << ",\n";
+    json << "    \"renderFlags\": " << mConfig.renderFlags << "\n";
+    json << "  },\n";
+    json << "  \"benchmarks\": [\n";
+    for (uint64_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult &result = results[i];
+        json << "    {\n";
+        json << "      \"name\": \"" << result.name << "\",\n";
+        json << "      \"view\": \"" << result.view << "\",\n";
+        json << "      \"function\": \"" << result.function << "\",\n";
+        json << "      \"pixels\": " << result.pixels << ",\n";
+        json << "      \"iterations\": " << result.iterations << ",\n";
+        json << "      \"seconds\": " << result.seconds << ",\n";
+        json << "      \"pixelsPerSecond\": " << result.pixels / result.seconds << ",\n";
+        json << "      \"iterationsPerSecond\": " << result.iterations / result.seconds;
+        if (result.laneOccupancy >= 0) json << ",\n      \"laneOccupancy\": " << result.laneOccupancy;
+        if (result.threadImbalance >= 0) json << ",\n      \"threadImbalance\": " << result.threadImbalance;
+        if (result.poolImbalance >= 0) json << ",\n      \"poolImbalance\": " << result.poolImbalance;
+        if (result.singlePrecisionTiles >= 0) json << ",\n      \"singlePrecisionTiles\": " << result.singlePrecisionTiles;
+        json << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n";
+    json << "}\n";
+}
+
+// Prints one line per benchmark like Google Benchmark's console reporter
+static void printResult(const BenchmarkResult &result) {
+    std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed
+              << std::setw(10) << std::setprecision(2) << result.seconds * 1e3 << " ms"
+              << std::setw(10) << std::setprecision(2) << result.pixels / result.seconds * 1e-6 << " Mpixel/s"
+              << std::setw(10) << std::setprecision(1) << result.iterations / result.seconds * 1e-6 << " Miter/s";
+    if (result.laneOccupancy >= 0) std::cout << "  lanes " << std::setprecision(3) << result.laneOccupancy;
+    if (result.threadImbalance >= 0) std::cout << "  thread imbalance " << std::setprecision(3) << result.threadImbalance;
+    if (result.poolImbalance >= 0) std::cout << "  pool imbalance " << std::setprecision(3) << result.poolImbalance;
+    if (result.singlePrecisionTiles >= 0) std::cout << "  float tiles " << result.singlePrecisionTiles;
+    std::cout << std::endl;
+}
+
+int main(int argc, char **argv) {
+    bindRenderState(renderState);
+    resetProgressConfiguration(tConfig.tileGridWidth * tConfig.tileGridHeight, tConfig.threadGridWidth * tConfig.threadGridHeight);
+    uint64_t repetitions = 3;
+    std::string filter;
+    uint64_t renderFlags = 0;
+    std::filesystem::path jsonPath;
+    bool verify = false;
+    bool cost = false;
+    std::filesystem::path savesDirectory;
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument == "--repetitions" && i + 1 < argc) {
+            repetitions = std::max(std::stoull(argv[++i]), 1ULL);
+        } else if (argument == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (argument == "--double") {
+            renderFlags |= DoublePrecisionRender;
+        } else if (argument == "--distances") {
+            renderFlags |= DistanceRender;
+        } else if (argument == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (argument == "--verify") {
+            verify = true;
+        } else if (argument == "--cost") {
+            cost = true;
+        } else if (argument == "--saves" && i + 1 < argc) {
+            savesDirectory = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--repetitions n] [--filter name] [--double] [--distances] [--json path] [--verify] [--cost] [--saves directory]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!savesDirectory.empty()) return verifySaves(savesDirectory) == 0 ? 0 : 1;
+
+    if (verify) {
+        uint64_t failedViews = 0;
+        for (const ReferenceView &view : referenceViews) {
+            if (!filter.empty() && std::string(view.name).find(filter) == std::string::npos) continue;
+            const uint64_t differences = verifyMarianiSilver(view, renderFlags);
+            std::cout << std::left << std::setw(40) << view.name << (differences == 0 ? "MarianiSilverRender matches" : "MarianiSilverRender differs in ")
+                      << (differences == 0 ? "" : std::to_string(differences) + " samples") << std::endl;
+            if (differences != 0) failedViews++;
+        }
+        return failedViews == 0 ? 0 : 1;
+    }
+
+    if (cost) {
+        uint64_t failedViews = 0;
+        for (const ReferenceView &view : referenceViews) {
+            if (!filter.empty() && std::string(view.name).find(filter) == std::string::npos) continue;
+            loadView(view, renderFlags);
+            bool uniform = false;
+            const double correlation = verifyCostEstimate(repetitions, uniform);
+            const bool failed = !uniform && correlation < minCostCorrelation;
+            std::cout << std::left << std::setw(40) << view.name << "cost rank correlation " << std::fixed << std::setprecision(2) << correlation;
+            if (uniform) std::cout << ", tiles cost about the same";
+            if (failed) std::cout << ", below the required " << minCostCorrelation;
+            std::cout << std::endl;
+            if (failed) failedViews++;
+        }
+        return failedViews == 0 ? 0 : 1;
+    }
+
+    std::cout << "kernel: " << kernelName(selectedKernel()) << ", image " << tConfig.imageWidth << "x" << tConfig.imageHeight
+              << ", best of " << repetitions << std::endl;
+
+    std::vector<BenchmarkResult> results;
+    for (const ReferenceView &view : referenceViews) {
+        loadView(view, renderFlags);
+        for (const BenchmarkFunction &benchmark : benchmarkFunctions) {
+            if (!filter.empty() && (std::string(view.name) + "/" + benchmark.name).find(filter) == std::string::npos) continue;
+            results.push_back(benchmark.run(view, repetitions));
+            printResult(results.back());
+        }
+    }
+
+    if (!jsonPath.empty()) writeJson(jsonPath, results);
+}
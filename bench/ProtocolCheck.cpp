@@ -0,0 +1,276 @@
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "Distributed.hpp"
+#include "RenderState.hpp"
+#include "Saves.hpp"
+
+/*
+mig_protocol_check runs a coordinator on port of 127.0.0.1 and connects to it as peers that break the protocol, then lets one well behaved worker
+complete the render and damages the tile file that worker wrote. Every check prints one line, it fails if any of them does. ctest runs it:
+
+Usage: mig_protocol_check port directory
+    wrong protocol version         a hello of another protocol version gets no configurations
+    unassigned tile record         a tile record of a tile the peer wasn't assigned drops the peer before its samples are taken
+    oversized compressed size      a tile record claiming more compressed samples than a tile can have drops the peer
+    tile file merge                the worker's tile file merges into every tile
+    tile file of another version   mergeTileFiles refuses it
+    tile file with unassigned tile mergeTileFiles refuses a record of a tile past the grid
+    tile file oversized record     mergeTileFiles refuses a record claiming more compressed samples than a tile can have
+*/
+
+// Small and shallow, the coordinator only has to hand out a few tiles
+static RenderState coordinatorState = {
+    .mConfig = {
+        .startReal = -20.0L / 9.0L,
+        .endReal = 20.0L / 9.0L,
+        .startImag = 1.25L,
+        .endImag = -1.25L,
+
+        .maxIterations = 100LL,
+        .bailoutRadius = 1 << 8,
+        .periodicityPrecision2 = 1E-14L,
+        .periodicitySavePeriod = 200,
+
+        .renderFlags = 0,
+        .centerRealHi = 0.0,
+        .centerRealLo = 0.0,
+        .centerImagHi = 0.0,
+        .centerImagLo = 0.0,
+        .zoom = 1.0,
+
+        .formula = MandelbrotFormula,
+        .juliaReal = 0.0,
+        .juliaImag = 0.0
+    },
+    .tConfig = {
+        .imageWidth = 256ULL,
+        .imageHeight = 192ULL,
+
+        .tileGridWidth = 4ULL,
+        .tileGridHeight = 4ULL,
+
+        .threadGridWidth = 2ULL,
+        .threadGridHeight = 2ULL
+    },
+    // The completion arrays are allocated for tConfig's grids by resetProgressConfiguration at the start of main
+    .pConfig = {
+        .threadsUsed = 2ULL,
+        .currentTile = 0ULL,
+        .tileCount = 0ULL,
+        .threadCount = 0ULL,
+        .tileCompletion = nullptr,
+        .threadCompletion = nullptr,
+        .tileBudgets = nullptr
+    },
+    .savePath = {},
+    .budgetHistory = {},
+    .sharedReferenceOrbit = nullptr,
+    .progressJournalMutex = {},
+    .progressJournal = {},
+    .progressJournalPath = {},
+    .telemetry = {}
+};
+
+// The well behaved worker, its configurations are the coordinator's
+static RenderState workerState = {
+    .mConfig = {},
+    .tConfig = {},
+    .pConfig = {
+        .threadsUsed = 2ULL,
+        .currentTile = 0ULL,
+        .tileCount = 0ULL,
+        .threadCount = 0ULL,
+        .tileCompletion = nullptr,
+        .threadCompletion = nullptr,
+        .tileBudgets = nullptr
+    },
+    .savePath = {},
+    .budgetHistory = {},
+    .sharedReferenceOrbit = nullptr,
+    .progressJournalMutex = {},
+    .progressJournal = {},
+    .progressJournalPath = {},
+    .telemetry = {}
+};
+
+extern thread_local TileConfiguration &tConfig;
+
+// How long the coordinator gets to start listening, and to answer or drop a peer
+static constexpr std::chrono::seconds listenTimeout(10);
+static constexpr std::chrono::seconds replyTimeout(10);
+
+// Connection to the coordinator of a peer that sends whatever it is told to
+class Peer {
+   public:
+    explicit Peer(uint16_t port) : handle(-1) {
+        const auto deadline = std::chrono::steady_clock::now() + listenTimeout;
+        while (true) {
+            handle = socket(AF_INET, SOCK_STREAM, 0);
+            if (handle < 0) throw std::system_error(errno, std::generic_category(), "socket");
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(port);
+            if (connect(handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+                const timeval timeout = {.tv_sec = replyTimeout.count(), .tv_usec = 0};
+                setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                return;
+            }
+            close(handle);
+            if (std::chrono::steady_clock::now() > deadline) throw std::system_error(errno, std::generic_category(), "connecting to the coordinator");
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    Peer(const Peer &) = delete;
+    Peer &operator=(const Peer &) = delete;
+    ~Peer() { close(handle); }
+
+    template <typename T>
+    void send(const T &value) {
+        if (::send(handle, &value, sizeof(T), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(T))) throw std::system_error(errno, std::generic_category(), "send");
+    }
+
+    // Receives exactly size bytes into data, false if the coordinator closed the connection first
+    bool receive(void *data, uint64_t size) {
+        char *bytes = static_cast<char*>(data);
+        while (size > 0) {
+            const ssize_t received = recv(handle, bytes, size, 0);
+            if (received <= 0) return false;
+            bytes += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    // Whether the coordinator closed the connection without sending anything more, a coordinator still waiting for more after replyTimeout didn't
+    bool dropped() {
+        char byte;
+        const ssize_t received = recv(handle, &byte, 1, 0);
+        return received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+
+    // Says hello with version and takes the configurations, false if the coordinator didn't send them
+    bool hello(uint64_t version) {
+        send<unsigned char>('H');
+        send(byteOrderMark);
+        send(version);
+        std::vector<unsigned char> message(1 + mandelbrotsetFieldsSize + tileFieldsSize);
+        return receive(message.data(), message.size()) && message[0] == 'C';
+    }
+
+   private:
+    int handle;
+};
+
+// Whether any tile is complete in the coordinator's pConfig
+static bool anyTileCompleted() {
+    for (uint64_t i = 0; i < (coordinatorState.pConfig.tileCount + 7) / 8; i++) {
+        if (coordinatorState.pConfig.tileCompletion[i] != 0) return true;
+    }
+    return false;
+}
+
+// Whether mergeTileFiles refuses the tile file contents with an exception of type Refusal
+template <typename Refusal>
+static bool mergeRefused(const std::filesystem::path &directory, const std::vector<unsigned char> &contents) {
+    const std::filesystem::path path = directory / "damaged.mtf";
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(contents.data()), contents.size());
+    try {
+        mergeTileFiles({path}, directory / "damaged.mss");
+    } catch (const Refusal &) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " port directory" << std::endl;
+        return 1;
+    }
+    const uint16_t port = static_cast<uint16_t>(std::stoul(argv[1]));
+    const std::filesystem::path directory = argv[2];
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    bindRenderState(coordinatorState);
+    resetProgressConfiguration(tConfig.tileGridWidth * tConfig.tileGridHeight, tConfig.threadGridWidth * tConfig.threadGridHeight);
+    uint64_t failedChecks = 0;
+    const auto check = [&failedChecks](const char *name, bool passed) {
+        std::cout << std::left << std::setw(40) << name << (passed ? "passes" : "fails") << std::endl;
+        if (!passed) failedChecks++;
+    };
+
+    // One tile per assignment, so the peers below hold a single tile each
+    std::future<void> coordinator = boundAsync(coordinateRender, port, uint64_t{1}, directory / "coordinator.mss");
+    {
+        Peer peer(port);
+        check("wrong protocol version", !peer.hello(protocolVersion + 1));
+    }
+    {
+        Peer peer(port);
+        const bool configured = peer.hello(protocolVersion);
+        const uint64_t header[3] = {0, 0, 16};
+        peer.send<unsigned char>('T');
+        peer.send(header);
+        check("unassigned tile record", configured && peer.dropped() && !anyTileCompleted());
+    }
+    {
+        Peer peer(port);
+        const bool configured = peer.hello(protocolVersion);
+        peer.send<unsigned char>('R');
+        unsigned char type = 0;
+        uint64_t assignment[2] = {0, 0};
+        const bool assigned = peer.receive(&type, 1) && type == 'A' && peer.receive(assignment, sizeof(assignment)) && assignment[0] == 1;
+        const uint64_t header[3] = {assignment[1], 0, uint64_t{1} << 40};
+        peer.send<unsigned char>('T');
+        peer.send(header);
+        check("oversized compressed size", configured && assigned && peer.dropped() && !anyTileCompleted());
+    }
+
+    // The tiles of the dropped peers are handed out again, the well behaved worker gets every one of them
+    const std::filesystem::path tileFilePath = directory / "worker.mtf";
+    std::future<void> worker = std::async(std::launch::async, [port, &tileFilePath] {
+        bindRenderState(workerState);
+        workForCoordinator("127.0.0.1", port, tileFilePath);
+    });
+    worker.get();
+    coordinator.get();
+
+    check("tile file merge", mergeTileFiles({tileFilePath}, directory / "merged.mss") == 0);
+    std::ifstream tileFile(tileFilePath, std::ios::binary);
+    const std::vector<unsigned char> contents{std::istreambuf_iterator<char>(tileFile), std::istreambuf_iterator<char>()};
+    // The version follows the magic numbers, the first record the configurations
+    const uint64_t recordOffset = 2 + sizeof(uint64_t) + mandelbrotsetFieldsSize + tileFieldsSize;
+    std::vector<unsigned char> damaged = contents;
+    damaged[2]++;
+    check("tile file of another version", mergeRefused<std::invalid_argument>(directory, damaged));
+    damaged = contents;
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    memcpy(damaged.data() + recordOffset, &tileCount, sizeof(tileCount));
+    check("tile file with unassigned tile", mergeRefused<std::out_of_range>(directory, damaged));
+    damaged = contents;
+    const uint64_t oversized = uint64_t{1} << 40;
+    memcpy(damaged.data() + recordOffset + 2 * sizeof(uint64_t), &oversized, sizeof(oversized));
+    check("tile file oversized record", mergeRefused<std::invalid_argument>(directory, damaged));
+    return failedChecks == 0 ? 0 : 1;
+}
@@ -0,0 +1,297 @@
+#include "Buddhabrot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Mandelbrotset.hpp"
+#include "PngEncoder.hpp"
+#include "RenderState.hpp"
+#include "Saves.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+static constexpr uint64_t bandCount = 3;
+static constexpr uint64_t cacheLineSize = 64;
+// Samples a worker takes at a time, run through computeIterationsQueue together
+static constexpr uint64_t chunkSamples = 4096;
+// Most samples per round, rounds are also kept short enough that no 32 bit counter can overflow
+static constexpr uint64_t maxRoundSamples = 1ULL << 22;
+// Counters a reducer takes at a time, 32 KiB of totals and 16 KiB of every worker's counters
+static constexpr uint64_t reductionBlock = 4096;
+// Cells of the stratified grid along each axis, a power of two
+static constexpr uint64_t strataPerAxis = 1024;
+// c is sampled from [-sampleRadius, sampleRadius] x [-sampleRadius, sampleRadius], which holds the whole set
+static constexpr double sampleRadius = 2;
+// Fields of a checkpoint before hits, and the part of them that has to match to resume
+static constexpr uint64_t checkpointHeaderSize = 112;
+static constexpr uint64_t checkpointIdentitySize = 104;
+
+// Zeroed counters starting on a cache line and padded to whole cache lines, so no two buffers ever share a line
+template <typename Counter>
+class CounterBuffer {
+   public:
+    explicit CounterBuffer(uint64_t count)
+        : size((count * sizeof(Counter) + cacheLineSize - 1) / cacheLineSize * cacheLineSize / sizeof(Counter)),
+          counters(static_cast<Counter*>(::operator new[](size * sizeof(Counter), std::align_val_t(cacheLineSize)))) {
+        std::fill_n(counters, size, 0);
+    }
+    CounterBuffer(const CounterBuffer &) = delete;
+    CounterBuffer &operator=(const CounterBuffer &) = delete;
+    ~CounterBuffer() { ::operator delete[](counters, std::align_val_t(cacheLineSize)); }
+
+    Counter *data() noexcept { return counters; }
+    const Counter *data() const noexcept { return counters; }
+
+   private:
+    uint64_t size;
+    Counter *counters;
+};
+
+// Maps orbit points to image pixels
+struct BuddhabrotView {
+    double startReal;
+    double startImag;
+    // Pixels per unit of the complex plane, negative if the axis is flipped
+    double scaleReal;
+    double scaleImag;
+    uint64_t width;
+    uint64_t height;
+};
+
+// Uniform number in [0, 1) derived from index by the splitmix64 finalizer, the same sample always gets the same c
+static double uniform(uint64_t index) noexcept {
+    index += 0x9E3779B97F4A7C15ULL;
+    index = (index ^ (index >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    index = (index ^ (index >> 27)) * 0x94D049BB133111EBULL;
+    index ^= index >> 31;
+    return static_cast<double>(index >> 11) * 0x1.0p-53;
+}
+
+// c of sample number sample
+static void sampleC(uint64_t sample, bool stratified, double &cReal, double &cImag) noexcept {
+    double u = uniform(2 * sample);
+    double v = uniform(2 * sample + 1);
+    if (stratified) {
+        // Multiplying by an odd number permutes the cells of a pass, consecutive samples land far apart instead of sweeping the grid row by row
+        const uint64_t cell = (sample * 0x9E3779B1ULL) & (strataPerAxis * strataPerAxis - 1);
+        u = (cell % strataPerAxis + u) / strataPerAxis;
+        v = (cell / strataPerAxis + v) / strataPerAxis;
+    }
+    cReal = sampleRadius * (2 * u - 1);
+    cImag = sampleRadius * (2 * v - 1);
+}
+
+// Iterates the orbit of c again for iterations iterations and counts every point of it within the view into the bands set in bandMask
+static void accumulateOrbit(const BuddhabrotView &view, double cReal, double cImag, int64_t iterations, unsigned bandMask, uint32_t *hits) noexcept {
+    double zReal = 0, zImag = 0;
+    for (int64_t k = 0; k < iterations; k++) {
+        const double zRealNext = zReal * zReal - zImag * zImag + cReal;
+        zImag = 2 * zReal * zImag + cImag;
+        zReal = zRealNext;
+
+        const double x = (zReal - view.startReal) * view.scaleReal + 0.5;
+        const double y = (zImag - view.startImag) * view.scaleImag + 0.5;
+        if (!(x >= 0 && y >= 0 && x < view.width && y < view.height)) continue;
+        uint32_t *pixel = hits + (static_cast<uint64_t>(y) * view.width + static_cast<uint64_t>(x)) * bandCount;
+        for (uint64_t band = 0; band < bandCount; band++) pixel[band] += (bandMask >> band) & 1;
+    }
+}
+
+// Runs work(worker) on workerCount threads, the calling one included
+template <typename Work>
+static void runWorkers(uint64_t workerCount, const Work &work) {
+    std::vector<std::thread> workers;
+    for (uint64_t worker = 1; worker < workerCount; worker++) workers.push_back(boundThread(std::cref(work), worker));
+    work(0);
+    for (std::thread &worker : workers) worker.join();
+}
+
+static void putLittleEndian(unsigned char *out, uint64_t value) noexcept {
+    for (uint64_t i = 0; i < 8; i++) out[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+static uint64_t getLittleEndian(const unsigned char *in) noexcept {
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < 8; i++) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+// Checkpoint fields of the current render before hits, see the specification in Buddhabrot.hpp
+static std::vector<unsigned char> checkpointHeader(const BuddhabrotSettings &settings, uint64_t samplesDone) {
+    const uint64_t values[] = {
+        tConfig.imageWidth, tConfig.imageHeight,
+        std::bit_cast<uint64_t>(mConfig.startReal), std::bit_cast<uint64_t>(mConfig.endReal), std::bit_cast<uint64_t>(mConfig.startImag), std::bit_cast<uint64_t>(mConfig.endImag),
+        static_cast<uint64_t>(mConfig.maxIterations), std::bit_cast<uint64_t>(mConfig.bailoutRadius),
+        static_cast<uint64_t>(settings.bandIterations[0]), static_cast<uint64_t>(settings.bandIterations[1]), static_cast<uint64_t>(settings.bandIterations[2]),
+        static_cast<uint64_t>(settings.minIterations), settings.stratified ? 1ULL : 0ULL,
+        samplesDone
+    };
+    static_assert(sizeof(values) == checkpointHeaderSize, "checkpoint header has to match its specification");
+    std::vector<unsigned char> header(checkpointHeaderSize);
+    for (uint64_t i = 0; i < std::size(values); i++) putLittleEndian(header.data() + 8 * i, values[i]);
+    return header;
+}
+
+static void saveCheckpoint(const std::filesystem::path &checkpointPath, const BuddhabrotSettings &settings, uint64_t samplesDone, const uint64_t *totals, uint64_t counterCount) {
+    std::vector<unsigned char> fields = checkpointHeader(settings, samplesDone);
+    fields.resize(checkpointHeaderSize + 8 * counterCount);
+    for (uint64_t i = 0; i < counterCount; i++) putLittleEndian(fields.data() + checkpointHeaderSize + 8 * i, totals[i]);
+    saveContainer(checkpointPath, "BC", fields);
+}
+
+// Loads the totals of a checkpoint of the current render, returns the samples it holds or 0 if there is none
+static uint64_t loadCheckpoint(const std::filesystem::path &checkpointPath, const BuddhabrotSettings &settings, uint64_t *totals, uint64_t counterCount) {
+    std::vector<unsigned char> fields;
+    if (!loadContainer(checkpointPath, "BC", fields) || fields.size() != checkpointHeaderSize + 8 * counterCount) return 0;
+    if (memcmp(fields.data(), checkpointHeader(settings, 0).data(), checkpointIdentitySize) != 0) return 0;
+    for (uint64_t i = 0; i < counterCount; i++) totals[i] = getLittleEndian(fields.data() + checkpointHeaderSize + 8 * i);
+    return getLittleEndian(fields.data() + checkpointIdentitySize);
+}
+
+// Writes every band as a channel with a square root curve, full intensity is the count of the brightest pixels that aren't among the top 0.1%,
+// a few pixels on the real axis get far more hits than anything else
+static void writeImage(const std::filesystem::path &filepath, const uint64_t *totals, uint8_t bitDepth) {
+    const uint64_t pixelCount = tConfig.imageWidth * tConfig.imageHeight;
+    uint64_t brightest[bandCount] = {};
+    std::vector<uint64_t> counts(pixelCount);
+    for (uint64_t band = 0; band < bandCount; band++) {
+        for (uint64_t i = 0; i < pixelCount; i++) counts[i] = totals[i * bandCount + band];
+        const auto quantile = counts.begin() + static_cast<int64_t>(pixelCount - 1 - pixelCount / 1000);
+        std::nth_element(counts.begin(), quantile, counts.end());
+        brightest[band] = std::max<uint64_t>(*quantile, 1);
+    }
+
+    PngEncoder png(filepath, tConfig.imageWidth, tConfig.imageHeight, bitDepth, PngRGB);
+    const double fullScale = bitDepth == 16 ? 65535 : 255;
+    std::vector<unsigned char> row(png.rowSize());
+    for (uint64_t y = 0; y < tConfig.imageHeight; y++) {
+        for (uint64_t x = 0; x < tConfig.imageWidth; x++) {
+            for (uint64_t band = 0; band < bandCount; band++) {
+                const uint64_t count = totals[(y * tConfig.imageWidth + x) * bandCount + band];
+                const uint64_t value = static_cast<uint64_t>(std::sqrt(std::min(static_cast<double>(count) / brightest[band], 1.0)) * fullScale + 0.5);
+                if (bitDepth == 16) {
+                    row[(x * bandCount + band) * 2] = static_cast<unsigned char>(value >> 8);
+                    row[(x * bandCount + band) * 2 + 1] = static_cast<unsigned char>(value);
+                } else {
+                    row[x * bandCount + band] = static_cast<unsigned char>(value);
+                }
+            }
+        }
+        png.writeRows(row.data(), 1);
+    }
+    png.finish();
+}
+
+void renderBuddhabrot(const std::filesystem::path &filepath, const std::filesystem::path &checkpointPath, const BuddhabrotSettings &settings, uint8_t bitDepth) {
+    if (mConfig.renderFlags & DeepZoomRender) throw std::invalid_argument("renderBuddhabrot doesn't support DeepZoomRender views");
+    if (mConfig.formula != MandelbrotFormula) throw std::invalid_argument("renderBuddhabrot only supports MandelbrotFormula");
+    if (tConfig.imageWidth < 2 || tConfig.imageHeight < 2) throw std::invalid_argument("renderBuddhabrot needs an image of at least 2 x 2 pixels");
+
+    // Samples escaping in limit iterations or more don't belong to any band
+    int64_t bands[bandCount];
+    int64_t limit = 0;
+    for (uint64_t band = 0; band < bandCount; band++) {
+        bands[band] = std::min(settings.bandIterations[band], mConfig.maxIterations);
+        limit = std::max(limit, bands[band]);
+    }
+    const BuddhabrotView view = {
+        .startReal = mConfig.startReal,
+        .startImag = mConfig.startImag,
+        .scaleReal = (tConfig.imageWidth - 1) / (mConfig.endReal - mConfig.startReal),
+        .scaleImag = (tConfig.imageHeight - 1) / (mConfig.endImag - mConfig.startImag),
+        .width = tConfig.imageWidth,
+        .height = tConfig.imageHeight
+    };
+    const uint64_t counterCount = tConfig.imageWidth * tConfig.imageHeight * bandCount;
+    const uint64_t workerCount = std::max<uint64_t>(pConfig.threadsUsed, 1);
+
+    CounterBuffer<uint64_t> totals(counterCount);
+    std::vector<std::unique_ptr<CounterBuffer<uint32_t>>> buffers;
+    for (uint64_t worker = 0; worker < workerCount; worker++) buffers.push_back(std::make_unique<CounterBuffer<uint32_t>>(counterCount));
+
+    uint64_t samplesDone = std::min(loadCheckpoint(checkpointPath, settings, totals.data(), counterCount), settings.samples);
+    // An orbit hits a counter at most once per iteration, so a round of this many samples can't overflow any worker's counters
+    const uint64_t roundSamples = std::clamp<uint64_t>(UINT32_MAX / std::max<int64_t>(limit, 1), 1, maxRoundSamples);
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+
+    while (samplesDone < settings.samples) {
+        const uint64_t roundEnd = std::min(samplesDone + roundSamples, settings.samples);
+        std::atomic<uint64_t> nextSample = samplesDone;
+        runWorkers(workerCount, [&](uint64_t worker) {
+            uint32_t *hits = buffers[worker]->data();
+            std::vector<double> cReal(chunkSamples);
+            std::vector<double> cImag(chunkSamples);
+            std::vector<QueuedPixel> queue(chunkSamples);
+            std::vector<Sample> results(chunkSamples);
+            // Sample i of a chunk is pixel (i, i) of a tile whose column and row i hold its c, so the tile kernels iterate scattered c values
+            const TileContext context = {
+                .cReal = cReal.data(),
+                .cImag = cImag.data(),
+                .x = 0,
+                .y = 0,
+                .maxIterations = limit,
+                .bailoutRadius = mConfig.bailoutRadius,
+                .periodicityPrecision2 = mConfig.periodicityPrecision2,
+                .periodicitySavePeriod = mConfig.periodicitySavePeriod,
+                .precision = DoublePrecision,
+                .formula = MandelbrotFormula,
+                .juliaReal = 0,
+                .juliaImag = 0,
+                .distances = false
+            };
+            for (uint64_t begin = nextSample.fetch_add(chunkSamples); begin < roundEnd; begin = nextSample.fetch_add(chunkSamples)) {
+                const uint64_t count = std::min(chunkSamples, roundEnd - begin);
+                for (uint64_t i = 0; i < count; i++) {
+                    sampleC(begin + i, settings.stratified, cReal[i], cImag[i]);
+                    queue[i] = {.x = i, .y = i, .index = i};
+                }
+                computeIterationsQueue(context, queue.data(), count, results.data(), nullptr);
+
+                for (uint64_t i = 0; i < count; i++) {
+                    const int64_t iterations = results[i].iterations;
+                    if (iterations < settings.minIterations || iterations >= limit) continue;
+                    unsigned bandMask = 0;
+                    for (uint64_t band = 0; band < bandCount; band++) bandMask |= (iterations < bands[band] ? 1U : 0U) << band;
+                    accumulateOrbit(view, cReal[i], cImag[i], iterations, bandMask, hits);
+                }
+            }
+        });
+
+        // Every reducer owns whole blocks of the totals and clears the same blocks of every worker's counters
+        std::atomic<uint64_t> nextBlock = 0;
+        runWorkers(workerCount, [&](uint64_t) {
+            for (uint64_t begin = nextBlock.fetch_add(reductionBlock); begin < counterCount; begin = nextBlock.fetch_add(reductionBlock)) {
+                const uint64_t end = std::min(begin + reductionBlock, counterCount);
+                uint64_t *total = totals.data();
+                for (const std::unique_ptr<CounterBuffer<uint32_t>> &buffer : buffers) {
+                    uint32_t *hits = buffer->data();
+                    for (uint64_t i = begin; i < end; i++) total[i] += hits[i];
+                    std::fill(hits + begin, hits + end, 0);
+                }
+            }
+        });
+        samplesDone = roundEnd;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (samplesDone == settings.samples || now - lastCheckpoint >= std::chrono::duration<double>(settings.checkpointInterval)) {
+            saveCheckpoint(checkpointPath, settings, samplesDone, totals.data(), counterCount);
+            lastCheckpoint = now;
+            std::cout << "buddhabrot: " << samplesDone << "/" << settings.samples << " samples" << std::endl;
+        }
+    }
+    writeImage(filepath, totals.data(), bitDepth);
+}
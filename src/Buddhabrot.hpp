@@ -0,0 +1,59 @@
+#ifndef BUDDHABROT_HPP_INCLUDED
+#define BUDDHABROT_HPP_INCLUDED
+#include <cstdint>
+#include <filesystem>
+
+/*
+Buddhabrot checkpoint specification:
+    Filename has to end in ".mbc" which stands for Mandelbrotset Buddhabrot Checkpoint.
+    Same container as the configuration files (see Saves.hpp), all values are little-endian. A checkpoint is only resumed from if every field before samplesDone
+    matches the current render, otherwise the render starts over.
+    Header byte layout:
+        Magic numbers:
+        byte[0, 1]                           = 'B' (0x42), 'C' (0x43) (char, char)
+
+        View, from mConfig and tConfig:
+        byte[ 8, ...,  15]                   = imageWidth             (uint64_t)
+        byte[16, ...,  23]                   = imageHeight            (uint64_t)
+        byte[24, ...,  31]                   = startReal              (double)
+        byte[32, ...,  39]                   = endReal                (double)
+        byte[40, ...,  47]                   = startImag              (double)
+        byte[48, ...,  55]                   = endImag                (double)
+        byte[56, ...,  63]                   = maxIterations          (int64_t)
+        byte[64, ...,  71]                   = bailoutRadius          (double)
+
+        Sampling, from BuddhabrotSettings:
+        byte[72, ...,  95]                   = bandIterations         (int64_t[3])
+        byte[96, ..., 103]                   = minIterations          (int64_t)
+        byte[104, ..., 111]                  = stratified             (uint64_t) Note: 0 or 1
+
+        Progress:
+        byte[112, ..., 119]                  = samplesDone            (uint64_t) Note: samples 0 to samplesDone - 1 are accumulated
+        byte[120, ...]                       = hits                   (uint64_t[imageWidth * imageHeight * 3]) Note: row by row, red, green and blue band per pixel
+*/
+
+// What renderBuddhabrot samples and how its bands are split
+struct BuddhabrotSettings {
+    // c values sampled in total, a resumed render continues up to this many
+    uint64_t samples;
+    // Samples are jittered within the cells of a 1024 x 1024 grid, every 1024 * 1024 consecutive samples cover each cell once, instead of independently uniform
+    bool stratified;
+    // Orbits escaping in fewer than bandIterations[b] iterations are accumulated into channel b (red, green, blue), each one is clamped to mConfig.maxIterations.
+    // Equal bands render a grayscale Buddhabrot, e.g. 5000, 500 and 50 the classic Nebulabrot
+    int64_t bandIterations[3];
+    // Orbits escaping in fewer iterations are skipped, they only add an even haze
+    int64_t minIterations;
+    // Seconds between checkpoints
+    double checkpointInterval;
+};
+
+// Renders the orbit density of the escaping c values (Buddhabrot, or Nebulabrot with different bands) into a PNG at filepath.
+// The view and image size come from mConfig and tConfig, c is sampled from [-2, 2] x [-2, 2]. Every sample is run through the vectorized computeIterationsQueue first,
+// only orbits escaping within a band are iterated again and every point of them within the view is counted. Counts go into 32 bit per thread buffers
+// that start on cache lines of their own. Samples are computed in rounds short enough that no counter can overflow, after each one the buffers are reduced
+// into 64 bit totals in parallel, every reducer owning whole cache sized blocks. The totals and the number of samples done are checkpointed to checkpointPath
+// (see above) once checkpointInterval passed and at the end, an interrupted render resumes there with the same samples, so interruptions don't change the result.
+// Each channel is scaled with a square root curve up to its 99.9th percentile. Only MandelbrotFormula is supported, without DeepZoomRender
+void renderBuddhabrot(const std::filesystem::path &filepath, const std::filesystem::path &checkpointPath, const BuddhabrotSettings &settings, uint8_t bitDepth);
+
+#endif  // BUDDHABROT_HPP_INCLUDED
@@ -0,0 +1,132 @@
+#include "Colorizer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Mandelbrotset.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+
+// Number of interpolated entries a palette is expanded to
+static constexpr uint64_t paletteSize = 4096;
+
+// Color of a palette at position in [0, 1)
+struct PaletteStop {
+    double position;
+    double red;
+    double green;
+    double blue;
+};
+
+// Stops of palette, the color at position 1 is the one at position 0
+static std::vector<PaletteStop> paletteStops(Palette palette) {
+    switch (palette) {
+        case GrayscalePalette:
+            return {{0.0, 0, 0, 0}, {0.5, 255, 255, 255}};
+        case UltraFractalPalette:
+            return {{0.0, 0, 7, 100}, {0.16, 32, 107, 203}, {0.42, 237, 255, 255}, {0.6425, 255, 170, 0}, {0.8575, 0, 2, 0}};
+        case FirePalette:
+            return {{0.0, 0, 0, 0}, {0.3, 180, 30, 0}, {0.6, 255, 180, 0}, {0.8, 255, 255, 200}};
+    }
+    return {{0.0, 0, 0, 0}};
+}
+
+Colorizer::Colorizer(const ColorSettings &colorSettings)
+    : settings(colorSettings),
+      red(paletteSize + 1),
+      green(paletteSize + 1),
+      blue(paletteSize + 1),
+      cumulativeHistogram(),
+      tables() {
+    // Expand the stops into paletteSize linearly interpolated 16 bit colors, the extra last entry repeats the first one
+    const std::vector<PaletteStop> stops = paletteStops(settings.palette);
+    for (uint64_t i = 0; i <= paletteSize; i++) {
+        const double position = static_cast<double>(i % paletteSize) / paletteSize;
+        uint64_t stop = 0;
+        while (stop + 1 < stops.size() && stops[stop + 1].position <= position) stop++;
+        const PaletteStop &from = stops[stop];
+        const PaletteStop &to = stop + 1 < stops.size() ? stops[stop + 1] : PaletteStop{1.0, stops[0].red, stops[0].green, stops[0].blue};
+        const double weight = (position - from.position) / (to.position - from.position);
+        red[i] = 257 * (from.red + weight * (to.red - from.red));
+        green[i] = 257 * (from.green + weight * (to.green - from.green));
+        blue[i] = 257 * (from.blue + weight * (to.blue - from.blue));
+    }
+
+    tables.red = red.data();
+    tables.green = green.data();
+    tables.blue = blue.data();
+    tables.paletteSize = paletteSize;
+    tables.cumulativeHistogram = nullptr;
+    tables.paletteDensity = settings.paletteDensity;
+    tables.smooth = settings.smooth;
+    tables.smoothScale = 1 / std::log2(static_cast<double>(mConfig.formulaPower()));
+    tables.sixteenBit = settings.bitDepth == 16;
+    tables.maxIterations = mConfig.maxIterations;
+}
+
+// Histograms of iteration counts have an entry for every n in [0, maxIterations]
+static uint64_t histogramIterations(int64_t maxIterations) noexcept {
+    return maxIterations > 1 ? maxIterations : 1;
+}
+
+// Adds the escaped samples among count samples to histogram, which has histogramIterations(maxIterations) + 1 entries
+static void countIterations(const StoredSample *samples, uint64_t count, int64_t budget, std::vector<uint64_t> &histogram) noexcept {
+    const uint64_t maxIterations = histogramIterations(budget);
+    for (uint64_t i = 0; i < count; i++) {
+        if (samples[i].iterations >= 0 && static_cast<uint64_t>(samples[i].iterations) < maxIterations) histogram[samples[i].iterations]++;
+    }
+}
+
+void Colorizer::buildHistogram(const SampleStore &store) {
+    std::vector<uint64_t> histogram(histogramIterations(tables.maxIterations) + 1, 0);
+    // Only the part of every tile within the image counts, samples of edge tiles past it are never computed
+    for (uint64_t tileY = 0; tileY < tConfig.tileGridHeight; tileY++) {
+        for (uint64_t tileX = 0; tileX < tConfig.tileGridWidth; tileX++) {
+            const StoredSample *tile = store.tile(tConfig.tileIndex(tileX, tileY));
+            for (uint64_t row = 0; row < tConfig.tileHeightAt(tileY); row++) countIterations(tile + row * tConfig.tileWidth(), tConfig.tileWidthAt(tileX), tables.maxIterations, histogram);
+        }
+    }
+    useHistogram(histogram);
+}
+
+void Colorizer::buildHistogram(const StoredSample *samples, uint64_t count) {
+    std::vector<uint64_t> histogram(histogramIterations(tables.maxIterations) + 1, 0);
+    countIterations(samples, count, tables.maxIterations, histogram);
+    useHistogram(histogram);
+}
+
+void Colorizer::useHistogram(const std::vector<uint64_t> &histogram) {
+    const uint64_t maxIterations = histogramIterations(tables.maxIterations);
+
+    // cumulativeHistogram[n] is the fraction of escaped samples that escaped in fewer than n iterations
+    cumulativeHistogram.assign(maxIterations + 1, 0);
+    uint64_t escaped = 0;
+    for (uint64_t n = 0; n < maxIterations; n++) {
+        escaped += histogram[n];
+        cumulativeHistogram[n + 1] = static_cast<double>(escaped);
+    }
+    if (escaped != 0) {
+        for (double &fraction : cumulativeHistogram) fraction /= static_cast<double>(escaped);
+    }
+    tables.cumulativeHistogram = cumulativeHistogram.data();
+}
+
+void Colorizer::colorize(const StoredSample *samples, uint64_t count, unsigned char *out) const noexcept {
+    colorizeSamples(tables, samples, count, out);
+}
+
+uint8_t Colorizer::bitDepth() const noexcept {
+    return settings.bitDepth == 16 ? 16 : 8;
+}
+
+uint64_t Colorizer::bytesPerPixel() const noexcept {
+    return 3 * bitDepth() / 8;
+}
+
+bool Colorizer::needsHistogram() const noexcept {
+    return settings.histogramEqualization;
+}
@@ -0,0 +1,60 @@
+#ifndef COLORIZER_HPP_INCLUDED
+#define COLORIZER_HPP_INCLUDED
+#include <cstdint>
+#include <vector>
+
+#include "Mandelbrotset.hpp"
+#include "SampleStore.hpp"
+
+// Built in palettes, all of them cyclic
+enum Palette {
+    GrayscalePalette,
+    UltraFractalPalette,
+    FirePalette
+};
+
+// How stored samples are turned into colors
+struct ColorSettings {
+    Palette palette;
+    // Continuous escape time instead of whole iteration counts, removes the banding between iteration counts
+    bool smooth;
+    // Spreads the palette evenly over the escaped samples, requires every sample of the image before the first pixel can be colored
+    bool histogramEqualization;
+    // Palette cycles per iteration when histogram equalization is off
+    double paletteDensity;
+    // 8 or 16 bits per channel
+    uint8_t bitDepth;
+};
+
+// Turns StoredSamples into RGB pixels independently of how they were computed, so an image can be recolored from its sample store without iterating.
+// The per pixel work runs in the vectorized colorizeSamples kernel, this class only owns the palette and histogram tables it reads.
+class Colorizer {
+   public:
+    // Colors samples computed with the current mConfig, which can be replaced afterwards
+    explicit Colorizer(const ColorSettings &colorSettings);
+
+    // Counts the iterations of every sample in store for histogram equalization, every tile of store has to be complete
+    void buildHistogram(const SampleStore &store);
+    // Same for count samples, e.g. the subset of a progressive preview
+    void buildHistogram(const StoredSample *samples, uint64_t count);
+
+    // Colors count samples into out, bytesPerPixel() bytes per pixel
+    void colorize(const StoredSample *samples, uint64_t count, unsigned char *out) const noexcept;
+
+    uint8_t bitDepth() const noexcept;
+    uint64_t bytesPerPixel() const noexcept;
+    bool needsHistogram() const noexcept;
+
+   private:
+    // Turns per iteration sample counts into cumulativeHistogram and hands it to the kernel
+    void useHistogram(const std::vector<uint64_t> &histogram);
+
+    ColorSettings settings;
+    std::vector<double> red;
+    std::vector<double> green;
+    std::vector<double> blue;
+    std::vector<double> cumulativeHistogram;
+    ColorTables tables;
+};
+
+#endif  // COLORIZER_HPP_INCLUDED
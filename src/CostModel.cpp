@@ -0,0 +1,141 @@
+#include "CostModel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Mandelbrotset.hpp"
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+#include "TileGenerator.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+
+// Pixels per probe along each axis, and the most probes per tile along each axis
+static constexpr uint64_t probeSpacing = 16;
+static constexpr uint64_t maxProbes = 8;
+// Iterations a pixel costs besides its own, for queueing it and writing its result
+static constexpr double pixelOverhead = 16;
+
+// Position of probe p of n along a tile side of size pixels, at the center of its cell
+static uint64_t probeOffset(uint64_t p, uint64_t n, uint64_t size) noexcept {
+    return (2 * p + 1) * size / (2 * n);
+}
+
+CostEstimate::CostEstimate() : probesX(0), probesY(0), probes(), tiles() {}
+
+CostEstimate::CostEstimate(const SampleStore &store, uint64_t workerCount) : probesX(0), probesY(0), probes(), tiles() {
+    const uint64_t tileWidth = tConfig.tileWidth();
+    const uint64_t tileHeight = tConfig.tileHeight();
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    if ((mConfig.renderFlags & DeepZoomRender) || tileWidth == 0 || tileHeight == 0 || tileCount == 0) return;
+    probesX = std::clamp<uint64_t>(tileWidth / probeSpacing, 1, maxProbes);
+    probesY = std::clamp<uint64_t>(tileHeight / probeSpacing, 1, maxProbes);
+    probes.resize(tileCount);
+    tiles.resize(tileCount, 0);
+
+    // Tiles are handed out one at a time, a probe grid is cheap next to the tile but boundary tiles still take far longer than exterior ones
+    std::atomic<uint64_t> nextTile = 0;
+    const auto probeTiles = [this, &store, &nextTile, tileCount] {
+        PreparedTile tile;
+        std::vector<QueuedPixel> queue;
+        std::vector<Sample> samples(probesX * probesY);
+        for (uint64_t tileIndex = nextTile++; tileIndex < tileCount; tileIndex = nextTile++) {
+            if (store.tileCompleted(tileIndex)) continue;
+            if (store.tileEscalatable(tileIndex)) {
+                uint64_t count = 0;
+                store.unresolved(tileIndex, count);
+                tiles[tileIndex] = count * (pixelOverhead + mConfig.maxIterations - store.tileBudget(tileIndex));
+                continue;
+            }
+
+            // Tiles at the image's right and bottom edges are probed over their part within the image, tiles entirely past it cost nothing
+            const uint64_t width = tConfig.tileWidthAt(tileIndex % tConfig.tileGridWidth);
+            const uint64_t height = tConfig.tileHeightAt(tileIndex / tConfig.tileGridWidth);
+            if (width == 0 || height == 0) continue;
+            prepareTile(tileIndex, tile);
+            queue.clear();
+            for (uint64_t py = 0; py < probesY; py++) {
+                for (uint64_t px = 0; px < probesX; px++) {
+                    queue.push_back({.x = tile.context.x + probeOffset(px, probesX, width), .y = tile.context.y + probeOffset(py, probesY, height), .index = queue.size()});
+                }
+            }
+            computeIterationsQueue(tile.context, queue.data(), queue.size(), samples.data(), nullptr);
+
+            std::vector<float> &tileProbes = probes[tileIndex];
+            double total = 0;
+            // Probes are charged what the kernel actually ran for them: nothing past the overhead inside the cardioid and bulb,
+            // up to the iteration that caught them for pixels in a period
+            for (const Sample &sample : samples) {
+                tileProbes.push_back(static_cast<float>(pixelOverhead + sample.iterationsRun));
+                total += tileProbes.back();
+            }
+            tiles[tileIndex] = total / samples.size() * width * height;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint64_t worker = 1; worker < workerCount; worker++) workers.push_back(boundThread(probeTiles));
+    probeTiles();
+    for (std::thread &worker : workers) worker.join();
+}
+
+bool CostEstimate::empty() const noexcept {
+    return tiles.empty();
+}
+
+const std::vector<double> &CostEstimate::tileCosts() const noexcept {
+    return tiles;
+}
+
+void CostEstimate::threadTileCosts(uint64_t tileIndex, std::vector<double> &costs) const {
+    const uint64_t threadCount = tConfig.threadGridWidth * tConfig.threadGridHeight;
+    if (empty() || probes[tileIndex].empty()) {
+        costs.assign(threadCount, empty() || threadCount == 0 ? 1 : tiles[tileIndex] / threadCount);
+        return;
+    }
+
+    // Every probe is charged to the thread tile it lies in
+    const uint64_t tileX = tileIndex % tConfig.tileGridWidth;
+    const uint64_t tileY = tileIndex / tConfig.tileGridWidth;
+    const uint64_t tileWidth = tConfig.tileWidthAt(tileX);
+    const uint64_t tileHeight = tConfig.tileHeightAt(tileY);
+    // Probes are mapped as if thread tiles were at least a pixel wide, empty ones still cost nothing
+    const uint64_t threadWidth = std::max<uint64_t>(tConfig.threadWidth(), 1);
+    const uint64_t threadHeight = std::max<uint64_t>(tConfig.threadHeight(), 1);
+    const std::vector<float> &tileProbes = probes[tileIndex];
+    std::vector<uint64_t> counts(threadCount, 0);
+    costs.assign(threadCount, 0);
+    for (uint64_t py = 0; py < probesY; py++) {
+        const uint64_t threadY = std::min(probeOffset(py, probesY, tileHeight) / threadHeight, tConfig.threadGridHeight - 1);
+        for (uint64_t px = 0; px < probesX; px++) {
+            const uint64_t threadX = std::min(probeOffset(px, probesX, tileWidth) / threadWidth, tConfig.threadGridWidth - 1);
+            costs[tConfig.threadIndex(threadX, threadY)] += tileProbes[py * probesX + px];
+            counts[tConfig.threadIndex(threadX, threadY)]++;
+        }
+    }
+
+    // Thread tiles smaller than the probe spacing fall back to the probe nearest to their center
+    for (uint64_t threadY = 0; threadY < tConfig.threadGridHeight; threadY++) {
+        for (uint64_t threadX = 0; threadX < tConfig.threadGridWidth; threadX++) {
+            const uint64_t threadIndex = tConfig.threadIndex(threadX, threadY);
+            const uint64_t width = tConfig.threadWidthAt(tileX, threadX);
+            const uint64_t height = tConfig.threadHeightAt(tileY, threadY);
+            if (width == 0 || height == 0) {
+                costs[threadIndex] = 0;
+                continue;
+            }
+            if (counts[threadIndex] == 0) {
+                const uint64_t px = std::min((2 * threadX * threadWidth + width) * probesX / (2 * tileWidth), probesX - 1);
+                const uint64_t py = std::min((2 * threadY * threadHeight + height) * probesY / (2 * tileHeight), probesY - 1);
+                costs[threadIndex] = tileProbes[py * probesX + px];
+                counts[threadIndex] = 1;
+            }
+            costs[threadIndex] = costs[threadIndex] / counts[threadIndex] * width * height;
+        }
+    }
+}
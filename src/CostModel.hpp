@@ -0,0 +1,38 @@
+#ifndef COSTMODEL_HPP_INCLUDED
+#define COSTMODEL_HPP_INCLUDED
+#include <cstdint>
+#include <vector>
+
+#include "SampleStore.hpp"
+
+// Estimated iteration cost of every tile and thread tile of the current configurations, from a low resolution pre-pass.
+// Every tile is probed at a sparse grid of pixels (one per 16 x 16 pixels, at most 8 x 8 per tile), a probe stands for the cost of the pixels around it:
+// the iterations the kernel ran for it (see Sample::iterationsRun, none for the cardioid and bulb), plus a fixed per pixel overhead. Costs differ by orders of magnitude between the exterior and the boundary,
+// the estimate only has to rank and balance them, not predict them exactly.
+// Tiles the store already holds cost nothing, tiles it holds for a smaller maxIterations with EscalationRender cost their unresolved pixels' remaining budget.
+// Deep zooms aren't probed, as probing a tile there needs its reference orbit: the estimate stays empty
+class CostEstimate {
+   public:
+    // Empty estimate, every tile and thread tile costs the same
+    CostEstimate();
+    // Probes the tiles of the current configurations that store doesn't hold on workerCount threads
+    CostEstimate(const SampleStore &store, uint64_t workerCount);
+
+    // Whether nothing was estimated
+    bool empty() const noexcept;
+    // Estimated iterations of every tile by tile index, empty for an empty estimate
+    const std::vector<double> &tileCosts() const noexcept;
+    // Estimated iterations of every thread tile of the tile by thread index into costs, uniform for an empty estimate or a tile without probes.
+    // Thread tiles are charged the probes inside them, or the nearest probe if they hold none
+    void threadTileCosts(uint64_t tileIndex, std::vector<double> &costs) const;
+
+   private:
+    // Probes per tile along each axis
+    uint64_t probesX;
+    uint64_t probesY;
+    // Cost per pixel of every probe, probesX * probesY row by row per tile in tile index order. Empty for tiles that weren't probed
+    std::vector<std::vector<float>> probes;
+    std::vector<double> tiles;
+};
+
+#endif  // COSTMODEL_HPP_INCLUDED
@@ -0,0 +1,486 @@
+#include "Distributed.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+#include "TileGenerator.hpp"
+#include "TileScheduler.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+// How long a worker without tiles waits before asking again, tiles of workers that disconnect are handed out again
+static constexpr std::chrono::milliseconds idleRetryDelay(500);
+// How long the coordinator waits for a connection before checking whether every tile is complete
+static constexpr int acceptPollMilliseconds = 200;
+// Size of a tile record's header: tileIndex, flags and compressedSize
+static constexpr uint64_t tileRecordHeaderSize = 3 * sizeof(uint64_t);
+
+#if defined(_WIN32)
+using SocketHandle = SOCKET;
+static constexpr SocketHandle invalidSocket = INVALID_SOCKET;
+
+static void closeSocket(SocketHandle handle) noexcept {
+    closesocket(handle);
+}
+
+static std::system_error socketError(const std::string &what) {
+    return std::system_error(WSAGetLastError(), std::system_category(), what);
+}
+
+// Winsock has to be started once before the first socket call
+static void startSockets() {
+    static const int started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data);
+    }();
+    if (started != 0) throw std::system_error(started, std::system_category(), "WSAStartup");
+}
+#else
+using SocketHandle = int;
+static constexpr SocketHandle invalidSocket = -1;
+
+static void closeSocket(SocketHandle handle) noexcept {
+    close(handle);
+}
+
+static std::system_error socketError(const std::string &what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+static void startSockets() {}
+#endif
+
+// Connected TCP socket, closed when destroyed
+class Connection {
+   public:
+    explicit Connection(SocketHandle connected) : handle(connected) {}
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+    ~Connection() { closeSocket(handle); }
+
+    // Sends size bytes of data, throws if the connection broke
+    void send(const void *data, uint64_t size) {
+        const char *bytes = static_cast<const char*>(data);
+        while (size > 0) {
+#if defined(_WIN32)
+            const int sent = ::send(handle, bytes, static_cast<int>(std::min<uint64_t>(size, INT32_MAX)), 0);
+#elif defined(MSG_NOSIGNAL)
+            const ssize_t sent = ::send(handle, bytes, size, MSG_NOSIGNAL);
+#else
+            const ssize_t sent = ::send(handle, bytes, size, 0);
+#endif
+            if (sent <= 0) throw socketError("send");
+            bytes += sent;
+            size -= sent;
+        }
+    }
+
+    // Receives exactly size bytes into data. Returns false if the peer closed the connection before sending any of them, throws if it broke in between
+    bool receive(void *data, uint64_t size) {
+        char *bytes = static_cast<char*>(data);
+        bool first = true;
+        while (size > 0) {
+#if defined(_WIN32)
+            const int received = ::recv(handle, bytes, static_cast<int>(std::min<uint64_t>(size, INT32_MAX)), 0);
+#else
+            const ssize_t received = ::recv(handle, bytes, size, 0);
+#endif
+            if (received < 0) throw socketError("recv");
+            if (received == 0) {
+                if (first) return false;
+                throw std::runtime_error("connection closed in the middle of a message");
+            }
+            bytes += received;
+            size -= received;
+            first = false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    void sendValue(const T &value) {
+        send(&value, sizeof(T));
+    }
+
+    template <typename T>
+    T receiveValue() {
+        T value{};
+        if (!receive(&value, sizeof(T))) throw std::runtime_error("connection closed in the middle of a message");
+        return value;
+    }
+
+   private:
+    SocketHandle handle;
+};
+
+// Replaces pConfig with one sized for tConfig, keeping threadsUsed
+static void resetProgressConfiguration() {
+    resetProgressConfiguration(tConfig.tileGridWidth * tConfig.tileGridHeight, tConfig.threadGridWidth * tConfig.threadGridHeight);
+}
+
+// Fields of mConfig and tConfig as the 'C' message and tile files hold them
+static std::vector<unsigned char> configurationFields() {
+    std::vector<unsigned char> fields;
+    putConfigurationFields(fields, mConfig);
+    putConfigurationFields(fields, tConfig);
+    return fields;
+}
+
+// Marks the tile as complete for mConfig.maxIterations in pConfig and journals it unless pConfig already had it
+static void markTileCompleted(uint64_t tileIndex) {
+    std::atomic_ref<unsigned char>(pConfig.tileCompletion[tileIndex / 8]).fetch_or(static_cast<unsigned char>(1 << (tileIndex % 8)));
+    if (std::atomic_ref<int64_t>(pConfig.tileBudgets[tileIndex]).exchange(mConfig.maxIterations) != mConfig.maxIterations) journalTileCompletion(tileIndex);
+}
+
+// Bytes of a tile's zlib stream before compression, its samples followed by its distances with DistanceRender
+static uLong tileRecordSize(const SampleStore &store) noexcept {
+    const uLong distanceSize = mConfig.renderFlags & DistanceRender ? store.tileSampleCount() * sizeof(DistanceSample) : 0;
+    return store.tileSampleCount() * sizeof(StoredSample) + distanceSize;
+}
+
+// Tile record of the completed tile in store, see the tile file specification
+static std::vector<unsigned char> tileRecord(const SampleStore &store, uint64_t tileIndex) {
+    const uLong sampleSize = store.tileSampleCount() * sizeof(StoredSample);
+    const uLong size = tileRecordSize(store);
+    std::vector<unsigned char> uncompressed(size);
+    memcpy(uncompressed.data(), store.tile(tileIndex), sampleSize);
+    if (size > sampleSize) memcpy(uncompressed.data() + sampleSize, store.distances(tileIndex), size - sampleSize);
+
+    uLongf compressedSize = compressBound(size);
+    std::vector<unsigned char> record(tileRecordHeaderSize + compressedSize);
+    if (compress2(record.data() + tileRecordHeaderSize, &compressedSize, uncompressed.data(), size, Z_BEST_SPEED) != Z_OK) {
+        throw std::runtime_error("compressing tile " + std::to_string(tileIndex) + " failed");
+    }
+    const uint64_t header[3] = {tileIndex, store.tileFlags(tileIndex) & TileSinglePrecision, compressedSize};
+    memcpy(record.data(), header, sizeof(header));
+    record.resize(tileRecordHeaderSize + compressedSize);
+    return record;
+}
+
+// Decompresses a tile record's samples and distances into its tile in store and completes the tile there and in pConfig
+static void completeTileRecord(SampleStore &store, const uint64_t header[3], const std::vector<unsigned char> &compressed) {
+    const uint64_t tileIndex = header[0];
+    if (tileIndex >= pConfig.tileCount) throw std::out_of_range("tile record for tile " + std::to_string(tileIndex) + " of " + std::to_string(pConfig.tileCount));
+    const uLong sampleSize = store.tileSampleCount() * sizeof(StoredSample);
+    const uLong size = tileRecordSize(store);
+    std::vector<unsigned char> uncompressed(size);
+    uLongf decompressedSize = size;
+    if (uncompress(uncompressed.data(), &decompressedSize, compressed.data(), compressed.size()) != Z_OK || decompressedSize != size) {
+        throw std::runtime_error("corrupt samples of tile " + std::to_string(tileIndex));
+    }
+    memcpy(store.tile(tileIndex), uncompressed.data(), sampleSize);
+    if (size > sampleSize) memcpy(store.distances(tileIndex), uncompressed.data() + sampleSize, size - sampleSize);
+    store.completeTile(tileIndex, header[1] & TileSinglePrecision);
+    markTileCompleted(tileIndex);
+}
+
+// Tiles of coordinateRender, guarded by mutex
+struct Coordination {
+    std::mutex mutex;
+    // Tiles nobody has been assigned, or that came back from a broken connection
+    std::deque<uint64_t> pending;
+    // Tiles not returned yet
+    uint64_t remaining;
+
+    Coordination() : mutex(), pending(), remaining(0) {}
+};
+
+// Serves one worker until it disconnects or every tile is complete
+static void serveWorker(std::unique_ptr<Connection> connection, Coordination &coordination, SampleStore &store, uint64_t rangeSize) {
+    std::vector<uint64_t> assigned;
+    try {
+        if (connection->receiveValue<unsigned char>() != 'H' || connection->receiveValue<uint64_t>() != byteOrderMark || connection->receiveValue<uint64_t>() != protocolVersion) {
+            throw std::runtime_error("not a worker of this protocol version and byte order");
+        }
+        const std::vector<unsigned char> configurations = configurationFields();
+        connection->sendValue<unsigned char>('C');
+        connection->send(configurations.data(), configurations.size());
+
+        unsigned char type;
+        while (connection->receive(&type, 1)) {
+            if (type == 'R') {
+                std::vector<uint64_t> range;
+                bool done;
+                {
+                    std::lock_guard<std::mutex> lock(coordination.mutex);
+                    done = coordination.remaining == 0;
+                    while (!coordination.pending.empty() && range.size() < rangeSize) {
+                        range.push_back(coordination.pending.front());
+                        coordination.pending.pop_front();
+                    }
+                }
+                if (done) {
+                    connection->sendValue<unsigned char>('D');
+                    return;
+                }
+                assigned.insert(assigned.end(), range.begin(), range.end());
+                connection->sendValue<unsigned char>('A');
+                connection->sendValue<uint64_t>(range.size());
+                connection->send(range.data(), range.size() * sizeof(uint64_t));
+            } else if (type == 'T') {
+                uint64_t header[3];
+                if (!connection->receive(header, sizeof(header))) throw std::runtime_error("connection closed in the middle of a message");
+                const auto found = std::find(assigned.begin(), assigned.end(), header[0]);
+                if (found == assigned.end()) throw std::runtime_error("returned tile " + std::to_string(header[0]) + " wasn't assigned to it");
+                if (header[2] > compressBound(tileRecordSize(store))) throw std::runtime_error("tile record too big");
+                std::vector<unsigned char> compressed(header[2]);
+                if (!connection->receive(compressed.data(), compressed.size())) throw std::runtime_error("connection closed in the middle of a message");
+
+                // Different tiles of the store are completed concurrently, each completion is journaled to the open ".mpc" file
+                completeTileRecord(store, header, compressed);
+                assigned.erase(found);
+                std::lock_guard<std::mutex> lock(coordination.mutex);
+                coordination.remaining--;
+                std::cout << "tile " << header[0] << " complete, " << coordination.remaining << " remaining" << std::endl;
+            } else {
+                throw std::runtime_error("unknown message type " + std::to_string(type));
+            }
+        }
+    } catch (const std::exception &error) {
+        std::cerr << "worker dropped: " << error.what() << std::endl;
+    }
+
+    // Tiles the worker didn't return go to the front, so the next request picks them up
+    std::lock_guard<std::mutex> lock(coordination.mutex);
+    for (auto tileIndex = assigned.rbegin(); tileIndex != assigned.rend(); tileIndex++) coordination.pending.push_front(*tileIndex);
+}
+
+void coordinateRender(uint16_t port, uint64_t rangeSize, const std::filesystem::path &storePath) {
+    startSockets();
+    // Features that need more than a tile's samples are left to generateImage
+    mConfig.renderFlags &= ~static_cast<uint64_t>(ProgressiveRender | EscalationRender);
+    SampleStore store(storePath);
+
+    Coordination coordination;
+    for (uint64_t tileIndex = 0; tileIndex < pConfig.tileCount; tileIndex++) {
+        if (store.tileCompleted(tileIndex)) {
+            markTileCompleted(tileIndex);
+        } else {
+            coordination.pending.push_back(tileIndex);
+        }
+    }
+    coordination.remaining = coordination.pending.size();
+    if (coordination.remaining == 0) return;
+
+    const SocketHandle listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == invalidSocket) throw socketError("socket");
+    const Connection listening(listener);
+    const int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) throw socketError("bind to port " + std::to_string(port));
+    if (listen(listener, SOMAXCONN) != 0) throw socketError("listen");
+    std::cout << "coordinating " << coordination.remaining << " tiles on port " << port << std::endl;
+
+    std::vector<std::thread> workers;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(coordination.mutex);
+            if (coordination.remaining == 0) break;
+        }
+        pollfd waiting = {};
+        waiting.fd = listener;
+        waiting.events = POLLIN;
+#if defined(_WIN32)
+        const int ready = WSAPoll(&waiting, 1, acceptPollMilliseconds);
+#else
+        const int ready = poll(&waiting, 1, acceptPollMilliseconds);
+#endif
+        if (ready < 0 && errno != EINTR) throw socketError("poll");
+        if (ready <= 0) continue;
+        const SocketHandle accepted = accept(listener, nullptr, nullptr);
+        if (accepted == invalidSocket) continue;
+        workers.push_back(boundThread(serveWorker, std::make_unique<Connection>(accepted), std::ref(coordination), std::ref(store), rangeSize));
+    }
+    // Every worker is told it is done on its next request
+    for (std::thread &worker : workers) worker.join();
+}
+
+// Connects to host at port
+static SocketHandle connectTo(const std::string &host, uint16_t port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    const int resolved = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses);
+    if (resolved != 0) throw std::runtime_error("resolving " + host + " failed: " + gai_strerror(resolved));
+
+    SocketHandle handle = invalidSocket;
+    for (const addrinfo *address = addresses; address != nullptr && handle == invalidSocket; address = address->ai_next) {
+        handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (handle == invalidSocket) continue;
+        if (connect(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0) {
+            closeSocket(handle);
+            handle = invalidSocket;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (handle == invalidSocket) throw socketError("connecting to " + host + ":" + std::to_string(port));
+    return handle;
+}
+
+// Replaces our configurations with the ones in fields like loadConfiguration does, throws if they can't be rendered. what names their source
+static void adoptConfigurations(const std::vector<unsigned char> &fields, const std::string &what) {
+    MandelbrotsetConfiguration configuration = mConfig;
+    TileConfiguration tileConfiguration = tConfig;
+    if (!readConfigurationFields(fields.data(), configuration) || !readConfigurationFields(fields.data() + mandelbrotsetFieldsSize, tileConfiguration)) {
+        throw std::invalid_argument(what + " can't be rendered");
+    }
+    mConfig = configuration;
+    tConfig = tileConfiguration;
+    resetProgressConfiguration();
+}
+
+// Asks for the next range of tiles into range. Returns false once the coordinator is done
+static bool requestRange(Connection &connection, std::vector<uint64_t> &range) {
+    connection.sendValue<unsigned char>('R');
+    const unsigned char type = connection.receiveValue<unsigned char>();
+    range.clear();
+    if (type == 'D') return false;
+    if (type != 'A') throw std::runtime_error("unknown message type " + std::to_string(type));
+    const uint64_t count = connection.receiveValue<uint64_t>();
+    if (count > pConfig.tileCount) throw std::runtime_error("assignment of " + std::to_string(count) + " tiles");
+    range.resize(count);
+    if (!connection.receive(range.data(), count * sizeof(uint64_t)) && count != 0) throw std::runtime_error("connection closed in the middle of a message");
+    for (const uint64_t tileIndex : range) {
+        if (tileIndex >= pConfig.tileCount) throw std::out_of_range("assigned tile " + std::to_string(tileIndex) + " of " + std::to_string(pConfig.tileCount));
+    }
+    return true;
+}
+
+void workForCoordinator(const std::string &host, uint16_t port, const std::filesystem::path &tileFilePath) {
+    startSockets();
+    Connection connection(connectTo(host, port));
+    connection.sendValue<unsigned char>('H');
+    connection.sendValue<uint64_t>(byteOrderMark);
+    connection.sendValue<uint64_t>(protocolVersion);
+
+    // The coordinator's configurations replace ours like loadConfiguration, once they are known to be renderable
+    if (connection.receiveValue<unsigned char>() != 'C') throw std::runtime_error("coordinator didn't send its configurations");
+    std::vector<unsigned char> configurations(mandelbrotsetFieldsSize + tileFieldsSize);
+    if (!connection.receive(configurations.data(), configurations.size())) throw std::runtime_error("connection closed in the middle of a message");
+    adoptConfigurations(configurations, "coordinator's configurations");
+
+    std::ofstream tileFile;
+    if (!tileFilePath.empty()) {
+        tileFile.open(tileFilePath, std::ios::binary);
+        if (!tileFile) throw std::system_error(errno, std::generic_category(), tileFilePath.string());
+        tileFile.write("TF", 2);
+        tileFile.write(reinterpret_cast<const char*>(&tileFileVersion), sizeof(tileFileVersion));
+        tileFile.write(reinterpret_cast<const char*>(configurations.data()), configurations.size());
+    }
+
+    SampleStore store("");
+    TileScheduler scheduler(store, pConfig.threadsUsed, false);
+    std::vector<uint64_t> current;
+    std::vector<uint64_t> next;
+    bool assigning = requestRange(connection, current);
+    for (const uint64_t tileIndex : current) scheduler.submit(tileIndex, allPasses);
+    while (assigning || !current.empty()) {
+        if (current.empty()) {
+            std::this_thread::sleep_for(idleRetryDelay);
+            assigning = requestRange(connection, current);
+            for (const uint64_t tileIndex : current) scheduler.submit(tileIndex, allPasses);
+            continue;
+        }
+
+        // The next range is computed while this one is sent
+        if (assigning) {
+            assigning = requestRange(connection, next);
+            for (const uint64_t tileIndex : next) scheduler.submit(tileIndex, allPasses);
+        }
+        for (const uint64_t tileIndex : current) {
+            scheduler.wait(tileIndex);
+            const std::vector<unsigned char> record = tileRecord(store, tileIndex);
+            connection.sendValue<unsigned char>('T');
+            connection.send(record.data(), record.size());
+            if (tileFile.is_open() && !tileFile.write(reinterpret_cast<const char*>(record.data()), record.size())) {
+                throw std::system_error(errno, std::generic_category(), tileFilePath.string());
+            }
+        }
+        std::cout << current.size() << " tiles returned" << std::endl;
+        std::swap(current, next);
+        next.clear();
+    }
+}
+
+uint64_t mergeTileFiles(const std::vector<std::filesystem::path> &tileFilePaths, const std::filesystem::path &storePath) {
+    std::vector<std::ifstream> tileFiles;
+    std::vector<unsigned char> firstHeader;
+    for (const std::filesystem::path &path : tileFilePaths) {
+        std::ifstream &tileFile = tileFiles.emplace_back(path, std::ios::binary);
+        if (!tileFile) throw std::system_error(errno, std::generic_category(), path.string());
+        char magic[2];
+        uint64_t version = 0;
+        std::vector<unsigned char> header(mandelbrotsetFieldsSize + tileFieldsSize);
+        if (!tileFile.read(magic, 2) || strncmp(magic, "TF", 2) != 0 || !tileFile.read(reinterpret_cast<char*>(&version), sizeof(version))) {
+            throw std::invalid_argument("not a tile file: " + path.string());
+        }
+        if (version != tileFileVersion) throw std::invalid_argument("tile file of another version or byte order: " + path.string());
+        if (!tileFile.read(reinterpret_cast<char*>(header.data()), header.size())) throw std::invalid_argument("not a tile file: " + path.string());
+        if (tileFiles.size() == 1) {
+            firstHeader = header;
+        } else if (firstHeader != header) {
+            throw std::invalid_argument("tile file made for other configurations than " + tileFilePaths[0].string() + ": " + path.string());
+        }
+    }
+    if (tileFiles.empty()) return pConfig.tileCount;
+
+    adoptConfigurations(firstHeader, "configurations of " + tileFilePaths[0].string());
+
+    SampleStore store(storePath);
+    const uint64_t maxCompressedSize = compressBound(tileRecordSize(store));
+    for (uint64_t file = 0; file < tileFiles.size(); file++) {
+        uint64_t header[3];
+        std::vector<unsigned char> compressed;
+        while (tileFiles[file].read(reinterpret_cast<char*>(header), sizeof(header))) {
+            if (header[2] > maxCompressedSize) throw std::invalid_argument("corrupt tile record in " + tileFilePaths[file].string());
+            compressed.resize(header[2]);
+            if (!tileFiles[file].read(reinterpret_cast<char*>(compressed.data()), compressed.size())) throw std::invalid_argument("truncated tile record in " + tileFilePaths[file].string());
+            completeTileRecord(store, header, compressed);
+        }
+    }
+
+    uint64_t missing = 0;
+    for (uint64_t tileIndex = 0; tileIndex < pConfig.tileCount; tileIndex++) {
+        if (!store.tileCompleted(tileIndex)) missing++;
+    }
+    return missing;
+}
@@ -0,0 +1,66 @@
+#ifndef DISTRIBUTED_HPP_INCLUDED
+#define DISTRIBUTED_HPP_INCLUDED
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/*
+Distributed rendering protocol:
+    One coordinator hands out the tiles of the current configurations to any number of workers over TCP. Every message starts with its type byte,
+    values are in native byte order, so coordinator and workers have to share it (checked by the hello message).
+
+    Worker to coordinator:
+        'H' hello:       byteOrderMark (uint64_t 0x0102030405060708), protocolVersion (uint64_t)
+        'R' request:     no payload, asks for the next range of tiles
+        'T' tile:        tile record, see the tile file specification below
+
+    Coordinator to worker:
+        'C' configure:   MandelbrotsetConfiguration, TileConfiguration (as putConfigurationFields writes them, little-endian) Note: workers refuse configurations
+                         loadConfiguration would refuse, see validConfiguration
+        'A' assignment:  count (uint64_t), tileIndices (uint64_t[count]) Note: count 0 means every tile left is assigned to other workers, ask again later
+        'D' done:        no payload, every tile is complete
+
+    The coordinator takes back the unreturned tiles of a worker whose connection breaks and hands them out again.
+
+Tile file specification:
+    Filename has to end in ".mtf" which stands for Mandelbrotset Tile File.
+    Byte layout:
+        Magic numbers:
+        byte[0, 1]                           = 'T' (0x54), 'F' (0x46) (char, char)
+        byte[2, ..., 9]                      = version                           (uint64_t) Note: 3, files of other versions or byte orders aren't merged
+
+        Configurations the tiles were computed with:
+        byte[10, ..., 145]                   = MandelbrotsetConfiguration, as putConfigurationFields writes it
+        byte[146, ..., 193]                  = TileConfiguration, as putConfigurationFields writes it
+
+        Tile records until the end of the file, in the order they were computed:
+        byte[0, ..., 7]                      = tileIndex                         (uint64_t)
+        byte[8, ..., 15]                     = flags                             (uint64_t) Note: TileRecordFlag bits of the tile in the worker's sample store
+        byte[16, ..., 23]                    = compressedSize                    (uint64_t)
+        byte[24, ..., 23 + compressedSize]   = samples                           (zlib stream of tileWidth * tileHeight StoredSamples,
+                                                                                     followed by as many DistanceSamples with DistanceRender)
+*/
+
+// Value of the hello message's byteOrderMark, read in the coordinator's byte order
+constexpr uint64_t byteOrderMark = 0x0102030405060708ULL;
+// Raised whenever a message's or tile record's layout changes, e.g. when a configuration gains fields
+constexpr uint64_t protocolVersion = 3;
+// Version of the tile file layout, files from before the version field count as 1
+constexpr uint64_t tileFileVersion = 3;
+
+// Listens on port and hands the tiles pConfig.tileCompletion doesn't mark out to the connecting workers, rangeSize at a time, until every tile is complete.
+// Returned tiles go into the sample store at storePath and pConfig.tileCompletion, each one is journaled to the open progress journal (see openProgressJournal),
+// so an interrupted coordinator resumes with the tiles still missing. ProgressiveRender and EscalationRender are cleared from mConfig first,
+// workers only return finished samples. Encode the image with generateImage afterwards, it finds every tile complete
+void coordinateRender(uint16_t port, uint64_t rangeSize, const std::filesystem::path &storePath);
+
+// Connects to the coordinator at host and port, takes over its configurations and computes the tiles it hands out until it is done, using pConfig.threadsUsed threads.
+// Every returned tile is also appended to the tile file at tileFilePath unless it is empty
+void workForCoordinator(const std::string &host, uint16_t port, const std::filesystem::path &tileFilePath);
+
+// Takes over the configurations of the tile files at tileFilePaths, which have to agree, and completes every tile they hold in the sample store at storePath
+// and pConfig.tileCompletion. Encode the image with generateImage afterwards, it computes the tiles no file holds. Returns the number of tiles missing
+uint64_t mergeTileFiles(const std::vector<std::filesystem::path> &tileFilePaths, const std::filesystem::path &storePath);
+
+#endif  // DISTRIBUTED_HPP_INCLUDED
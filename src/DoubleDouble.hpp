@@ -0,0 +1,62 @@
+#ifndef DOUBLEDOUBLE_HPP_INCLUDED
+#define DOUBLEDOUBLE_HPP_INCLUDED
+
+// Unevaluated sum of two doubles (hi + lo, |lo| <= ulp(hi) / 2) giving about 106 bits of mantissa, enough for zooms down to about 1e-30.
+// The error-free transformations below rely on strict IEEE evaluation order, so this header must only be used from translation units
+// compiled without -ffast-math and without floating point contraction (see Perturbation.cpp in CMakeLists.txt).
+struct DoubleDouble {
+    double hi;
+    double lo;
+
+    DoubleDouble() : hi(0), lo(0) {}
+    DoubleDouble(double a) : hi(a), lo(0) {}
+    DoubleDouble(double h, double l) : hi(h), lo(l) {}
+};
+
+// a + b exactly as s + e, requires |a| >= |b|
+inline DoubleDouble quickTwoSum(double a, double b) noexcept {
+    const double s = a + b;
+    return {s, b - (s - a)};
+}
+
+// a + b exactly as s + e
+inline DoubleDouble twoSum(double a, double b) noexcept {
+    const double s = a + b;
+    const double bb = s - a;
+    return {s, (a - (s - bb)) + (b - bb)};
+}
+
+// a * b exactly as p + e, using Dekker's split so no fused multiply-add is needed
+inline DoubleDouble twoProduct(double a, double b) noexcept {
+    constexpr double splitter = 134217729.0;  // 2^27 + 1
+    const double p = a * b;
+    const double ta = splitter * a, tb = splitter * b;
+    const double aHi = ta - (ta - a), aLo = a - aHi;
+    const double bHi = tb - (tb - b), bLo = b - bHi;
+    return {p, ((aHi * bHi - p) + aHi * bLo + aLo * bHi) + aLo * bLo};
+}
+
+inline DoubleDouble operator+(const DoubleDouble &a, const DoubleDouble &b) noexcept {
+    DoubleDouble s = twoSum(a.hi, b.hi);
+    const DoubleDouble t = twoSum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = quickTwoSum(s.hi, s.lo);
+    s.lo += t.lo;
+    return quickTwoSum(s.hi, s.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble &a) noexcept {
+    return {-a.hi, -a.lo};
+}
+
+inline DoubleDouble operator-(const DoubleDouble &a, const DoubleDouble &b) noexcept {
+    return a + -b;
+}
+
+inline DoubleDouble operator*(const DoubleDouble &a, const DoubleDouble &b) noexcept {
+    DoubleDouble p = twoProduct(a.hi, b.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return quickTwoSum(p.hi, p.lo);
+}
+
+#endif  // DOUBLEDOUBLE_HPP_INCLUDED
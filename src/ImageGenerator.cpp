@@ -0,0 +1,233 @@
+#include "ImageGenerator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Colorizer.hpp"
+#include "CostModel.hpp"
+#include "PngEncoder.hpp"
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+#include "Telemetry.hpp"
+#include "TileGenerator.hpp"
+#include "TileScheduler.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+// Submits pass of tiles in order of decreasing estimated cost, so the slowest tiles don't start last and hold up the ones waiting for them
+static void submitTiles(TileScheduler &scheduler, const CostEstimate &estimate, std::vector<uint64_t> tiles, uint64_t pass) {
+    if (!estimate.empty()) {
+        std::stable_sort(tiles.begin(), tiles.end(), [&estimate](uint64_t a, uint64_t b) { return estimate.tileCosts()[a] > estimate.tileCosts()[b]; });
+    }
+    for (const uint64_t tileIndex : tiles) scheduler.submit(tileIndex, pass);
+}
+
+// Submits pass of every tile of the band of tiles at tileY
+static void submitBand(TileScheduler &scheduler, const CostEstimate &estimate, uint64_t tileY, uint64_t pass) {
+    std::vector<uint64_t> tiles;
+    for (uint64_t tileX = 0; tileX < tConfig.tileGridWidth; tileX++) tiles.push_back(tConfig.tileIndex(tileX, tileY));
+    submitTiles(scheduler, estimate, tiles, pass);
+}
+
+// Submits pass of every tile
+static void submitImage(TileScheduler &scheduler, const CostEstimate &estimate, uint64_t pass) {
+    std::vector<uint64_t> tiles(tConfig.tileGridWidth * tConfig.tileGridHeight);
+    for (uint64_t tileIndex = 0; tileIndex < tiles.size(); tileIndex++) tiles[tileIndex] = tileIndex;
+    submitTiles(scheduler, estimate, tiles, pass);
+}
+
+// Path of another output next to filepath, image.png becomes image.<name>.png
+static std::filesystem::path siblingPath(const std::filesystem::path &filepath, const std::string &name) {
+    std::filesystem::path path = filepath;
+    path.replace_filename(filepath.stem().string() + "." + name + filepath.extension().string());
+    return path;
+}
+
+// Path of the preview downscaled by stride next to filepath, image.png becomes image.preview4.png
+static std::filesystem::path previewPath(const std::filesystem::path &filepath, uint64_t stride) {
+    return siblingPath(filepath, "preview" + std::to_string(stride));
+}
+
+static void writeChannel(unsigned char *out, double value) noexcept {
+    const unsigned channel = static_cast<unsigned>(std::clamp(value, 0.0, 1.0) * 65535 + 0.5);
+    out[0] = static_cast<unsigned char>(channel >> 8);
+    out[1] = static_cast<unsigned char>(channel);
+}
+
+// Writes the distances of the completed store next to filepath as 16 bit PNGs. image.distance.png is grayscale with the distance in pixels as 8.8 fixed point,
+// so 256 pixels and more are white and the set itself is black. image.normal.png is a normal map of the distance field's slope, red pointing right
+// and green pointing up in the image whichever way the view runs, flat (0.5, 0.5, 1) within the set
+static void writeDistanceImages(const std::filesystem::path &filepath, const SampleStore &store) {
+    const uint64_t tileWidth = tConfig.tileWidth();
+    const uint64_t tileHeight = tConfig.tileHeight();
+    const auto start = std::chrono::steady_clock::now();
+
+    const double stepReal = mConfig.pixelStepReal(tConfig.imageWidth);
+    const double stepImag = mConfig.pixelStepImag(tConfig.imageHeight);
+    const double pixelStep = std::min(std::abs(stepReal), std::abs(stepImag));
+    // Image rows run down, so the normal's imaginary part points up exactly when the imaginary axis runs down the rows
+    const double right = stepReal < 0 ? -1 : 1;
+    const double up = stepImag < 0 ? 1 : -1;
+    constexpr double diagonal = std::numbers::sqrt2 / 2;
+
+    PngEncoder distancePng(siblingPath(filepath, "distance"), tConfig.imageWidth, tConfig.imageHeight, 16, PngGrayscale);
+    PngEncoder normalPng(siblingPath(filepath, "normal"), tConfig.imageWidth, tConfig.imageHeight, 16, PngRGB);
+    std::vector<unsigned char> distanceRow(distancePng.rowSize()), normalRow(normalPng.rowSize());
+    for (uint64_t y = 0; y < tConfig.imageHeight; y++) {
+        for (uint64_t x = 0; x < tConfig.imageWidth; x++) {
+            const DistanceSample &sample = store.distances(tConfig.tileIndex(x / tileWidth, y / tileHeight))[(y % tileHeight) * tileWidth + x % tileWidth];
+            writeChannel(distanceRow.data() + 2 * x, sample.distance / pixelStep * 256 / 65535);
+            // n = (cos, sin, 1) / sqrt(2) outside the set, (0, 0, 1) inside, mapped from [-1, 1] to [0, 1]
+            const bool exterior = sample.distance > 0;
+            const double normalX = exterior ? right * std::cos(sample.normalAngle) * diagonal : 0;
+            const double normalY = exterior ? up * std::sin(sample.normalAngle) * diagonal : 0;
+            const double normalZ = exterior ? diagonal : 1;
+            writeChannel(normalRow.data() + 6 * x, (normalX + 1) / 2);
+            writeChannel(normalRow.data() + 6 * x + 2, (normalY + 1) / 2);
+            writeChannel(normalRow.data() + 6 * x + 4, (normalZ + 1) / 2);
+        }
+        distancePng.writeRows(distanceRow.data(), 1);
+        normalPng.writeRows(normalRow.data(), 1);
+    }
+    distancePng.finish();
+    normalPng.finish();
+    countOutputTime(std::chrono::steady_clock::now() - start);
+}
+
+// Writes every stride-th sample of the image in both directions as a PNG downscaled by stride.
+// These are exactly the pixels of the progressive passes with at least that stride, histogram equalization only counts them.
+// Later passes never write these pixels, so this can run while they are computed
+static void writePreview(const std::filesystem::path &filepath, const SampleStore &store, const ColorSettings &colorSettings, uint64_t stride) {
+    const uint64_t tileWidth = tConfig.tileWidth();
+    const uint64_t tileHeight = tConfig.tileHeight();
+    const uint64_t width = (tConfig.imageWidth + stride - 1) / stride;
+    const uint64_t height = (tConfig.imageHeight + stride - 1) / stride;
+    if (width == 0 || height == 0) return;
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<StoredSample> samples(width * height);
+    for (uint64_t previewY = 0; previewY < height; previewY++) {
+        const uint64_t y = previewY * stride;
+        for (uint64_t previewX = 0; previewX < width; previewX++) {
+            const uint64_t x = previewX * stride;
+            const StoredSample *tile = store.tile(tConfig.tileIndex(x / tileWidth, y / tileHeight));
+            samples[previewY * width + previewX] = tile[(y % tileHeight) * tileWidth + x % tileWidth];
+        }
+    }
+
+    Colorizer colorizer(colorSettings);
+    if (colorizer.needsHistogram()) colorizer.buildHistogram(samples.data(), samples.size());
+    PngEncoder png(filepath, width, height, colorizer.bitDepth(), PngRGB);
+    std::vector<unsigned char> row(png.rowSize());
+    for (uint64_t previewY = 0; previewY < height; previewY++) {
+        colorizer.colorize(samples.data() + previewY * width, width, row.data());
+        png.writeRows(row.data(), 1);
+    }
+    png.finish();
+    countOutputTime(std::chrono::steady_clock::now() - start);
+}
+
+void generateImage(const std::filesystem::path &filepath, const std::filesystem::path &storePath, const ColorSettings &colorSettings, const SupersampleSettings &supersampleSettings) {
+    TileScheduler scheduler(pConfig.threadsUsed);
+    generateImage(scheduler, filepath, storePath, colorSettings, supersampleSettings);
+}
+
+void generateImage(TileScheduler &scheduler, const std::filesystem::path &filepath, const std::filesystem::path &storePath, const ColorSettings &colorSettings,
+                   const SupersampleSettings &supersampleSettings) {
+    if ((mConfig.renderFlags & DeepZoomRender) && mConfig.formula != MandelbrotFormula) throw std::invalid_argument("DeepZoomRender only supports MandelbrotFormula");
+    const uint64_t tileWidth = tConfig.tileWidth();
+    const uint64_t tileHeight = tConfig.tileHeight();
+    const uint64_t imageWidth = tConfig.imageWidth;
+
+    SampleStore store(storePath);
+    budgetHistory = store.budgetHistory();
+    Colorizer colorizer(colorSettings);
+    PngEncoder png(filepath, imageWidth, tConfig.imageHeight, colorizer.bitDepth(), PngRGB);
+    const uint64_t rowSize = png.rowSize();
+    const uint64_t bandSize = rowSize * tileHeight;
+
+    // The cost pre-pass orders the tiles and sizes the units of work of the scheduler, and gives the ETA its basis
+    const CostEstimate estimate(store, pConfig.threadsUsed);
+    setTileCostEstimate(estimate.tileCosts());
+    const StoreAttachment attachment(scheduler, store, supersampleSettings.factor > 1);
+    scheduler.setCostEstimate(&estimate);
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+
+    // The coarse progressive passes cover the whole image before their preview is written, the last pass only computes the pixels they left out
+    uint64_t pass = allPasses;
+    std::future<void> preview;
+    if (mConfig.renderFlags & ProgressiveRender) {
+        for (pass = 0; pass + 1 < progressivePassCount; pass++) {
+            submitImage(scheduler, estimate, pass);
+            for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) scheduler.wait(tileIndex);
+            if (preview.valid()) preview.get();
+            preview = boundAsync(writePreview, previewPath(filepath, progressiveStride(pass)), std::cref(store), std::cref(colorSettings), progressiveStride(pass));
+        }
+    }
+
+    // Histogram equalization needs every sample before the first pixel can be colored, so iterating and encoding can't overlap
+    if (colorizer.needsHistogram()) {
+        submitImage(scheduler, estimate, pass);
+        for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) scheduler.wait(tileIndex);
+        colorizer.buildHistogram(store);
+    } else if (tConfig.tileGridHeight > 0) {
+        submitBand(scheduler, estimate, 0, pass);
+    }
+
+    // One band is filled while the other one is compressed
+    std::vector<unsigned char> bands[2] = {std::vector<unsigned char>(bandSize), std::vector<unsigned char>(bandSize)};
+    std::future<void> encoding;
+
+    for (uint64_t tileY = 0; tileY < tConfig.tileGridHeight; tileY++) {
+        // Workers move on to the next band's thread tiles while the last ones of this band finish
+        if (tileY + 1 < tConfig.tileGridHeight) submitBand(scheduler, estimate, tileY + 1, pass);
+
+        std::vector<unsigned char> &band = bands[tileY % 2];
+        for (uint64_t tileX = 0; tileX < tConfig.tileGridWidth; tileX++) {
+            const uint64_t tileIndex = tConfig.tileIndex(tileX, tileY);
+            scheduler.wait(tileIndex);
+
+            const auto start = std::chrono::steady_clock::now();
+            const StoredSample *tile = store.tile(tileIndex);
+            // Tiles at the right and bottom edges only partly lie within the image, their samples past it are never computed
+            const uint64_t tileColumns = tConfig.tileWidthAt(tileX);
+            for (uint64_t row = 0; row < tConfig.tileHeightAt(tileY); row++) {
+                unsigned char *out = band.data() + row * rowSize + tileX * tileWidth * colorizer.bytesPerPixel();
+                colorizer.colorize(tile + row * tileWidth, tileColumns, out);
+            }
+            countOutputTime(std::chrono::steady_clock::now() - start);
+        }
+
+        // Supersampling is queued behind the next band's tiles, the band is encoded once its tiles are refined
+        if (supersampleSettings.factor > 1) {
+            for (uint64_t tileX = 0; tileX < tConfig.tileGridWidth; tileX++) {
+                scheduler.supersample(tConfig.tileIndex(tileX, tileY), supersampleSettings, colorizer, band.data() + tileX * tileWidth * colorizer.bytesPerPixel(), rowSize);
+            }
+            for (uint64_t tileX = 0; tileX < tConfig.tileGridWidth; tileX++) scheduler.wait(tConfig.tileIndex(tileX, tileY));
+        }
+
+        // The previous band has to be written before its buffer gets reused, and rows have to reach the encoder in order
+        if (encoding.valid()) encoding.get();
+        encoding = boundAsync([&png, &band, bandRows = tConfig.tileHeightAt(tileY)] {
+            const auto start = std::chrono::steady_clock::now();
+            png.writeRows(band.data(), bandRows);
+            countOutputTime(std::chrono::steady_clock::now() - start);
+        });
+    }
+    if (encoding.valid()) encoding.get();
+    if (preview.valid()) preview.get();
+    png.finish();
+    if (mConfig.renderFlags & DistanceRender) writeDistanceImages(filepath, store);
+}
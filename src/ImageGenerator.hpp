@@ -0,0 +1,31 @@
+#ifndef IMAGEGENERATOR_HPP_INCLUDED
+#define IMAGEGENERATOR_HPP_INCLUDED
+#include <filesystem>
+
+#include "Colorizer.hpp"
+#include "TileGenerator.hpp"
+#include "TileScheduler.hpp"
+
+// Renders the whole image tile row by tile row and streams it into a PNG at filepath.
+// Samples go through the memory mapped sample store at storePath: tiles it already holds from an earlier run aren't computed again,
+// so an interrupted render resumes where it stopped and a finished one is re-encoded without iterating.
+// Only the band of tiles being assembled and the band being compressed are held in memory, compression of one band runs on its own thread
+// while the tiles of the next band are computed. Tiles are computed by a TileScheduler that already works on the next band while the current one is finished,
+// finished tiles are marked in pConfig.tileCompletion. A CostEstimate pre-pass first probes every tile still to compute: tiles are submitted costliest first
+// within what is submitted together, and the scheduler sizes its units of work by the estimate (see TileScheduler::setCostEstimate).
+// Pixels are colored from the stored samples according to colorSettings, with histogram equalization every tile is computed before the first band is encoded.
+// With ProgressiveRender the image is first computed at 1/16 and 1/4 of its pixels, each written as a preview downscaled by 4 and 2 next to filepath
+// (image.preview4.png and image.preview2.png), and the full resolution pass then only computes the pixels the previews didn't.
+// With EscalationRender a store computed with a smaller maxIterations is kept and only its unresolved pixels are continued, budgetHistory is set to the store's.
+// With a supersampleSettings.factor above 1 the colored pixels of every band are refined by supersampling on the workers before the band is encoded,
+// the subsamples never reach the store and the previews aren't supersampled.
+// With DistanceRender the distance estimate and normal map are written next to filepath as well (image.distance.png and image.normal.png).
+void generateImage(const std::filesystem::path &filepath, const std::filesystem::path &storePath, const ColorSettings &colorSettings, const SupersampleSettings &supersampleSettings);
+
+// generateImage on the workers of scheduler instead of a TileScheduler of pConfig.threadsUsed workers of its own. The scheduler is attached to the store
+// for the render and detached again afterwards, also when it throws. Canceling the scheduler makes this throw std::errc::operation_canceled,
+// the tiles completed until then stay in the store
+void generateImage(TileScheduler &scheduler, const std::filesystem::path &filepath, const std::filesystem::path &storePath, const ColorSettings &colorSettings,
+                   const SupersampleSettings &supersampleSettings);
+
+#endif  // IMAGEGENERATOR_HPP_INCLUDED
@@ -0,0 +1,52 @@
+#ifndef KERNEL_HPP_INCLUDED
+#define KERNEL_HPP_INCLUDED
+#include <array>
+#include <cstdint>
+
+#include "Mandelbrotset.hpp"
+#include "Saves.hpp"
+
+// Entry points of one formula within a kernel family, see formulaKernels in KernelTemplates.hpp
+struct FormulaKernel {
+    // Computes 8 sequential pixels, see computeIterationsVector
+    void (*computeIterationsVector)(uint64_t x, uint64_t y, Sample outSamples[8]) noexcept;
+    // Computes a queue of pixels with lane refilling, see computeIterationsQueue
+    uint64_t (*computeIterationsQueue)(const TileContext &context, const QueuedPixel *queue, uint64_t count, Sample *outSamples, EscapeState *outUnresolved) noexcept;
+    // Computes a rectangle of pixels with lane refilling, see computeIterationsRows
+    uint64_t (*computeIterationsRows)(const TileContext &context, uint64_t x, uint64_t y, uint64_t width, uint64_t height, StoredSample *outSamples, uint64_t stride,
+                                      EscapeState *outUnresolved) noexcept;
+    // Continues unresolved pixels with lane refilling, see computeIterationsResumed
+    uint64_t (*computeIterationsResumed)(const TileContext &context, const EscapeState *states, uint64_t count, int64_t fromIterations, StoredSample *outSamples,
+                                         uint64_t stride, EscapeState *outUnresolved) noexcept;
+    // Single precision variants of computeIterationsQueue, computeIterationsRows and computeIterationsResumed, used for tiles with context.precision SinglePrecision
+    uint64_t (*computeIterationsQueueFloat)(const TileContext &context, const QueuedPixel *queue, uint64_t count, Sample *outSamples, EscapeState *outUnresolved) noexcept;
+    uint64_t (*computeIterationsRowsFloat)(const TileContext &context, uint64_t x, uint64_t y, uint64_t width, uint64_t height, StoredSample *outSamples, uint64_t stride,
+                                           EscapeState *outUnresolved) noexcept;
+    uint64_t (*computeIterationsResumedFloat)(const TileContext &context, const EscapeState *states, uint64_t count, int64_t fromIterations, StoredSample *outSamples,
+                                              uint64_t stride, EscapeState *outUnresolved) noexcept;
+    // computeIterationsQueue also tracking dz/dc, used for tiles with context.distances
+    uint64_t (*computeIterationsQueueDistances)(const TileContext &context, const QueuedPixel *queue, uint64_t count, Sample *outSamples, EscapeState *outUnresolved) noexcept;
+};
+
+// Entry points of one instruction set's kernel family, each Kernel*.cpp translation unit defines one of these
+struct Kernel {
+    // Name used to force this kernel through the MIG_KERNEL environment variable
+    const char *name;
+    // Number of doubles per vector register
+    uint64_t vectorWidth;
+    // Iteration entry points of every formula, indexed by Formula
+    std::array<FormulaKernel, formulaCount> formulas;
+    // Computes a queue of pixels relative to a reference orbit, see computeIterationsPerturbed. Only iterates the Mandelbrot set
+    void (*computeIterationsPerturbed)(const PerturbationReference &reference, const QueuedPixel *queue, uint64_t count, Sample *outSamples) noexcept;
+    // computeIterationsPerturbed also tracking dz/dc, used with reference.distances
+    void (*computeIterationsPerturbedDistances)(const PerturbationReference &reference, const QueuedPixel *queue, uint64_t count, Sample *outSamples) noexcept;
+    // Colors stored samples, see colorizeSamples
+    void (*colorizeSamples)(const ColorTables &tables, const StoredSample *samples, uint64_t count, unsigned char *out) noexcept;
+};
+
+extern const Kernel scalarKernel;
+extern const Kernel sse2Kernel;
+extern const Kernel avx2Kernel;
+extern const Kernel avx512Kernel;
+
+#endif  // KERNEL_HPP_INCLUDED
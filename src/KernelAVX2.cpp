@@ -0,0 +1,13 @@
+// AVX2 kernel family, this translation unit is compiled with -mavx2 -mfma (see CMakeLists.txt) and is only dispatched to when CPUID reports AVX2 and FMA
+
+#include "Kernel.hpp"
+#include "KernelTemplates.hpp"
+
+const Kernel avx2Kernel = {
+    .name = "avx2",
+    .vectorWidth = AVX2Double::width,
+    .formulas = formulaKernels<AVX2Double, AVX2Float>(),
+    .computeIterationsPerturbed = &computeIterationsPerturbation<AVX2Double, false>,
+    .computeIterationsPerturbedDistances = &computeIterationsPerturbation<AVX2Double, true>,
+    .colorizeSamples = &colorizeSamplesLanes<AVX2Double>
+};
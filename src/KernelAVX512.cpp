@@ -0,0 +1,13 @@
+// AVX-512 kernel family, this translation unit is compiled with -mavx512f -mfma (see CMakeLists.txt) and is only dispatched to when CPUID reports AVX-512F
+
+#include "Kernel.hpp"
+#include "KernelTemplates.hpp"
+
+const Kernel avx512Kernel = {
+    .name = "avx512",
+    .vectorWidth = AVX512Double::width,
+    .formulas = formulaKernels<AVX512Double, AVX512Float>(),
+    .computeIterationsPerturbed = &computeIterationsPerturbation<AVX512Double, false>,
+    .computeIterationsPerturbedDistances = &computeIterationsPerturbation<AVX512Double, true>,
+    .colorizeSamples = &colorizeSamplesLanes<AVX512Double>
+};
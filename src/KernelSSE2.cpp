@@ -0,0 +1,13 @@
+// SSE2 kernel family, SSE2 is part of the x86-64 baseline so this translation unit needs no extra flags
+
+#include "Kernel.hpp"
+#include "KernelTemplates.hpp"
+
+const Kernel sse2Kernel = {
+    .name = "sse2",
+    .vectorWidth = SSE2Double::width,
+    .formulas = formulaKernels<SSE2Double, SSE2Float>(),
+    .computeIterationsPerturbed = &computeIterationsPerturbation<SSE2Double, false>,
+    .computeIterationsPerturbedDistances = &computeIterationsPerturbation<SSE2Double, true>,
+    .colorizeSamples = &colorizeSamplesLanes<SSE2Double>
+};
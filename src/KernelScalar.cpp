@@ -0,0 +1,13 @@
+// Scalar reference kernel family, one pixel at a time using plain doubles
+
+#include "Kernel.hpp"
+#include "KernelTemplates.hpp"
+
+const Kernel scalarKernel = {
+    .name = "scalar",
+    .vectorWidth = ScalarDouble::width,
+    .formulas = formulaKernels<ScalarDouble, ScalarFloat>(),
+    .computeIterationsPerturbed = &computeIterationsPerturbation<ScalarDouble, false>,
+    .computeIterationsPerturbedDistances = &computeIterationsPerturbation<ScalarDouble, true>,
+    .colorizeSamples = &colorizeSamplesLanes<ScalarDouble>
+};
@@ -0,0 +1,891 @@
+#ifndef KERNELTEMPLATES_HPP_INCLUDED
+#define KERNELTEMPLATES_HPP_INCLUDED
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "Kernel.hpp"
+#include "Mandelbrotset.hpp"
+#include "Saves.hpp"
+#include "Simd.hpp"
+#include "Telemetry.hpp"
+
+// Instruction set independent kernel bodies, instantiated once per traits struct from Simd.hpp by the Kernel*.cpp translation units.
+// Like Simd.hpp everything here has internal linkage so differently compiled instantiations never get mixed up.
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+
+namespace {
+
+// z^Power by repeated squaring, unrolled at compile time
+template <typename V, uint64_t Power>
+inline void complexPower(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector &m_pReal, typename V::Vector &m_pImag) noexcept {
+    using Vector = typename V::Vector;
+
+    if constexpr (Power == 1) {
+        m_pReal = m_zReal;
+        m_pImag = m_zImag;
+    } else if constexpr (Power % 2 == 0) {
+        Vector m_hReal, m_hImag;
+        complexPower<V, Power / 2>(m_zReal, m_zImag, m_hReal, m_hImag);
+        m_pReal = V::mul(V::add(m_hReal, m_hImag), V::sub(m_hReal, m_hImag));
+        m_pImag = V::mul(V::add(m_hReal, m_hReal), m_hImag);
+    } else {
+        Vector m_hReal, m_hImag;
+        complexPower<V, Power - 1>(m_zReal, m_zImag, m_hReal, m_hImag);
+        m_pReal = V::fmadd(m_hReal, m_zReal, V::mul(V::sub(V::zero(), m_hImag), m_zImag));
+        m_pImag = V::fmadd(m_hReal, m_zImag, V::mul(m_hImag, m_zReal));
+    }
+}
+
+// Power * z^(Power - 1) * d, the derivative of z^Power applied to d
+template <typename V, uint64_t Power>
+inline void powerDerivative(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_dReal, typename V::Vector m_dImag,
+                            typename V::Vector &m_dRealNew, typename V::Vector &m_dImagNew) noexcept {
+    typename V::Vector m_pReal, m_pImag;
+    complexPower<V, Power - 1>(m_zReal, m_zImag, m_pReal, m_pImag);
+    const typename V::Vector m_power = V::set1(Power);
+    m_pReal = V::mul(m_pReal, m_power);
+    m_pImag = V::mul(m_pImag, m_power);
+    m_dRealNew = V::fmadd(m_pReal, m_dReal, V::sub(V::zero(), V::mul(m_pImag, m_dImag)));
+    m_dImagNew = V::fmadd(m_pReal, m_dImag, V::mul(m_pImag, m_dReal));
+}
+
+// Formulas the kernels are instantiated for, one per Formula in Saves.hpp (see formulaKernels). step computes z_(n+1) = f(z_n) + a,
+// where a is c unless julia is set, then it is the tile's Julia constant. bulbs tells whether insideBulbs applies, i.e. the set is the Mandelbrot set.
+// derivative applies the Jacobian of f at z_n to a derivative d_n of z_n, see computeIterationsRefill. Where f is holomorphic (conformal) that is f'(z_n) * d_n,
+// and dz/dc is a single complex number. The Burning Ship isn't, its dz/dc.r and dz/dc.i have to be tracked separately.
+// Everything is known at compile time, so the inner loops of every formula are as branch free as the Mandelbrot set's
+template <uint64_t Power>
+struct MultibrotStep {
+    static_assert(Power >= 2, "Multibrot sets start at z^2 + c");
+    static constexpr bool julia = false;
+    static constexpr bool bulbs = Power == 2;
+    static constexpr bool conformal = true;
+
+    template <typename V>
+    static inline void step(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_aReal, typename V::Vector m_aImag,
+                            typename V::Vector &m_zRealNew, typename V::Vector &m_zImagNew) noexcept {
+        if constexpr (Power == 2) {
+            // z_(n+1) = z ^ 2 + c
+            // z_(n+1).i = (2 * z.r * z.i) + c.i = (z.r + z.r) * z.i + c.i
+            // z_(n+1).r = (z.r * z.r) - (z.i * z.i) + c.r = (z.r + z.i) * (z.r - z.i) + c.r
+            m_zImagNew = V::fmadd(V::add(m_zReal, m_zReal), m_zImag, m_aImag);
+            m_zRealNew = V::fmadd(V::add(m_zReal, m_zImag), V::sub(m_zReal, m_zImag), m_aReal);
+        } else {
+            // z_(n+1) = z ^ (Power - 1) * z + c
+            typename V::Vector m_pReal, m_pImag;
+            complexPower<V, Power - 1>(m_zReal, m_zImag, m_pReal, m_pImag);
+            m_zRealNew = V::fmadd(m_pReal, m_zReal, V::sub(m_aReal, V::mul(m_pImag, m_zImag)));
+            m_zImagNew = V::fmadd(m_pReal, m_zImag, V::fmadd(m_pImag, m_zReal, m_aImag));
+        }
+    }
+
+    template <typename V>
+    static inline void derivative(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_dReal, typename V::Vector m_dImag,
+                                  typename V::Vector &m_dRealNew, typename V::Vector &m_dImagNew) noexcept {
+        powerDerivative<V, Power>(m_zReal, m_zImag, m_dReal, m_dImag, m_dRealNew, m_dImagNew);
+    }
+};
+
+struct BurningShipStep {
+    static constexpr bool julia = false;
+    static constexpr bool bulbs = false;
+    static constexpr bool conformal = false;
+
+    template <typename V>
+    static inline void step(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_aReal, typename V::Vector m_aImag,
+                            typename V::Vector &m_zRealNew, typename V::Vector &m_zImagNew) noexcept {
+        // z_(n+1) = (|z.r| + |z.i| i) ^ 2 + c, only the sign of the imaginary part's product changes: z_(n+1).i = 2 * |z.r * z.i| + c.i
+        const typename V::Vector m_product = V::mul(V::add(m_zReal, m_zReal), m_zImag);
+        m_zImagNew = V::add(V::max(m_product, V::sub(V::zero(), m_product)), m_aImag);
+        m_zRealNew = V::fmadd(V::add(m_zReal, m_zImag), V::sub(m_zReal, m_zImag), m_aReal);
+    }
+
+    template <typename V>
+    static inline void derivative(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_dReal, typename V::Vector m_dImag,
+                                  typename V::Vector &m_dRealNew, typename V::Vector &m_dImagNew) noexcept {
+        // The absolute value flips the imaginary part's derivative where z.r * z.i < 0: d_(n+1).i = sign(z.r * z.i) * 2 * (z.r * d.i + z.i * d.r)
+        typename V::Vector m_pImag;
+        powerDerivative<V, 2>(m_zReal, m_zImag, m_dReal, m_dImag, m_dRealNew, m_pImag);
+        m_dImagNew = V::blend(V::cmplt(V::mul(m_zReal, m_zImag), V::zero()), m_pImag, V::sub(V::zero(), m_pImag));
+    }
+};
+
+struct JuliaStep {
+    static constexpr bool julia = true;
+    static constexpr bool bulbs = false;
+    static constexpr bool conformal = true;
+
+    template <typename V>
+    static inline void step(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_aReal, typename V::Vector m_aImag,
+                            typename V::Vector &m_zRealNew, typename V::Vector &m_zImagNew) noexcept {
+        MultibrotStep<2>::step<V>(m_zReal, m_zImag, m_aReal, m_aImag, m_zRealNew, m_zImagNew);
+    }
+
+    template <typename V>
+    static inline void derivative(typename V::Vector m_zReal, typename V::Vector m_zImag, typename V::Vector m_dReal, typename V::Vector m_dImag,
+                                  typename V::Vector &m_dRealNew, typename V::Vector &m_dImagNew) noexcept {
+        powerDerivative<V, 2>(m_zReal, m_zImag, m_dReal, m_dImag, m_dRealNew, m_dImagNew);
+    }
+};
+
+// Iterates the V::width points c with formula F until they escape, are caught in a period or reach maxIterations. Every lane starts at z_1 = c
+// and adds m_aReal + m_aImag i each iteration, which is c itself except for Julia sets.
+// Returns the iteration counts in m_k, the last |z|^2 of every lane in m_finalMagnitude2 and the iterations every lane actually ran in m_iterationsRun,
+// which is less than m_k for lanes caught in a period
+template <typename V, typename F>
+inline void iterateLanes(typename V::Vector m_cReal, typename V::Vector m_cImag, typename V::Vector m_aReal, typename V::Vector m_aImag, int64_t maxIterations,
+                         double bailoutRadius, double periodicityPrecision2, uint64_t periodicitySavePeriod, typename V::Vector &m_k,
+                         typename V::Vector &m_finalMagnitude2, typename V::Vector &m_iterationsRun) noexcept {
+    using Vector = typename V::Vector;
+    using Mask = typename V::Mask;
+
+    const Vector m_ones = V::set1(1);
+    const Vector m_maxIterations = V::set1(maxIterations);
+    const Vector m_bailoutRadius = V::set1(bailoutRadius);
+    const Vector m_periodicityPrecision2 = V::set1(periodicityPrecision2);
+
+    // Initialization variables
+    Vector m_zReal = m_cReal;
+    Vector m_zImag = m_cImag;
+    m_finalMagnitude2 = V::zero();
+    // Periodicity checking
+    Vector m_oReal = V::zero();
+    Vector m_oImag = V::zero();
+
+    Mask m_iterating = V::fullMask();
+    // Lanes caught in a period keep the k they were caught at until the end
+    unsigned periodic = 0;
+
+    m_k = m_ones;
+    // Counts down to the next periodicity save, every lane is at the same k so one integer serves the whole vector
+    uint64_t untilSave = 0;
+    for (int64_t k = 1; k < maxIterations; k++) {
+        const Vector m_zReal2 = V::mul(m_zReal, m_zReal);
+        const Vector m_zImag2 = V::mul(m_zImag, m_zImag);
+
+        // Positions are saved at k = 1, periodicitySavePeriod + 1, 2 * periodicitySavePeriod + 1, ...
+        if (periodicitySavePeriod > 0 && untilSave-- == 0) {
+            untilSave = periodicitySavePeriod - 1;
+            m_oReal = V::blend(m_iterating, m_oReal, m_zReal);
+            m_oImag = V::blend(m_iterating, m_oImag, m_zImag);
+        }
+
+        const Vector m_magnitude2 = V::add(m_zReal2, m_zImag2);
+        m_finalMagnitude2 = V::blend(m_iterating, m_finalMagnitude2, m_magnitude2);
+        m_iterating = V::maskAnd(m_iterating, V::cmplt(m_magnitude2, m_bailoutRadius));
+
+        // Pixels are done iterating
+        if (V::bits(m_iterating) == 0) break;
+
+        // Iterate, lanes that are done keep their last value
+        Vector m_zRealNew, m_zImagNew;
+        F::template step<V>(m_zReal, m_zImag, m_aReal, m_aImag, m_zRealNew, m_zImagNew);
+        m_zReal = V::blend(m_iterating, m_zReal, m_zRealNew);
+        m_zImag = V::blend(m_iterating, m_zImag, m_zImagNew);
+
+        if (periodicitySavePeriod > 0) {
+            const Vector m_pReal = V::sub(m_zReal, m_oReal);
+            const Vector m_pImag = V::sub(m_zImag, m_oImag);
+            const Vector m_error = V::fmadd(m_pReal, m_pReal, V::mul(m_pImag, m_pImag));
+            const Mask m_inPeriod = V::maskAnd(V::cmplt(m_error, m_periodicityPrecision2), m_iterating);
+
+            // Set iterating to false when in a period
+            periodic |= V::bits(m_inPeriod);
+            m_iterating = V::maskAndNot(m_iterating, m_inPeriod);
+        }
+
+        // Iterating m_k
+        m_k = V::blend(m_iterating, m_k, V::add(m_k, m_ones));
+    }
+
+    // Every lane started at k = 1, lanes in a period count as reaching maxIterations
+    m_iterationsRun = V::sub(m_k, m_ones);
+    m_k = V::blend(V::fromBits(periodic), m_k, m_maxIterations);
+}
+
+// Lanes whose c lies inside the main cardioid or the period-2 bulb, these never escape
+template <typename V>
+inline typename V::Mask insideBulbs(typename V::Vector m_cReal, typename V::Vector m_cImag) noexcept {
+    using Vector = typename V::Vector;
+
+    const Vector m_cImag2 = V::mul(m_cImag, m_cImag);
+    // Cardioid: q * (q + x - 1/4) < y^2 / 4 with q = (x - 1/4)^2 + y^2
+    const Vector m_xQuarter = V::sub(m_cReal, V::set1(0.25));
+    const Vector m_q = V::fmadd(m_xQuarter, m_xQuarter, m_cImag2);
+    const unsigned cardioid = V::bits(V::cmplt(V::mul(m_q, V::add(m_q, m_xQuarter)), V::mul(m_cImag2, V::set1(0.25))));
+    // Period-2 bulb: (x + 1)^2 + y^2 < 1/16
+    const Vector m_xBulb = V::add(m_cReal, V::set1(1));
+    const unsigned bulb = V::bits(V::cmplt(V::fmadd(m_xBulb, m_xBulb, m_cImag2), V::set1(0.0625)));
+    return V::fromBits(cardioid | bulb);
+}
+
+// Computes the result for V::width sequential pixels starting at pixel x and y with formula F, saves the results inside the output array outSamples.
+// x and y are image coordinates
+template <typename V, typename F>
+inline void computeIterationsLanes(uint64_t x, uint64_t y, Sample *outSamples) noexcept {
+    using Vector = typename V::Vector;
+    using Scalar = typename V::Scalar;
+
+    const Vector m_ones = V::set1(1);
+    const Vector m_startReal = V::set1(mConfig.startReal);
+    const Vector m_endReal = V::set1(mConfig.endReal);
+    const Vector m_startImag = V::set1(mConfig.startImag);
+    const Vector m_endImag = V::set1(mConfig.endImag);
+    const Vector m_imageWidth = V::set1(tConfig.imageWidth - 1);
+    const Vector m_imageHeight = V::set1(tConfig.imageHeight - 1);
+
+    // Position vectors
+    const Vector m_x = V::add(V::set1(x), V::iota());
+    const Vector m_y = V::set1(y);
+
+    // Input variables
+    // (((1 - (x / m)) * a) + ((x / m) * b)) = ((1 - (x / m)) * a + ((x / m) * b))
+    const Vector m_cReal = V::fmadd(V::sub(m_ones, V::div(m_x, m_imageWidth)), m_startReal, V::mul(V::div(m_x, m_imageWidth), m_endReal));
+    const Vector m_cImag = V::fmadd(V::sub(m_ones, V::div(m_y, m_imageHeight)), m_startImag, V::mul(V::div(m_y, m_imageHeight), m_endImag));
+
+    const Vector m_aReal = F::julia ? V::set1(mConfig.juliaReal) : m_cReal;
+    const Vector m_aImag = F::julia ? V::set1(mConfig.juliaImag) : m_cImag;
+
+    Vector m_k, m_finalMagnitude2, m_iterationsRun;
+    iterateLanes<V, F>(m_cReal, m_cImag, m_aReal, m_aImag, mConfig.maxIterations, mConfig.bailoutRadius, mConfig.periodicityPrecision2, mConfig.periodicitySavePeriod, m_k, m_finalMagnitude2,
+                       m_iterationsRun);
+
+    Scalar cReal[V::width], cImag[V::width], iteration[V::width], finalMagnitude2[V::width], iterationsRun[V::width];
+    V::store(cReal, m_cReal);
+    V::store(cImag, m_cImag);
+    V::store(iteration, m_k);
+    V::store(finalMagnitude2, m_finalMagnitude2);
+    V::store(iterationsRun, m_iterationsRun);
+    for (uint64_t i = 0; i < V::width; i++) {
+        Sample &sample = outSamples[i];
+        sample.cReal = cReal[i];
+        sample.cImag = cImag[i];
+        sample.iterations = static_cast<int64_t>(iteration[i]);
+        sample.finalMagnitude2 = iteration[i] < mConfig.maxIterations ? finalMagnitude2[i] : 0;
+        sample.iterationsRun = static_cast<int64_t>(iterationsRun[i]);
+    }
+}
+
+// Computes the result for 8 sequential pixels starting at pixel x and y with formula F using as many V::width wide vectors as needed
+template <typename V, typename F>
+void computeIterationsBatch(uint64_t x, uint64_t y, Sample outSamples[8]) noexcept {
+    static_assert(8 % V::width == 0, "vector width has to divide the 8 pixel batch");
+    for (uint64_t i = 0; i < 8; i += V::width) {
+        computeIterationsLanes<V, F>(x + i, y, outSamples + i);
+    }
+}
+
+// Pixels of a computeIterationsQueue queue
+struct QueueSource {
+    static constexpr bool resumes = false;
+    const QueuedPixel *queue;
+    uint64_t count;
+
+    QueuedPixel operator[](uint64_t i) const noexcept { return queue[i]; }
+};
+
+// Pixels of a computeIterationsRows rectangle in row order, written to the rows of an output with stride samples per row
+struct RectangleSource {
+    static constexpr bool resumes = false;
+    uint64_t x;
+    uint64_t y;
+    uint64_t width;
+    uint64_t count;
+    uint64_t stride;
+
+    QueuedPixel operator[](uint64_t i) const noexcept {
+        const uint64_t row = i / width;
+        const uint64_t column = i % width;
+        return {.x = x + column, .y = y + row, .index = row * stride + column};
+    }
+};
+
+// Unresolved pixels of a computeIterationsResumed call, continuing at iteration iterations and written to the rows of an output with stride samples per row
+struct ResumeSource {
+    static constexpr bool resumes = true;
+    const EscapeState *states;
+    uint64_t count;
+    int64_t iterations;
+    // Image pixel of output[0]
+    uint64_t x;
+    uint64_t y;
+    uint64_t stride;
+
+    QueuedPixel operator[](uint64_t i) const noexcept {
+        return {.x = states[i].x, .y = states[i].y, .index = (states[i].y - y) * stride + (states[i].x - x)};
+    }
+};
+
+// Pixels that didn't escape get a finalMagnitude2 of 0, see StoredSample
+inline void writeSample(Sample &sample, double cReal, double cImag, double k, double finalMagnitude2, bool escaped, double iterationsRun) noexcept {
+    sample.cReal = cReal;
+    sample.cImag = cImag;
+    sample.iterations = static_cast<int64_t>(k);
+    sample.finalMagnitude2 = escaped ? finalMagnitude2 : 0;
+    sample.iterationsRun = static_cast<int64_t>(iterationsRun);
+}
+
+inline void writeSample(StoredSample &sample, double, double, double k, double finalMagnitude2, bool escaped, double) noexcept {
+    sample.iterations = static_cast<int64_t>(k);
+    sample.finalMagnitude2 = escaped ? finalMagnitude2 : 0;
+}
+
+// Distance estimate and normal angle of a pixel from z and its derivatives d = dz/dc.r and e = dz/dc.i at its last iteration, see DistanceSample.
+// The escape time grows like G = ln|z|, whose gradient over c is g / |z|^2 with g = (Re(conj(z) * d), Re(conj(z) * e)). The distance is G / |grad G|,
+// which is |z| * ln|z| / |dz/dc| for conformal formulas where e = i * d. Pixels that didn't escape get 0
+inline void writeDistance(Sample &sample, double zReal, double zImag, double dReal, double dImag, double eReal, double eImag, bool escaped) noexcept {
+    const double magnitude2 = zReal * zReal + zImag * zImag;
+    const double gradientReal = zReal * dReal + zImag * dImag;
+    const double gradientImag = zReal * eReal + zImag * eImag;
+    const double gradient = std::sqrt(gradientReal * gradientReal + gradientImag * gradientImag);
+    if (!escaped || gradient == 0 || magnitude2 <= 1) {
+        sample.distance = 0;
+        sample.normalAngle = 0;
+        return;
+    }
+    sample.distance = 0.5 * std::log(magnitude2) * magnitude2 / gradient;
+    sample.normalAngle = std::atan2(gradientImag, gradientReal);
+}
+
+// Iterates every pixel of source with formula F, writing each result to outSamples[pixel.index]. c comes from the tables of context, which also holds every other constant,
+// so nothing is derived from the configurations per call. For the Mandelbrot set pixels inside the main cardioid or the period-2 bulb are finished with maxIterations right away.
+// Instead of waiting for a whole vector to finish, a lane is refilled with the next pixel as soon as its pixel escapes,
+// is caught by periodicity checking or reaches maxIterations, so a slow pixel only ever occupies its own lane.
+// Iteration state never leaves the registers, refilled lanes are blended in and only the results of finished lanes are stored.
+// Instantiated with float traits for SinglePrecision tiles, c and every constant are then rounded to float once per pixel.
+// Unless outUnresolved is nullptr, lanes that run out of iterations also store their z and periodicity position there, and resumed sources restart lanes
+// from such states instead of z_1 = c. With Distances every lane also carries d = dz/dc.r from d_1 = 1, and for formulas that aren't conformal e = dz/dc.i
+// from e_1 = i, finished lanes get their distance estimate from them (see writeDistance). For Julia sets both are taken by the starting point instead.
+// The iterations every lane ran, from where it started to where it finished, are counted into the calling worker's counters (see countKernelWork).
+// Returns the number of states written to outUnresolved.
+template <typename V, typename F, bool Distances, typename Source, typename Output>
+uint64_t computeIterationsRefill(const TileContext &context, const Source &source, Output *outSamples, EscapeState *outUnresolved) noexcept {
+    using Vector = typename V::Vector;
+    using Mask = typename V::Mask;
+    using Scalar = typename V::Scalar;
+    constexpr uint64_t width = V::width;
+    constexpr uint64_t idle = UINT64_MAX;
+    const uint64_t count = source.count;
+    static_assert(!Distances || !Source::resumes, "resumed states don't carry dz/dc");
+
+    const bool capture = outUnresolved != nullptr;
+    uint64_t unresolvedCount = 0;
+    uint64_t iterationsRun = 0;
+
+    // A single lane has nothing to refill, every pixel simply runs to completion. iterateLanes keeps no state to resume from or save
+    if constexpr (width == 1 && !Source::resumes && !Distances) {
+        if (!capture) {
+            for (uint64_t i = 0; i < count; i++) {
+                const QueuedPixel pixel = source[i];
+                const Scalar cReal = context.cReal[pixel.x - context.x];
+                const Scalar cImag = context.cImag[pixel.y - context.y];
+                const Scalar aReal = F::julia ? static_cast<Scalar>(context.juliaReal) : cReal;
+                const Scalar aImag = F::julia ? static_cast<Scalar>(context.juliaImag) : cImag;
+                Vector m_k = context.maxIterations, m_finalMagnitude2 = 0, m_iterationsRun = 0;
+                if (!F::bulbs || !insideBulbs<V>(cReal, cImag)) {
+                    iterateLanes<V, F>(cReal, cImag, aReal, aImag, context.maxIterations, context.bailoutRadius, context.periodicityPrecision2, context.periodicitySavePeriod, m_k, m_finalMagnitude2,
+                                       m_iterationsRun);
+                }
+                writeSample(outSamples[pixel.index], cReal, cImag, m_k, m_finalMagnitude2, m_k < context.maxIterations, m_iterationsRun);
+                iterationsRun += static_cast<uint64_t>(m_iterationsRun);
+            }
+            countKernelWork(count, iterationsRun);
+            return 0;
+        }
+    }
+
+    const Vector m_ones = V::set1(1);
+    const Vector m_maxIterations = V::set1(context.maxIterations);
+    const Vector m_bailoutRadius = V::set1(context.bailoutRadius);
+    const Vector m_periodicityPrecision2 = V::set1(context.periodicityPrecision2);
+    const Vector m_savePeriod = V::set1(context.periodicitySavePeriod);
+    const Vector m_half = V::set1(0.5);
+    const Vector m_juliaReal = V::set1(context.juliaReal);
+    const Vector m_juliaImag = V::set1(context.juliaImag);
+    const bool periodicity = context.periodicitySavePeriod > 0;
+
+    // Resumed pixels count down to their next periodicity save from where a run from z_1 = c would be at that iteration
+    int64_t resumedIterations = 1;
+    if constexpr (Source::resumes) resumedIterations = source.iterations;
+    const uint64_t savePeriod = context.periodicitySavePeriod;
+    const Vector m_resumedIterations = V::set1(resumedIterations);
+    const Vector m_resumedUntilSave = V::set1(periodicity ? (savePeriod - static_cast<uint64_t>(resumedIterations - 1) % savePeriod) % savePeriod : 0);
+
+    // Lane bookkeeping, the iteration state itself stays in registers and is only stored for unresolved or resumed lanes
+    Scalar cReal[width], cImag[width], k[width], start[width], finalMagnitude2[width];
+    Scalar zReal[width], zImag[width], oReal[width], oImag[width], dReal[width], dImag[width], eReal[width], eImag[width];
+    uint64_t laneIndex[width], laneX[width], laneY[width];
+    for (uint64_t lane = 0; lane < width; lane++) {
+        cReal[lane] = cImag[lane] = 0;
+        zReal[lane] = zImag[lane] = oReal[lane] = oImag[lane] = dReal[lane] = dImag[lane] = eReal[lane] = eImag[lane] = 0;
+        laneIndex[lane] = idle;
+        laneX[lane] = laneY[lane] = 0;
+    }
+
+    Vector m_cReal = V::zero(), m_cImag = V::zero();
+    Vector m_zReal = V::zero(), m_zImag = V::zero(), m_oReal = V::zero(), m_oImag = V::zero();
+    Vector m_dReal = V::zero(), m_dImag = V::zero(), m_eReal = V::zero(), m_eImag = V::zero();
+    // k every lane started its pixel at, the pixel ran k - start iterations
+    Vector m_k = m_ones, m_start = m_ones, m_finalMagnitude2 = V::zero(), m_untilSave = V::zero();
+    Mask m_active = V::fromBits(0);
+    uint64_t next = 0;
+    unsigned finished = (1u << width) - 1;  // Every lane starts out empty
+    // Finished lanes that ran out of iterations, only tracked when capturing
+    unsigned unresolved = 0;
+    // Lanes caught in a period, they keep the k they were caught at and are written back with maxIterations
+    unsigned periodic = 0;
+    while (true) {
+        if (finished != 0) {
+            V::store(cReal, m_cReal);
+            V::store(cImag, m_cImag);
+            V::store(k, m_k);
+            V::store(start, m_start);
+            V::store(finalMagnitude2, m_finalMagnitude2);
+            if (unresolved != 0 || Distances) {
+                V::store(zReal, m_zReal);
+                V::store(zImag, m_zImag);
+                V::store(oReal, m_oReal);
+                V::store(oImag, m_oImag);
+            }
+            if constexpr (Distances) {
+                V::store(dReal, m_dReal);
+                V::store(dImag, m_dImag);
+                // Conformal formulas have e = i * d
+                V::store(eReal, F::conformal ? V::sub(V::zero(), m_dImag) : m_eReal);
+                V::store(eImag, F::conformal ? m_dReal : m_eImag);
+            }
+
+            // Write back the finished lanes and pull the next pixels into them
+            unsigned refilled = 0;
+            for (uint64_t lane = 0; lane < width; lane++) {
+                if (!(finished & (1u << lane))) continue;
+                if (laneIndex[lane] != idle) {
+                    const Scalar iterations = periodic & (1u << lane) ? static_cast<Scalar>(context.maxIterations) : k[lane];
+                    writeSample(outSamples[laneIndex[lane]], cReal[lane], cImag[lane], iterations, finalMagnitude2[lane], iterations < context.maxIterations, k[lane] - start[lane]);
+                    iterationsRun += static_cast<uint64_t>(k[lane] - start[lane]);
+                    if constexpr (Distances) {
+                        writeDistance(outSamples[laneIndex[lane]], zReal[lane], zImag[lane], dReal[lane], dImag[lane], eReal[lane], eImag[lane], iterations < context.maxIterations);
+                    }
+                    if (unresolved & (1u << lane)) {
+                        outUnresolved[unresolvedCount++] = {.x = laneX[lane], .y = laneY[lane], .zReal = zReal[lane], .zImag = zImag[lane], .oReal = oReal[lane], .oImag = oImag[lane]};
+                    }
+                }
+                laneIndex[lane] = idle;
+                if (next == count) continue;
+
+                if constexpr (Source::resumes) {
+                    const EscapeState &state = source.states[next];
+                    zReal[lane] = state.zReal;
+                    zImag[lane] = state.zImag;
+                    oReal[lane] = state.oReal;
+                    oImag[lane] = state.oImag;
+                }
+                const QueuedPixel pixel = source[next++];
+                laneIndex[lane] = pixel.index;
+                laneX[lane] = pixel.x;
+                laneY[lane] = pixel.y;
+                cReal[lane] = context.cReal[pixel.x - context.x];
+                cImag[lane] = context.cImag[pixel.y - context.y];
+                refilled |= 1u << lane;
+            }
+
+            const Mask m_refilled = V::fromBits(refilled);
+            m_cReal = V::blend(m_refilled, m_cReal, V::load(cReal));
+            m_cImag = V::blend(m_refilled, m_cImag, V::load(cImag));
+            Mask m_inside = V::fromBits(0);
+            if constexpr (Source::resumes) {
+                // Resumed lanes continue from their saved state, they already lie outside the cardioid and bulb
+                m_zReal = V::blend(m_refilled, m_zReal, V::load(zReal));
+                m_zImag = V::blend(m_refilled, m_zImag, V::load(zImag));
+                m_oReal = V::blend(m_refilled, m_oReal, V::load(oReal));
+                m_oImag = V::blend(m_refilled, m_oImag, V::load(oImag));
+                m_k = V::blend(m_refilled, m_k, m_resumedIterations);
+                m_untilSave = V::blend(m_refilled, m_untilSave, m_resumedUntilSave);
+            } else {
+                // Refilled lanes restart from z_1 = c like in iterateLanes, the first saved position for periodicity checking is z_1 as well
+                m_zReal = V::blend(m_refilled, m_zReal, m_cReal);
+                m_zImag = V::blend(m_refilled, m_zImag, m_cImag);
+                m_oReal = V::blend(m_refilled, m_oReal, m_cReal);
+                m_oImag = V::blend(m_refilled, m_oImag, m_cImag);
+                if constexpr (Distances) {
+                    m_dReal = V::blend(m_refilled, m_dReal, m_ones);
+                    m_dImag = V::blend(m_refilled, m_dImag, V::zero());
+                    m_eReal = V::blend(m_refilled, m_eReal, V::zero());
+                    m_eImag = V::blend(m_refilled, m_eImag, m_ones);
+                }
+                // Pixels inside the cardioid or bulb start out at maxIterations and are written back without iterating
+                if constexpr (F::bulbs) m_inside = V::maskAnd(m_refilled, insideBulbs<V>(m_cReal, m_cImag));
+                m_k = V::blend(m_refilled, m_k, V::blend(m_inside, m_ones, m_maxIterations));
+                m_untilSave = V::blend(m_refilled, m_untilSave, V::zero());
+            }
+            m_start = V::blend(m_refilled, m_start, m_k);
+            m_finalMagnitude2 = V::blend(m_refilled, m_finalMagnitude2, V::zero());
+            m_active = V::fromBits(V::bits(m_active) | refilled);
+            periodic &= ~finished;
+            finished = 0;
+            unresolved = 0;
+
+            // Nothing left in the queue and every lane is empty
+            if (V::bits(m_active) == 0) {
+                countKernelWork(count, iterationsRun);
+                return unresolvedCount;
+            }
+
+            // Pixels that are done before their first iteration, i.e. inside the bulbs, maxIterations <= 1 or resumed without a larger budget
+            const Mask m_capped = V::maskAndNot(m_active, V::cmplt(m_k, m_maxIterations));
+            if (V::bits(m_capped) != 0) {
+                finished = V::bits(m_capped);
+                if (capture) unresolved = finished & ~V::bits(m_inside);
+                m_active = V::maskAndNot(m_active, m_capped);
+                continue;
+            }
+        }
+
+        const Vector m_zReal2 = V::mul(m_zReal, m_zReal);
+        const Vector m_zImag2 = V::mul(m_zImag, m_zImag);
+
+        // Lanes start at different iterations, every lane counts down to its own next save so it saves at the same k as in iterateLanes.
+        // A pixel's result then doesn't depend on the pixels it shares the vector with.
+        if (periodicity) {
+            const Mask m_save = V::cmplt(m_untilSave, m_half);
+            if (V::bits(m_save) != 0) {
+                m_oReal = V::blend(m_save, m_oReal, m_zReal);
+                m_oImag = V::blend(m_save, m_oImag, m_zImag);
+                m_untilSave = V::blend(m_save, m_untilSave, m_savePeriod);
+            }
+            m_untilSave = V::sub(m_untilSave, m_ones);
+        }
+
+        const Vector m_magnitude2 = V::add(m_zReal2, m_zImag2);
+        m_finalMagnitude2 = V::blend(m_active, m_finalMagnitude2, m_magnitude2);
+        Mask m_iterating = V::maskAnd(m_active, V::cmplt(m_magnitude2, m_bailoutRadius));
+
+        // z_(n+1) = f(z) + a, see iterateLanes
+        Vector m_zRealNew, m_zImagNew;
+        F::template step<V>(m_zReal, m_zImag, F::julia ? m_juliaReal : m_cReal, F::julia ? m_juliaImag : m_cImag, m_zRealNew, m_zImagNew);
+        if constexpr (Distances) {
+            // d_(n+1) = J(z_n) * d_n + 1 and e_(n+1) = J(z_n) * e_n + i, without the constants for Julia sets. Both come from z_n, so they are stepped before z is replaced.
+            // Escaped lanes keep the derivatives of the z they escaped with
+            Vector m_dRealNew, m_dImagNew;
+            F::template derivative<V>(m_zReal, m_zImag, m_dReal, m_dImag, m_dRealNew, m_dImagNew);
+            if constexpr (!F::julia) m_dRealNew = V::add(m_dRealNew, m_ones);
+            m_dReal = V::blend(m_iterating, m_dReal, m_dRealNew);
+            m_dImag = V::blend(m_iterating, m_dImag, m_dImagNew);
+            if constexpr (!F::conformal) {
+                Vector m_eRealNew, m_eImagNew;
+                F::template derivative<V>(m_zReal, m_zImag, m_eReal, m_eImag, m_eRealNew, m_eImagNew);
+                if constexpr (!F::julia) m_eImagNew = V::add(m_eImagNew, m_ones);
+                m_eReal = V::blend(m_iterating, m_eReal, m_eRealNew);
+                m_eImag = V::blend(m_iterating, m_eImag, m_eImagNew);
+            }
+        }
+        m_zReal = V::blend(m_iterating, m_zReal, m_zRealNew);
+        m_zImag = V::blend(m_iterating, m_zImag, m_zImagNew);
+
+        if (periodicity) {
+            const Vector m_pReal = V::sub(m_zReal, m_oReal);
+            const Vector m_pImag = V::sub(m_zImag, m_oImag);
+            const Vector m_error = V::fmadd(m_pReal, m_pReal, V::mul(m_pImag, m_pImag));
+            const Mask m_inPeriod = V::maskAnd(V::cmplt(m_error, m_periodicityPrecision2), m_iterating);
+
+            periodic |= V::bits(m_inPeriod);
+            m_iterating = V::maskAndNot(m_iterating, m_inPeriod);
+        }
+
+        m_k = V::blend(m_iterating, m_k, V::add(m_k, m_ones));
+        // Lanes that escaped, were caught in a period or just reached maxIterations
+        const Mask m_continuing = V::maskAnd(m_iterating, V::cmplt(m_k, m_maxIterations));
+        finished = V::bits(V::maskAndNot(m_active, m_continuing));
+        // Lanes still iterating when they reached maxIterations, as opposed to escaped ones and ones caught in a period
+        if (capture && finished != 0) unresolved = V::bits(V::maskAndNot(m_iterating, m_continuing));
+        m_active = m_continuing;
+    }
+}
+
+// Kernel entry point of computeIterationsQueue
+template <typename V, typename F, bool Distances>
+uint64_t computeIterationsQueued(const TileContext &context, const QueuedPixel *queue, uint64_t count, Sample *outSamples, EscapeState *outUnresolved) noexcept {
+    return computeIterationsRefill<V, F, Distances>(context, QueueSource{.queue = queue, .count = count}, outSamples, outUnresolved);
+}
+
+// Kernel entry point of computeIterationsRows
+template <typename V, typename F>
+uint64_t computeIterationsRectangle(const TileContext &context, uint64_t x, uint64_t y, uint64_t width, uint64_t height, StoredSample *outSamples, uint64_t stride,
+                                    EscapeState *outUnresolved) noexcept {
+    return computeIterationsRefill<V, F, false>(context, RectangleSource{.x = x, .y = y, .width = width, .count = width * height, .stride = stride}, outSamples, outUnresolved);
+}
+
+// Kernel entry point of computeIterationsResumed
+template <typename V, typename F>
+uint64_t computeIterationsContinued(const TileContext &context, const EscapeState *states, uint64_t count, int64_t fromIterations, StoredSample *outSamples,
+                                   uint64_t stride, EscapeState *outUnresolved) noexcept {
+    const ResumeSource source = {.states = states, .count = count, .iterations = fromIterations, .x = context.x, .y = context.y, .stride = stride};
+    return computeIterationsRefill<V, F, false>(context, source, outSamples, outUnresolved);
+}
+
+// Entry points of formula F in double precision D and single precision S
+template <typename D, typename S, typename F>
+constexpr FormulaKernel formulaKernel() noexcept {
+    return {
+        .computeIterationsVector = &computeIterationsBatch<D, F>,
+        .computeIterationsQueue = &computeIterationsQueued<D, F, false>,
+        .computeIterationsRows = &computeIterationsRectangle<D, F>,
+        .computeIterationsResumed = &computeIterationsContinued<D, F>,
+        .computeIterationsQueueFloat = &computeIterationsQueued<S, F, false>,
+        .computeIterationsRowsFloat = &computeIterationsRectangle<S, F>,
+        .computeIterationsResumedFloat = &computeIterationsContinued<S, F>,
+        .computeIterationsQueueDistances = &computeIterationsQueued<D, F, true>
+    };
+}
+
+// Entry points of every formula indexed by Formula, for Kernel::formulas
+template <typename D, typename S>
+constexpr std::array<FormulaKernel, formulaCount> formulaKernels() noexcept {
+    static_assert(formulaCount == 5, "every Formula needs its instantiation here");
+    return {
+        formulaKernel<D, S, MultibrotStep<2>>(),
+        formulaKernel<D, S, MultibrotStep<3>>(),
+        formulaKernel<D, S, MultibrotStep<4>>(),
+        formulaKernel<D, S, BurningShipStep>(),
+        formulaKernel<D, S, JuliaStep>()
+    };
+}
+
+// Iterates every pixel in queue as a perturbation of the reference orbit Z_n of the point C, writing each result to outSamples[pixel.index].
+// With z_n = Z_n + dz_n and c = C + dc the deltas follow dz_(n+1) = (2 * Z_n + dz_n) * dz_n + dc, which only involves small numbers
+// that doubles represent with full relative precision no matter how deep the zoom is.
+// A pixel glitches once |z_n| < |dz_n|: the delta is then bigger than the point itself and the reference no longer describes it.
+// Such pixels, and pixels that run past the end of the reference orbit, are rebased by continuing with dz = z_n from Z_0 = 0.
+// Lane refilling works like computeIterationsRefill, except that every lane carries its own position n within the reference orbit.
+// Periodicity checking isn't done, its precision would have to scale with the zoom.
+// With Distances every lane also carries d = dz/dc of the full z = Z + dz, d_(n+1) = 2 * z_n * d_n + 1, which rebasing leaves unchanged.
+// Every pixel runs from k = 1, the iterations they ran are counted into the calling worker's counters like in computeIterationsRefill.
+template <typename V, bool Distances>
+void computeIterationsPerturbation(const PerturbationReference &reference, const QueuedPixel *queue, uint64_t count, Sample *outSamples) noexcept {
+    using Vector = typename V::Vector;
+    using Mask = typename V::Mask;
+    using Scalar = typename V::Scalar;
+    constexpr uint64_t width = V::width;
+    constexpr uint64_t idle = UINT64_MAX;
+
+    const Vector m_ones = V::set1(1);
+    const Vector m_maxIterations = V::set1(mConfig.maxIterations);
+    const Vector m_bailoutRadius = V::set1(mConfig.bailoutRadius);
+    const Vector m_referenceX = V::set1(reference.referenceX);
+    const Vector m_referenceY = V::set1(reference.referenceY);
+    const Vector m_stepReal = V::set1(reference.stepReal);
+    const Vector m_stepImag = V::set1(reference.stepImag);
+    // Last usable index of the reference orbit
+    const Vector m_referenceEnd = V::set1(reference.length > 1 ? reference.length - 1 : 1);
+    const Scalar referenceReal = reference.length > 1 ? reference.zReal[1] : 0;
+    const Scalar referenceImag = reference.length > 1 ? reference.zImag[1] : 0;
+
+    Scalar x[width], y[width], cReal[width], cImag[width], k[width], finalMagnitude2[width];
+    Scalar zReal[width], zImag[width], dReal[width], dImag[width];
+    uint64_t laneIndex[width];
+    for (uint64_t lane = 0; lane < width; lane++) {
+        x[lane] = y[lane] = 0;
+        zReal[lane] = zImag[lane] = dReal[lane] = dImag[lane] = 0;
+        laneIndex[lane] = idle;
+    }
+
+    Vector m_dcReal = V::zero(), m_dcImag = V::zero(), m_dzReal = V::zero(), m_dzImag = V::zero();
+    Vector m_dReal = V::zero(), m_dImag = V::zero();
+    Vector m_n = m_ones, m_k = m_ones, m_finalMagnitude2 = V::zero();
+    Mask m_active = V::fromBits(0);
+    uint64_t next = 0;
+    uint64_t iterationsRun = 0;
+    unsigned finished = (1u << width) - 1;  // Every lane starts out empty
+    while (true) {
+        if (finished != 0) {
+            // c is only stored approximately, the exact value doesn't fit in a double at deep zooms
+            V::store(cReal, V::add(V::set1(referenceReal), m_dcReal));
+            V::store(cImag, V::add(V::set1(referenceImag), m_dcImag));
+            V::store(k, m_k);
+            V::store(finalMagnitude2, m_finalMagnitude2);
+            if constexpr (Distances) {
+                // Finished lanes still sit at the n they escaped at
+                V::store(zReal, V::add(V::gather(reference.zReal, m_n), m_dzReal));
+                V::store(zImag, V::add(V::gather(reference.zImag, m_n), m_dzImag));
+                V::store(dReal, m_dReal);
+                V::store(dImag, m_dImag);
+            }
+
+            unsigned refilled = 0;
+            for (uint64_t lane = 0; lane < width; lane++) {
+                if (!(finished & (1u << lane))) continue;
+                if (laneIndex[lane] != idle) {
+                    Sample &sample = outSamples[laneIndex[lane]];
+                    sample.cReal = cReal[lane];
+                    sample.cImag = cImag[lane];
+                    sample.iterations = static_cast<int64_t>(k[lane]);
+                    sample.finalMagnitude2 = k[lane] < mConfig.maxIterations ? finalMagnitude2[lane] : 0;
+                    sample.iterationsRun = static_cast<int64_t>(k[lane]) - 1;
+                    iterationsRun += static_cast<uint64_t>(sample.iterationsRun);
+                    if constexpr (Distances) writeDistance(sample, zReal[lane], zImag[lane], dReal[lane], dImag[lane], -dImag[lane], dReal[lane], k[lane] < mConfig.maxIterations);
+                }
+                laneIndex[lane] = idle;
+                if (next == count) continue;
+
+                const QueuedPixel &pixel = queue[next++];
+                laneIndex[lane] = pixel.index;
+                x[lane] = pixel.x;
+                y[lane] = pixel.y;
+                refilled |= 1u << lane;
+            }
+
+            // Refilled lanes start at z_1 = c, i.e. n = 1 with dz_1 = dc
+            const Mask m_refilled = V::fromBits(refilled);
+            m_dcReal = V::blend(m_refilled, m_dcReal, V::mul(V::sub(V::load(x), m_referenceX), m_stepReal));
+            m_dcImag = V::blend(m_refilled, m_dcImag, V::mul(V::sub(V::load(y), m_referenceY), m_stepImag));
+            m_dzReal = V::blend(m_refilled, m_dzReal, m_dcReal);
+            m_dzImag = V::blend(m_refilled, m_dzImag, m_dcImag);
+            if constexpr (Distances) {
+                m_dReal = V::blend(m_refilled, m_dReal, m_ones);
+                m_dImag = V::blend(m_refilled, m_dImag, V::zero());
+            }
+            m_n = V::blend(m_refilled, m_n, m_ones);
+            m_k = V::blend(m_refilled, m_k, m_ones);
+            m_finalMagnitude2 = V::blend(m_refilled, m_finalMagnitude2, V::zero());
+            m_active = V::fromBits(V::bits(m_active) | refilled);
+            finished = 0;
+
+            if (V::bits(m_active) == 0) {
+                countKernelWork(count, iterationsRun);
+                return;
+            }
+
+            const Mask m_capped = V::maskAndNot(m_active, V::cmplt(m_k, m_maxIterations));
+            if (V::bits(m_capped) != 0) {
+                finished = V::bits(m_capped);
+                m_active = V::maskAndNot(m_active, m_capped);
+                continue;
+            }
+        }
+
+        Vector m_ZReal = V::gather(reference.zReal, m_n);
+        Vector m_ZImag = V::gather(reference.zImag, m_n);
+        const Vector m_zReal = V::add(m_ZReal, m_dzReal);
+        const Vector m_zImag = V::add(m_ZImag, m_dzImag);
+
+        const Vector m_magnitude2 = V::fmadd(m_zReal, m_zReal, V::mul(m_zImag, m_zImag));
+        m_finalMagnitude2 = V::blend(m_active, m_finalMagnitude2, m_magnitude2);
+        const Mask m_iterating = V::maskAnd(m_active, V::cmplt(m_magnitude2, m_bailoutRadius));
+
+        // Rebase glitched lanes and lanes at the end of the reference orbit onto Z_0 = 0
+        const Vector m_deltaMagnitude2 = V::fmadd(m_dzReal, m_dzReal, V::mul(m_dzImag, m_dzImag));
+        const Mask m_glitched = V::cmplt(m_magnitude2, m_deltaMagnitude2);
+        const Mask m_ended = V::maskAndNot(V::fullMask(), V::cmplt(m_n, m_referenceEnd));
+        const unsigned rebased = V::bits(V::maskAnd(m_iterating, m_glitched)) | V::bits(V::maskAnd(m_iterating, m_ended));
+        if (rebased != 0) {
+            const Mask m_rebased = V::fromBits(rebased);
+            m_dzReal = V::blend(m_rebased, m_dzReal, m_zReal);
+            m_dzImag = V::blend(m_rebased, m_dzImag, m_zImag);
+            m_ZReal = V::blend(m_rebased, m_ZReal, V::zero());
+            m_ZImag = V::blend(m_rebased, m_ZImag, V::zero());
+            m_n = V::blend(m_rebased, m_n, V::zero());
+        }
+
+        if constexpr (Distances) {
+            Vector m_dRealNew, m_dImagNew;
+            MultibrotStep<2>::derivative<V>(m_zReal, m_zImag, m_dReal, m_dImag, m_dRealNew, m_dImagNew);
+            m_dRealNew = V::add(m_dRealNew, m_ones);
+            m_dReal = V::blend(m_iterating, m_dReal, m_dRealNew);
+            m_dImag = V::blend(m_iterating, m_dImag, m_dImagNew);
+        }
+
+        // dz_(n+1) = (2 * Z_n + dz_n) * dz_n + dc
+        const Vector m_aReal = V::add(V::add(m_ZReal, m_ZReal), m_dzReal);
+        const Vector m_aImag = V::add(V::add(m_ZImag, m_ZImag), m_dzImag);
+        const Vector m_dzRealNew = V::fmadd(m_aReal, m_dzReal, V::sub(m_dcReal, V::mul(m_aImag, m_dzImag)));
+        const Vector m_dzImagNew = V::fmadd(m_aReal, m_dzImag, V::fmadd(m_aImag, m_dzReal, m_dcImag));
+        m_dzReal = V::blend(m_iterating, m_dzReal, m_dzRealNew);
+        m_dzImag = V::blend(m_iterating, m_dzImag, m_dzImagNew);
+        m_n = V::blend(m_iterating, m_n, V::add(m_n, m_ones));
+        m_k = V::blend(m_iterating, m_k, V::add(m_k, m_ones));
+
+        const Mask m_continuing = V::maskAnd(m_iterating, V::cmplt(m_k, m_maxIterations));
+        finished = V::bits(V::maskAndNot(m_active, m_continuing));
+        m_active = m_continuing;
+    }
+}
+
+// Colors count stored samples into interleaved RGB pixels, see colorizeSamples.
+// The smooth escape time is mu = n + 1 - log_d(log2(|z_n|)) for formulas of degree d, it is mapped to a palette position either through the cumulative histogram or by cycling
+template <typename V>
+void colorizeSamplesLanes(const ColorTables &tables, const StoredSample *samples, uint64_t count, unsigned char *out) noexcept {
+    using Vector = typename V::Vector;
+    using Scalar = typename V::Scalar;
+    constexpr uint64_t width = V::width;
+
+    const Vector m_ones = V::set1(1);
+    const Vector m_maxIterations = V::set1(tables.maxIterations);
+    const Vector m_lastIteration = V::set1(tables.maxIterations > 1 ? tables.maxIterations - 1 : 0);
+    const Vector m_paletteDensity = V::set1(tables.paletteDensity);
+    const Vector m_smoothScale = V::set1(tables.smoothScale);
+    const Vector m_paletteSize = V::set1(tables.paletteSize);
+    const Vector m_lastColor = V::set1(tables.paletteSize - 1);
+    const Scalar scale = tables.sixteenBit ? 1 : 1.0 / 257;
+
+    Scalar iterations[width], finalMagnitude2[width], red[width], green[width], blue[width];
+    for (uint64_t i = 0; i < count; i += width) {
+        const uint64_t lanes = count - i < width ? count - i : width;
+        for (uint64_t lane = 0; lane < width; lane++) {
+            iterations[lane] = lane < lanes ? samples[i + lane].iterations : 0;
+            finalMagnitude2[lane] = lane < lanes ? samples[i + lane].finalMagnitude2 : 0;
+        }
+        const Vector m_n = V::load(iterations);
+
+        Vector m_mu = m_n;
+        if (tables.smooth) {
+            // |z|^2 >= 4 keeps log2(log2(|z|)) defined for samples that never reached the bailout radius
+            const Vector m_log2Magnitude = V::mul(V::log2(V::max(V::load(finalMagnitude2), V::set1(4))), V::set1(0.5));
+            m_mu = V::max(V::sub(V::add(m_n, m_ones), V::mul(V::log2(m_log2Magnitude), m_smoothScale)), V::zero());
+        }
+
+        Vector m_position;
+        if (tables.cumulativeHistogram != nullptr) {
+            m_mu = V::min(m_mu, m_lastIteration);
+            const Vector m_whole = V::truncate(m_mu);
+            const Vector m_below = V::gather(tables.cumulativeHistogram, m_whole);
+            const Vector m_above = V::gather(tables.cumulativeHistogram, V::add(m_whole, m_ones));
+            m_position = V::fmadd(V::sub(m_mu, m_whole), V::sub(m_above, m_below), m_below);
+        } else {
+            m_position = V::mul(m_mu, m_paletteDensity);
+            m_position = V::sub(m_position, V::truncate(m_position));
+        }
+
+        // Linear interpolation between neighbouring palette entries, the copy of the first color closes the cycle
+        const Vector m_color = V::mul(m_position, m_paletteSize);
+        const Vector m_entry = V::min(V::truncate(m_color), m_lastColor);
+        const Vector m_next = V::add(m_entry, m_ones);
+        const Vector m_weight = V::sub(m_color, m_entry);
+        const typename V::Mask m_interior = V::maskAndNot(V::fullMask(), V::cmplt(m_n, m_maxIterations));
+        const Scalar *channels[3] = {tables.red, tables.green, tables.blue};
+        Scalar *results[3] = {red, green, blue};
+        for (uint64_t channel = 0; channel < 3; channel++) {
+            const Vector m_low = V::gather(channels[channel], m_entry);
+            const Vector m_value = V::fmadd(m_weight, V::sub(V::gather(channels[channel], m_next), m_low), m_low);
+            V::store(results[channel], V::blend(m_interior, m_value, V::zero()));
+        }
+
+        for (uint64_t lane = 0; lane < lanes; lane++) {
+            for (uint64_t channel = 0; channel < 3; channel++) {
+                const unsigned value = static_cast<unsigned>(results[channel][lane] * scale + 0.5);
+                if (tables.sixteenBit) {
+                    *out++ = static_cast<unsigned char>(value >> 8);
+                    *out++ = static_cast<unsigned char>(value);
+                } else {
+                    *out++ = static_cast<unsigned char>(value);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+#endif  // KERNELTEMPLATES_HPP_INCLUDED
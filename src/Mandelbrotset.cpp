@@ -1,109 +1,152 @@
 #include "Mandelbrotset.hpp"
 
-#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 
 #include <cstdint>
-#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 
+#include "Kernel.hpp"
 #include "Saves.hpp"
 
-extern MandelbrotsetConfiguration mConfig;
-extern TileConfiguration tConfig;
+extern thread_local MandelbrotsetConfiguration &mConfig;
+
+// Indexed by KernelType
+static const Kernel *const kernels[] = {&scalarKernel, &sse2Kernel, &avx2Kernel, &avx512Kernel};
+
+// Executes CPUID for leaf and subleaf, returns false if the leaf isn't supported
+static bool cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4]) noexcept {
+#if defined(_MSC_VER)
+    int maxLeaf[4];
+    __cpuid(maxLeaf, leaf & 0x80000000u);
+    if (static_cast<uint32_t>(maxLeaf[0]) < leaf) return false;
+    __cpuidex(reinterpret_cast<int*>(registers), leaf, subleaf);
+    return true;
+#else
+    return __get_cpuid_count(leaf, subleaf, &registers[0], &registers[1], &registers[2], &registers[3]) != 0;
+#endif
+}
+
+// Returns the XCR0 register, which tells which register states the operating system saves on context switches
+static uint64_t xgetbv() noexcept {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+KernelType detectKernelType() noexcept {
+    uint32_t leaf1[4] = {0}, leaf7[4] = {0};
+    if (!cpuid(1, 0, leaf1)) return ScalarKernel;
+    cpuid(7, 0, leaf7);
+
+    const bool sse2 = leaf1[3] & (1u << 26);
+    if (!sse2) return ScalarKernel;
+
+    // AVX registers are only usable if the operating system enabled them through XSAVE
+    const bool osxsave = leaf1[2] & (1u << 27);
+    const uint64_t xcr0 = osxsave ? xgetbv() : 0;
+    const bool ymmState = (xcr0 & 0x06) == 0x06;  // SSE and AVX state
+    const bool zmmState = (xcr0 & 0xe6) == 0xe6;  // and opmask, upper ZMM and high ZMM state
+
+    const bool avx = leaf1[2] & (1u << 28);
+    const bool fma = leaf1[2] & (1u << 12);
+    const bool avx2 = leaf7[1] & (1u << 5);
+    const bool avx512f = leaf7[1] & (1u << 16);
+
+    if (ymmState && zmmState && fma && avx512f) return AVX512Kernel;
+    if (ymmState && avx && fma && avx2) return AVX2Kernel;
+    return SSE2Kernel;
+}
+
+const char *kernelName(KernelType type) noexcept {
+    return kernels[type]->name;
+}
+
+// Picks the widest supported kernel, or the one named by MIG_KERNEL if the processor supports it
+static KernelType initialKernelType() noexcept {
+    const KernelType detected = detectKernelType();
+    const char *forced = std::getenv("MIG_KERNEL");
+    if (forced == nullptr || *forced == '\0') return detected;
+
+    for (int type = ScalarKernel; type <= AVX512Kernel; type++) {
+        if (strcmp(forced, kernels[type]->name) != 0) continue;
+        if (type > detected) {
+            std::cerr << "MIG_KERNEL=" << forced << " is not supported by this processor, using " << kernelName(detected) << std::endl;
+            return detected;
+        }
+        return static_cast<KernelType>(type);
+    }
+    std::cerr << "MIG_KERNEL=" << forced << " is not a known kernel (scalar, sse2, avx2, avx512), using " << kernelName(detected) << std::endl;
+    return detected;
+}
+
+static KernelType currentKernelType = initialKernelType();
+static const Kernel *currentKernel = kernels[currentKernelType];
 
-__m512d fmod(__m512d a, __m512d b) {
-    return _mm512_sub_pd(a, _mm512_mul_pd(_mm512_div_round_pd(a, b, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), b));
+bool selectKernel(KernelType type) noexcept {
+    if (type > detectKernelType()) return false;
+    currentKernelType = type;
+    currentKernel = kernels[type];
+    return true;
+}
+
+KernelType selectedKernel() noexcept {
+    return currentKernelType;
 }
 
 // Computes the result for 8 sequential pixels starting at pixel x and y, saves the results inside the output array outSamples.
 // x and y and image coordinates
 void computeIterationsVector(uint64_t x, uint64_t y, Sample outSamples[8]) noexcept {
-    const __m512d m_ones = _mm512_set1_pd(1);
-    const __m512d m_startReal = _mm512_set1_pd(mConfig.startReal);
-    const __m512d m_endReal = _mm512_set1_pd(mConfig.endReal);
-    const __m512d m_startImag = _mm512_set1_pd(mConfig.startImag);
-    const __m512d m_endImag = _mm512_set1_pd(mConfig.endImag);
-    const __m512d m_imageWidth = _mm512_set1_pd(tConfig.imageWidth - 1);
-    const __m512d m_imageHeight = _mm512_set1_pd(tConfig.imageHeight - 1);
-    const __m512d m_maxIterations = _mm512_set1_pd(mConfig.maxIterations);
-    const __m512d m_bailoutRadius = _mm512_set1_pd(mConfig.bailoutRadius);
-    const __m512d m_periodicityPrecision2 = _mm512_set1_pd(mConfig.periodicityPrecision2);
-    const __m512d m_periodicitySavePeriod = _mm512_set1_pd(mConfig.periodicitySavePeriod);
-
-    // Position vectors
-    __m512d m_x =  _mm512_set_pd(x + 7, x + 6, x + 5, x + 4, x + 3, x + 2, x + 1, x + 0); // Vectors read from right to left when converted to native types
-    __m512d m_y = _mm512_set1_pd(                           y                          );
-
-    // Input variables
-    // (((1 - (x / m)) * a) + ((x / m) * b)) = ((1 - (x / m)) * a + ((x / m) * b))
-    __m512d m_cReal = _mm512_fmadd_pd(_mm512_sub_pd(m_ones, _mm512_div_pd(m_x, m_imageWidth)), m_startReal, _mm512_mul_pd(_mm512_div_pd(m_x, m_imageWidth), m_endReal));
-    __m512d m_cImag = _mm512_fmadd_pd(_mm512_sub_pd(m_ones, _mm512_div_pd(m_y, m_imageHeight)), m_startImag, _mm512_mul_pd(_mm512_div_pd(m_y, m_imageHeight), m_endImag));
-
-    // Initialization variables
-    __m512d m_zReal = m_cReal;
-    __m512d m_zImag = m_cImag;
-    __m512d m_zReal2 = _mm512_set1_pd(0);
-    __m512d m_zImag2 = _mm512_set1_pd(0);
-    __m512d m_finalMagnitude2 = _mm512_set1_pd(0);
-    // Periodicity checking
-    __m512d m_oReal = _mm512_set1_pd(0);
-    __m512d m_oImag = _mm512_set1_pd(0);
-
-    // Compute for pixels (x + 0, y), (x + 1, y), (x + 2, y), (x + 3, y), (x + 4, y), (x + 5, y), (x + 6, y), (x + 7, y)
-    __mmask8 m_iterating = 0b11111111;
-
-    __m512d m_k = m_ones;
-    for (int64_t k = 1; k < mConfig.maxIterations; k++) {
-        m_zReal2 = _mm512_mul_pd(m_zReal, m_zReal);
-        m_zImag2 = _mm512_mul_pd(m_zImag, m_zImag);
-
-        if (mConfig.periodicitySavePeriod > 0) {
-            __mmask8 m_savePeriod = m_iterating & _mm512_cmplt_pd_mask(fmod(_mm512_sub_pd(m_k, m_ones), m_periodicitySavePeriod), _mm512_set1_pd(0));
-                     m_oReal = _mm512_mask_blend_pd(m_savePeriod, m_oReal, m_zReal);
-                     m_oImag = _mm512_mask_blend_pd(m_savePeriod, m_oImag, m_zImag);
-        }
-
-        __m512d  m_magnitude2 = _mm512_add_pd(m_zReal2, m_zImag2);
-                 m_finalMagnitude2 = _mm512_mask_blend_pd(m_iterating, m_finalMagnitude2, m_magnitude2);
-        __mmask8 m_mask = _mm512_cmplt_pd_mask(m_magnitude2, m_bailoutRadius);
-                 m_iterating = m_iterating & m_mask;
-
-        // Pixels are done iterating
-        if (m_iterating == 0b00000000) break;
-
-        // Iterate
-        // z_(n+1) = z ^ 2 + c
-        // z_(n+1).i = (2 * z.r * z.i) + c.i = (z.r + z.r) * z.i + c.i
-        // z_(n+1).r = (z.r * z.r) - (z.i * z.i) + c.r = (z.r + z.i) * (z.r - z.i) + c.r
-        __m512d m_zImagNew = _mm512_maskz_fmadd_pd(m_iterating, _mm512_add_pd(m_zReal, m_zReal), m_zImag, m_cImag);
-        m_zReal = _mm512_maskz_fmadd_pd(m_iterating, _mm512_add_pd(m_zReal, m_zImag), _mm512_sub_pd(m_zReal, m_zImag), m_cReal);
-        m_zImag = m_zImagNew;
-
-        if (mConfig.periodicitySavePeriod > 0) {
-            __m512d  m_pReal    = _mm512_sub_pd(m_zReal, m_oReal),
-                     m_pImag    = _mm512_sub_pd(m_zImag, m_oImag),
-                     m_error    = _mm512_add_pd(_mm512_mul_pd(m_pReal, m_pReal), _mm512_mul_pd(m_pImag, m_pImag));
-            __mmask8 m_inPeriod = _mm512_cmplt_pd_mask(m_error, m_periodicityPrecision2);
-
-            // Setting m_k to maxIter when in a period
-            m_k = _mm512_mask_blend_pd(m_inPeriod & m_iterating, m_k, m_maxIterations);
-            // Set iterating to false when in a period
-            m_iterating = m_iterating & ~m_inPeriod;
-        }
+    currentKernel->formulas[mConfig.formula].computeIterationsVector(x, y, outSamples);
+}
 
-        // Iterating m_k
-        m_k = _mm512_mask_add_pd(m_k, m_iterating, m_k, m_ones);
+// Computes every pixel in queue using lane refilling in the tile's precision and formula, or in double with dz/dc for distances, results are written to outSamples by each pixel's index
+uint64_t computeIterationsQueue(const TileContext &context, const QueuedPixel *queue, uint64_t count, Sample *outSamples, EscapeState *outUnresolved) noexcept {
+    const FormulaKernel &kernel = currentKernel->formulas[context.formula];
+    uint64_t unresolved;
+    if (context.distances) {
+        unresolved = kernel.computeIterationsQueueDistances(context, queue, count, outSamples, outUnresolved);
+    } else {
+        unresolved = context.precision == SinglePrecision ? kernel.computeIterationsQueueFloat(context, queue, count, outSamples, outUnresolved)
+                                                          : kernel.computeIterationsQueue(context, queue, count, outSamples, outUnresolved);
     }
-    __m512i m_iterations = _mm512_cvtpd_epi64(m_k);
-
-    double  *cReal =           reinterpret_cast<double*> (&m_cReal);
-    double  *cImag =           reinterpret_cast<double*> (&m_cImag);
-    int64_t *iteration =       reinterpret_cast<int64_t*>(&m_iterations);
-    double  *finalMagnitude2 = reinterpret_cast<double*> (&m_finalMagnitude2);
-    for (int i = 0; i < 8; i++) {
-        Sample &sample = outSamples[i];
-        sample.cReal = cReal[i];
-        sample.cImag = cImag[i];
-        sample.iterations = iteration[i];
-        sample.finalMagnitude2 = finalMagnitude2[i];
+    return unresolved;
+}
+
+// Computes a rectangle of pixels using lane refilling in the tile's precision and formula, rows are written stride samples apart
+uint64_t computeIterationsRows(const TileContext &context, uint64_t x, uint64_t y, uint64_t width, uint64_t height, StoredSample *outSamples, uint64_t stride,
+                               EscapeState *outUnresolved) noexcept {
+    const FormulaKernel &kernel = currentKernel->formulas[context.formula];
+    return context.precision == SinglePrecision ? kernel.computeIterationsRowsFloat(context, x, y, width, height, outSamples, stride, outUnresolved)
+                                                : kernel.computeIterationsRows(context, x, y, width, height, outSamples, stride, outUnresolved);
+}
+
+// Continues unresolved pixels using lane refilling in the tile's precision and formula, states saved in double are exact in float if the tile was iterated in float before
+uint64_t computeIterationsResumed(const TileContext &context, const EscapeState *states, uint64_t count, int64_t fromIterations, StoredSample *outSamples,
+                                  uint64_t stride, EscapeState *outUnresolved) noexcept {
+    const FormulaKernel &kernel = currentKernel->formulas[context.formula];
+    return context.precision == SinglePrecision ? kernel.computeIterationsResumedFloat(context, states, count, fromIterations, outSamples, stride, outUnresolved)
+                                                : kernel.computeIterationsResumed(context, states, count, fromIterations, outSamples, stride, outUnresolved);
+}
+
+// Computes every pixel in queue as a perturbation of reference, results are written to outSamples by each pixel's index
+void computeIterationsPerturbed(const PerturbationReference &reference, const QueuedPixel *queue, uint64_t count, Sample *outSamples) noexcept {
+    if (reference.distances) {
+        currentKernel->computeIterationsPerturbedDistances(reference, queue, count, outSamples);
+    } else {
+        currentKernel->computeIterationsPerturbed(reference, queue, count, outSamples);
     }
-}
\ No newline at end of file
+}
+
+void colorizeSamples(const ColorTables &tables, const StoredSample *samples, uint64_t count, unsigned char *out) noexcept {
+    currentKernel->colorizeSamples(tables, samples, count, out);
+}
@@ -8,11 +8,172 @@ struct Sample {
     double cImag;
     int64_t iterations;
     double finalMagnitude2;
+    // Only computed with TileContext::distances or PerturbationReference::distances, see DistanceSample
+    double distance;
+    double normalAngle;
+    // Iterations the kernel actually ran for the pixel, less than iterations for pixels finished by the bulb test (none) or caught in a period
+    // (those up to the iteration that caught them)
+    int64_t iterationsRun;
 
-    Sample() : cReal(0), cImag(0), iterations(0), finalMagnitude2(0) {}
+    Sample() : cReal(0), cImag(0), iterations(0), finalMagnitude2(0), distance(0), normalAngle(0), iterationsRun(0) {}
 };
 
-// Takes in x and y as image pixels and outputs them in samples output array
+// Part of a Sample that is kept on disk, see SampleStore.hpp. finalMagnitude2 is 0 for pixels that didn't escape, whatever |z|^2 they ended at,
+// so pixels filled without iterating them (see MarianiSilverRender) are stored exactly like computed ones
+struct StoredSample {
+    int64_t iterations;
+    double finalMagnitude2;
+};
+
+// Part of a Sample that is kept on disk with DistanceRender, see SampleStore.hpp. Both are 0 for pixels that didn't escape
+struct DistanceSample {
+    // Estimated distance to the set in the complex plane, ln|z| / |grad ln|z|| over c at the escaping iteration, i.e. |z| * ln|z| / |dz/dc| for every formula
+    // but the Burning Ship. The true distance lies within about a factor of 2 of it
+    double distance;
+    // Direction of grad ln|z| as an angle in the complex plane, the direction the escape time grows in, i.e. the normal of the set's equipotential lines
+    double normalAngle;
+};
+
+// Iteration state of a pixel that reached maxIterations without escaping or being caught in a period, see EscalationRender in Saves.hpp.
+// Continuing from it with a larger maxIterations gives the same result as iterating the pixel from the start with that budget
+struct EscapeState {
+    // Image pixel
+    uint64_t x;
+    uint64_t y;
+    // z after maxIterations iterations
+    double zReal;
+    double zImag;
+    // Last position saved for periodicity checking
+    double oReal;
+    double oImag;
+};
+
+// Floating point type a tile is iterated in, see prepareTile in TileGenerator.hpp for how it is picked
+enum Precision {
+    DoublePrecision,
+    // Twice as many lanes per vector, only resolves shallow views
+    SinglePrecision
+};
+
+// Constants of one tile handed to computeIterationsQueue and computeIterationsRows, see prepareTile in TileGenerator.hpp.
+// Kernels read everything from here instead of rebuilding it from mConfig and tConfig on every call
+struct TileContext {
+    // c of the tile's columns and rows, cReal[x - this->x] and cImag[y - this->y] for the image pixel at x and y
+    const double *cReal;
+    const double *cImag;
+    // Image pixel of the tile's top left corner
+    uint64_t x;
+    uint64_t y;
+    int64_t maxIterations;
+    double bailoutRadius;
+    double periodicityPrecision2;
+    uint64_t periodicitySavePeriod;
+    // Precision the tile's pixels are iterated in, c is rounded to it from the tables above
+    Precision precision;
+    // Formula the pixels are iterated with, which picks the kernel instantiation (see Formula in Saves.hpp), and the constant of JuliaFormula
+    uint64_t formula;
+    double juliaReal;
+    double juliaImag;
+    // Tracks dz/dc to fill in Sample::distance and Sample::normalAngle, only computeIterationsQueue does so and only in DoublePrecision.
+    // For JuliaFormula the derivative is taken by the starting point instead of c
+    bool distances;
+};
+
+// Pixel waiting in a computeIterationsQueue queue, its result is written to outSamples[index]
+struct QueuedPixel {
+    uint64_t x;
+    uint64_t y;
+    uint64_t index;
+};
+
+// Reference orbit handed to computeIterationsPerturbed, see ReferenceOrbit in Perturbation.hpp
+struct PerturbationReference {
+    // Z_n rounded to double for n in [0, length), Z_0 = 0
+    const double *zReal;
+    const double *zImag;
+    uint64_t length;
+    // Pixel position of the reference point C
+    double referenceX;
+    double referenceY;
+    // Complex plane distance between neighbouring pixels
+    double stepReal;
+    double stepImag;
+    // Tracks dz/dc to fill in Sample::distance and Sample::normalAngle
+    bool distances;
+};
+
+// Palette and mapping tables handed to colorizeSamples, see Colorizer in Colorizer.hpp
+struct ColorTables {
+    // Cyclic palette of paletteSize colors per channel in [0, 65535], followed by a copy of the first color
+    const double *red;
+    const double *green;
+    const double *blue;
+    uint64_t paletteSize;
+    // Fraction of escaped samples that escaped in fewer than n iterations for n in [0, maxIterations], nullptr disables histogram equalization
+    const double *cumulativeHistogram;
+    // Palette cycles per iteration when histogram equalization is disabled
+    double paletteDensity;
+    // Continuous escape time from finalMagnitude2 instead of whole iteration counts
+    bool smooth;
+    // 1 / log2(d) for formulas of degree d, the smooth escape time subtracts log_d(log2(|z|)) so it stays continuous across iteration counts
+    double smoothScale;
+    // Writes 16 bit big-endian channels instead of 8 bit ones
+    bool sixteenBit;
+    // maxIterations the samples were computed with, samples reaching it are interior
+    int64_t maxIterations;
+};
+
+// Instruction sets computeIterationsVector can dispatch to, ordered from narrowest to widest
+enum KernelType {
+    ScalarKernel,
+    SSE2Kernel,
+    AVX2Kernel,
+    AVX512Kernel
+};
+
+// Returns the widest kernel type supported by both the processor and the operating system, queried through CPUID
+KernelType detectKernelType() noexcept;
+
+// Makes computeIterationsVector dispatch to the kernel of type. Returns false and keeps the current kernel if the processor doesn't support type
+bool selectKernel(KernelType type) noexcept;
+
+// Returns the kernel type computeIterationsVector currently dispatches to
+KernelType selectedKernel() noexcept;
+
+// Returns the name of the kernel of type, this is also the value MIG_KERNEL accepts for it
+const char *kernelName(KernelType type) noexcept;
+
+// Takes in x and y as image pixels and outputs them in samples output array, iterated with mConfig.formula
+// Dispatches to the kernel picked at startup, which is the widest one supported unless overridden by the MIG_KERNEL environment variable
 void computeIterationsVector(uint64_t x, uint64_t y, Sample outSamples[8]) noexcept;
 
-#endif  // MANDELBROTSET_HPP_INCLUDED
\ No newline at end of file
+// Computes every pixel in queue, which all have to lie in the tile of context, and writes each result to outSamples[pixel.index].
+// Vector lanes are refilled from the queue as soon as their pixel finishes, so unlike computeIterationsVector a slow pixel never holds up its neighbours.
+// Pixels inside the main cardioid or the period-2 bulb are recognized analytically and get maxIterations without iterating when context.formula is MandelbrotFormula.
+// With context.precision SinglePrecision the pixels are iterated in float, which fills twice as many lanes per vector.
+// With context.distances the derivative dz/dc is iterated alongside z for the distance estimate, in double precision regardless of context.precision.
+// Unless outUnresolved is nullptr the state of every pixel that ran out of iterations is written to it, which needs room for count states.
+// The pixels and the iterations they actually ran are counted into the calling worker's counters, see countKernelWork in Telemetry.hpp.
+// Returns the number of states written
+uint64_t computeIterationsQueue(const TileContext &context, const QueuedPixel *queue, uint64_t count, Sample *outSamples, EscapeState *outUnresolved) noexcept;
+
+// Computes the width * height pixels starting at image pixel x and y, which all have to lie in the tile of context, like computeIterationsQueue.
+// Row j of the rectangle is written to outSamples[j * stride, j * stride + width), so a rectangle of a SampleStore tile is written in place with stride tileWidth
+uint64_t computeIterationsRows(const TileContext &context, uint64_t x, uint64_t y, uint64_t width, uint64_t height, StoredSample *outSamples, uint64_t stride,
+                               EscapeState *outUnresolved) noexcept;
+
+// Continues the count pixels of states, which all have to lie in the tile of context, from iteration fromIterations up to context.maxIterations.
+// The result of the pixel at image pixel x and y is written to outSamples[(y - context.y) * stride + x - context.x], pixels running out of iterations again
+// are written to outUnresolved like in computeIterationsQueue. Only the iterations past fromIterations are counted
+uint64_t computeIterationsResumed(const TileContext &context, const EscapeState *states, uint64_t count, int64_t fromIterations, StoredSample *outSamples,
+                                  uint64_t stride, EscapeState *outUnresolved) noexcept;
+
+// Like computeIterationsQueue, but iterates each pixel's difference from reference in double precision (perturbation theory).
+// Pixel c values never have to be represented as doubles, which allows zooming far beyond the resolution of a double.
+// Pixels that lose precision relative to the reference are rebased onto the start of the reference orbit. reference.distances adds the distance estimate.
+void computeIterationsPerturbed(const PerturbationReference &reference, const QueuedPixel *queue, uint64_t count, Sample *outSamples) noexcept;
+
+// Colors count samples into out as interleaved RGB pixels of 3 or 6 bytes depending on tables.sixteenBit, interior points are black
+void colorizeSamples(const ColorTables &tables, const StoredSample *samples, uint64_t count, unsigned char *out) noexcept;
+
+#endif  // MANDELBROTSET_HPP_INCLUDED
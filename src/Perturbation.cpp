@@ -0,0 +1,76 @@
+#include "Perturbation.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "DoubleDouble.hpp"
+#include "Saves.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+
+PerturbationReference ReferenceOrbit::reference(const double stepReal, const double stepImag) const noexcept {
+    return {
+        .zReal = zReal.data(),
+        .zImag = zImag.data(),
+        .length = zReal.size(),
+        .referenceX = referenceX,
+        .referenceY = referenceY,
+        .stepReal = stepReal,
+        .stepImag = stepImag,
+        .distances = false
+    };
+}
+
+void computeReferenceOrbit(double cRealHi, double cRealLo, double cImagHi, double cImagLo, int64_t maxIterations, ReferenceOrbit &orbit) {
+    const DoubleDouble cReal(cRealHi, cRealLo);
+    const DoubleDouble cImag(cImagHi, cImagLo);
+    orbit.cRealHi = cRealHi;
+    orbit.cRealLo = cRealLo;
+    orbit.cImagHi = cImagHi;
+    orbit.cImagLo = cImagLo;
+
+    orbit.zReal.clear();
+    orbit.zImag.clear();
+    orbit.zReal.reserve(maxIterations + 1);
+    orbit.zImag.reserve(maxIterations + 1);
+
+    DoubleDouble zReal, zImag;
+    for (int64_t n = 0; n <= maxIterations; n++) {
+        orbit.zReal.push_back(zReal.hi);
+        orbit.zImag.push_back(zImag.hi);
+        if (zReal.hi * zReal.hi + zImag.hi * zImag.hi >= mConfig.bailoutRadius) break;
+
+        // z_(n+1) = z ^ 2 + c
+        const DoubleDouble zRealNew = (zReal + zImag) * (zReal - zImag) + cReal;
+        zImag = (zReal + zReal) * zImag + cImag;
+        zReal = zRealNew;
+    }
+}
+
+// C's offset from the image center is taken in double-double, only the offset in pixels has to fit in a double
+void placeReferenceOrbit(ReferenceOrbit &orbit) {
+    const DoubleDouble offsetReal = DoubleDouble(orbit.cRealHi, orbit.cRealLo) - DoubleDouble(mConfig.centerRealHi, mConfig.centerRealLo);
+    const DoubleDouble offsetImag = DoubleDouble(orbit.cImagHi, orbit.cImagLo) - DoubleDouble(mConfig.centerImagHi, mConfig.centerImagLo);
+    orbit.referenceX = offsetReal.hi / mConfig.pixelStepReal(tConfig.imageWidth) + (tConfig.imageWidth - 1) / 2.0;
+    orbit.referenceY = offsetImag.hi / mConfig.pixelStepImag(tConfig.imageHeight) + (tConfig.imageHeight - 1) / 2.0;
+}
+
+// Computes the orbit of the tile's center pixel. The center's offset from the image center is small enough to be exact as a double,
+// only adding it to the double-double image center needs the extra precision.
+void computeTileReferenceOrbit(uint64_t tileIndex, ReferenceOrbit &orbit) {
+    const uint64_t tileX = tileIndex % tConfig.tileGridWidth;
+    const uint64_t tileY = tileIndex / tConfig.tileGridWidth;
+    // Tiles cut off at the image's edge are centered on their part within the image
+    const double referenceX = tConfig.tileWidth() * tileX + (std::max<double>(tConfig.tileWidthAt(tileX), 1) - 1) / 2.0;
+    const double referenceY = tConfig.tileHeight() * tileY + (std::max<double>(tConfig.tileHeightAt(tileY), 1) - 1) / 2.0;
+
+    const double offsetReal = (referenceX - (tConfig.imageWidth - 1) / 2.0) * mConfig.pixelStepReal(tConfig.imageWidth);
+    const double offsetImag = (referenceY - (tConfig.imageHeight - 1) / 2.0) * mConfig.pixelStepImag(tConfig.imageHeight);
+    const DoubleDouble cReal = DoubleDouble(mConfig.centerRealHi, mConfig.centerRealLo) + offsetReal;
+    const DoubleDouble cImag = DoubleDouble(mConfig.centerImagHi, mConfig.centerImagLo) + offsetImag;
+
+    computeReferenceOrbit(cReal.hi, cReal.lo, cImag.hi, cImag.lo, mConfig.maxIterations, orbit);
+    orbit.referenceX = referenceX;
+    orbit.referenceY = referenceY;
+}
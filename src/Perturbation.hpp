@@ -0,0 +1,37 @@
+#ifndef PERTURBATION_HPP_INCLUDED
+#define PERTURBATION_HPP_INCLUDED
+#include <cstdint>
+#include <vector>
+
+#include "Mandelbrotset.hpp"
+
+// High precision reference orbit Z_n for perturbation rendering, Z_0 = 0 and Z_(n+1) = Z_n ^ 2 + C computed in double-double and rounded to double
+struct ReferenceOrbit {
+    std::vector<double> zReal;
+    std::vector<double> zImag;
+    // Pixel position of C, may lie between pixels or outside of the image
+    double referenceX;
+    double referenceY;
+    // C as a double-double (hi + lo)
+    double cRealHi;
+    double cRealLo;
+    double cImagHi;
+    double cImagLo;
+
+    ReferenceOrbit() : zReal(), zImag(), referenceX(0), referenceY(0), cRealHi(0), cRealLo(0), cImagHi(0), cImagLo(0) {}
+    // View handed to computeIterationsPerturbed without distances, only valid as long as this orbit isn't modified
+    PerturbationReference reference(const double stepReal, const double stepImag) const noexcept;
+};
+
+// Computes the reference orbit of the double-double point C = (cRealHi + cRealLo) + (cImagHi + cImagLo)i, iterated until it escapes or reaches maxIterations.
+// Its pixel position is left to placeReferenceOrbit
+void computeReferenceOrbit(double cRealHi, double cRealLo, double cImagHi, double cImagLo, int64_t maxIterations, ReferenceOrbit &orbit);
+
+// Sets the pixel position of orbit's C within the image of mConfig's double-double center and zoom
+void placeReferenceOrbit(ReferenceOrbit &orbit);
+
+// Computes the reference orbit at the center of the tile with index tileIndex, using mConfig's double-double center and zoom.
+// The orbit is iterated until it escapes or reaches mConfig.maxIterations.
+void computeTileReferenceOrbit(uint64_t tileIndex, ReferenceOrbit &orbit);
+
+#endif  // PERTURBATION_HPP_INCLUDED
@@ -0,0 +1,114 @@
+#include "PngEncoder.hpp"
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+// Size of the compressed data in one IDAT chunk
+static constexpr uint64_t chunkSize = 1 << 20;
+
+static void writeUint32(unsigned char *out, uint32_t value) noexcept {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+PngEncoder::PngEncoder(const std::filesystem::path &path, uint64_t imageWidth, uint64_t imageHeight, uint8_t bitDepth, PngColorType colorType)
+    : file(path, std::ios::binary),
+      filepath(path),
+      stream(),
+      width(imageWidth),
+      height(imageHeight),
+      bytesPerPixel((colorType == PngRGB ? 3 : 1) * bitDepth / 8),
+      rowsWritten(0),
+      finished(false),
+      filteredRow(1 + imageWidth * bytesPerPixel),
+      compressed(chunkSize) {
+    if (!file) throw std::system_error(errno, std::generic_category(), filepath.string());
+    if (width == 0 || height == 0 || width > UINT32_MAX || height > UINT32_MAX) throw std::invalid_argument("PNG dimensions out of range: " + filepath.string());
+
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) throw std::runtime_error("deflateInit failed: " + filepath.string());
+    stream.next_out = compressed.data();
+    stream.avail_out = compressed.size();
+
+    file.write("\x89PNG\r\n\x1a\n", 8);
+    unsigned char header[13];
+    writeUint32(header, width);
+    writeUint32(header + 4, height);
+    header[8] = bitDepth;
+    header[9] = colorType;
+    header[10] = 0;  // Deflate compression
+    header[11] = 0;  // Adaptive filtering
+    header[12] = 0;  // No interlacing
+    writeChunk("IHDR", header, sizeof(header));
+}
+
+PngEncoder::~PngEncoder() {
+    deflateEnd(&stream);
+}
+
+uint64_t PngEncoder::rowSize() const noexcept {
+    return width * bytesPerPixel;
+}
+
+void PngEncoder::writeChunk(const char type[4], const unsigned char *data, uint64_t size) {
+    unsigned char length[4], crc[4];
+    writeUint32(length, size);
+    uLong checksum = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0) checksum = crc32(checksum, data, size);  // crc32 with a null buffer returns the initial value instead
+    writeUint32(crc, checksum);
+
+    file.write(reinterpret_cast<const char*>(length), 4);
+    file.write(type, 4);
+    file.write(reinterpret_cast<const char*>(data), size);
+    file.write(reinterpret_cast<const char*>(crc), 4);
+    if (!file) throw std::system_error(errno, std::generic_category(), filepath.string());
+}
+
+// Feeds the current filteredRow to deflate, writing an IDAT chunk every time the output buffer fills up
+void PngEncoder::deflateRow(int flush) {
+    stream.next_in = filteredRow.data();
+    stream.avail_in = flush == Z_FINISH ? 0 : filteredRow.size();
+    while (true) {
+        const int result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR) throw std::runtime_error("deflate failed: " + filepath.string());
+        if (stream.avail_out == 0 || (result == Z_STREAM_END && stream.avail_out != compressed.size())) {
+            writeChunk("IDAT", compressed.data(), compressed.size() - stream.avail_out);
+            stream.next_out = compressed.data();
+            stream.avail_out = compressed.size();
+        }
+        if (flush == Z_FINISH ? result == Z_STREAM_END : stream.avail_in == 0 && stream.avail_out != 0) return;
+    }
+}
+
+// Rows are filtered with the Sub filter, which stores each byte as the difference to the same channel of the pixel to its left.
+// It costs one subtraction per byte and fits the smooth gradients of escape time images well.
+void PngEncoder::writeRows(const unsigned char *rows, uint64_t rowCount) {
+    if (rowsWritten + rowCount > height) throw std::out_of_range("too many rows written: " + filepath.string());
+    const uint64_t size = rowSize();
+    for (uint64_t row = 0; row < rowCount; row++) {
+        const unsigned char *pixels = rows + row * size;
+        filteredRow[0] = 1;
+        for (uint64_t i = 0; i < bytesPerPixel; i++) filteredRow[1 + i] = pixels[i];
+        for (uint64_t i = bytesPerPixel; i < size; i++) filteredRow[1 + i] = pixels[i] - pixels[i - bytesPerPixel];
+        deflateRow(Z_NO_FLUSH);
+    }
+    rowsWritten += rowCount;
+}
+
+void PngEncoder::finish() {
+    if (finished) return;
+    if (rowsWritten != height) throw std::logic_error("PNG finished with " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows: " + filepath.string());
+    deflateRow(Z_FINISH);
+    writeChunk("IEND", nullptr, 0);
+    file.flush();
+    if (!file) throw std::system_error(errno, std::generic_category(), filepath.string());
+    finished = true;
+}
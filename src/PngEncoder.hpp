@@ -0,0 +1,52 @@
+#ifndef PNGENCODER_HPP_INCLUDED
+#define PNGENCODER_HPP_INCLUDED
+#include <zlib.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// PNG color types used by MIG
+enum PngColorType : uint8_t {
+    PngGrayscale = 0,
+    PngRGB = 2
+};
+
+// Writes a PNG file row by row. Rows are filtered and deflated as they come in and flushed to disk in IDAT chunks,
+// so only the deflate window and one chunk worth of compressed data are ever held in memory, no matter how big the image is.
+class PngEncoder {
+   public:
+    // Opens path and writes the PNG signature and IHDR chunk. bitDepth is 8 or 16
+    PngEncoder(const std::filesystem::path &path, uint64_t imageWidth, uint64_t imageHeight, uint8_t bitDepth, PngColorType colorType);
+    PngEncoder(const PngEncoder &) = delete;
+    PngEncoder &operator=(const PngEncoder &) = delete;
+    ~PngEncoder();
+
+    // Number of bytes of one unfiltered row
+    uint64_t rowSize() const noexcept;
+
+    // Appends rowCount rows of rowSize() bytes each, 16 bit samples are big-endian as PNG stores them
+    void writeRows(const unsigned char *rows, uint64_t rowCount);
+
+    // Flushes the deflate stream and writes the IEND chunk. Throws if fewer rows than the image height were written
+    void finish();
+
+   private:
+    void writeChunk(const char type[4], const unsigned char *data, uint64_t size);
+    void deflateRow(int flush);
+
+    std::ofstream file;
+    std::filesystem::path filepath;
+    z_stream stream;
+    uint64_t width;
+    uint64_t height;
+    uint64_t bytesPerPixel;
+    uint64_t rowsWritten;
+    bool finished;
+    // Filter type byte followed by the filtered row
+    std::vector<unsigned char> filteredRow;
+    std::vector<unsigned char> compressed;
+};
+
+#endif  // PNGENCODER_HPP_INCLUDED
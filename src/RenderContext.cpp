@@ -0,0 +1,90 @@
+#include "RenderContext.hpp"
+
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "ImageGenerator.hpp"
+#include "RenderState.hpp"
+#include "Saves.hpp"
+#include "TileScheduler.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+RenderContext::RenderContext(uint64_t workerCount)
+    : state{}, mutex(), jobQueued(), queue(), rendering(false), stopping(false), scheduler(nullptr), thread(&RenderContext::run, this, workerCount) {}
+
+RenderContext::~RenderContext() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobQueued.notify_all();
+    thread.join();
+}
+
+std::future<void> RenderContext::render(RenderJob job) {
+    QueuedJob queued = {.job = std::move(job), .done = {}};
+    std::future<void> done = queued.done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(queued));
+    }
+    jobQueued.notify_all();
+    return done;
+}
+
+void RenderContext::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (QueuedJob &queued : queue) {
+        queued.done.set_exception(std::make_exception_ptr(std::system_error(std::make_error_code(std::errc::operation_canceled), queued.job.imagePath.string())));
+    }
+    queue.clear();
+    if (rendering) scheduler->cancel();
+}
+
+void RenderContext::run(uint64_t workerCount) {
+    bindRenderState(state);
+    pConfig.threadsUsed = workerCount;
+    TileScheduler workers(workerCount);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        scheduler = &workers;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobQueued.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) break;
+        QueuedJob queued = std::move(queue.front());
+        queue.pop_front();
+        // A cancel from before this job doesn't reach it, one from now on does
+        rendering = true;
+        workers.resume();
+        lock.unlock();
+
+        try {
+            const RenderJob &job = queued.job;
+            mConfig = job.mConfig;
+            tConfig = job.tConfig;
+            resetProgressConfiguration(tConfig.tileGridWidth * tConfig.tileGridHeight, tConfig.threadGridWidth * tConfig.threadGridHeight);
+            workers.setTileCallback(job.onTile);
+            generateImage(workers, job.imagePath, job.storePath, job.colorSettings, job.supersampleSettings);
+            queued.done.set_value();
+        } catch (...) {
+            queued.done.set_exception(std::current_exception());
+        }
+        workers.setTileCallback(nullptr);
+
+        lock.lock();
+        rendering = false;
+    }
+    scheduler = nullptr;
+}
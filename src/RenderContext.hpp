@@ -0,0 +1,71 @@
+#ifndef RENDERCONTEXT_HPP_INCLUDED
+#define RENDERCONTEXT_HPP_INCLUDED
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "Colorizer.hpp"
+#include "RenderState.hpp"
+#include "Saves.hpp"
+#include "TileGenerator.hpp"
+#include "TileScheduler.hpp"
+
+// One image for a RenderContext to render
+struct RenderJob {
+    // View and image, the thread grid can differ from job to job while the context's worker count stays
+    MandelbrotsetConfiguration mConfig;
+    TileConfiguration tConfig;
+    // Written like generateImage writes them, a store that already holds tiles of the same view is resumed
+    std::filesystem::path imagePath;
+    std::filesystem::path storePath;
+    ColorSettings colorSettings;
+    SupersampleSettings supersampleSettings;
+    // Called for every tile computed into the store, on the worker computing it, see TileScheduler::setTileCallback. Has to be thread safe, may be empty
+    TileScheduler::TileCallback onTile;
+};
+
+// Renders images in process, one after another, with a render state (see RenderState.hpp) and a TileScheduler of its own.
+// Renders of different contexts run concurrently and independently of each other and of the command line's globals. The workers and their scratch buffers
+// are started once and kept for every job, so rendering many images through one context costs no process or thread startup per image.
+// Contexts don't journal progress, saving configurations is up to the caller
+class RenderContext {
+   public:
+    // Starts a context whose renders use workerCount workers
+    explicit RenderContext(uint64_t workerCount);
+    RenderContext(const RenderContext &) = delete;
+    RenderContext &operator=(const RenderContext &) = delete;
+    // Cancels the running and queued jobs and stops the workers
+    ~RenderContext();
+
+    // Queues job behind the context's earlier ones. The future becomes ready once the job's images are written, or holds the error it failed with
+    std::future<void> render(RenderJob job);
+    // Cancels the running job and every queued one, their futures hold a std::system_error of std::errc::operation_canceled.
+    // Tiles the running job completed stay in its store, rendering the job again resumes there. Thread safe
+    void cancel();
+
+   private:
+    struct QueuedJob {
+        RenderJob job;
+        std::promise<void> done;
+    };
+
+    // Binds the context's thread to state and renders the queued jobs on the scheduler's workers until the context is destroyed
+    void run(uint64_t workerCount);
+
+    RenderState state;
+    // Guards queue, rendering, stopping and scheduler
+    std::mutex mutex;
+    std::condition_variable jobQueued;
+    std::deque<QueuedJob> queue;
+    bool rendering;
+    bool stopping;
+    // Owned by run, nullptr until its workers are started
+    TileScheduler *scheduler;
+    std::thread thread;
+};
+
+#endif  // RENDERCONTEXT_HPP_INCLUDED
@@ -0,0 +1,29 @@
+#include "RenderState.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include "Saves.hpp"
+
+// State bound to this thread, and whether the thread took it already. Neither needs dynamic initialization, reading them doesn't bind the references below
+static thread_local constinit RenderState *boundState = nullptr;
+static thread_local constinit bool boundStateTaken = false;
+
+void bindRenderState(RenderState &state) {
+    if (boundStateTaken && boundState != &state) throw std::logic_error("thread is already bound to another render state");
+    boundState = &state;
+}
+
+RenderState &boundRenderState() {
+    if (boundState == nullptr) throw std::logic_error("thread has no render state bound");
+    boundStateTaken = true;
+    return *boundState;
+}
+
+// Bound on the thread's first use of any of them, which is why a thread can't be bound to another state afterwards
+thread_local MandelbrotsetConfiguration &mConfig = boundRenderState().mConfig;
+thread_local TileConfiguration &tConfig = boundRenderState().tConfig;
+thread_local ProgressConfiguration &pConfig = boundRenderState().pConfig;
+thread_local std::filesystem::path &savePath = boundRenderState().savePath;
+thread_local std::vector<int64_t> &budgetHistory = boundRenderState().budgetHistory;
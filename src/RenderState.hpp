@@ -0,0 +1,68 @@
+#ifndef RENDERSTATE_HPP_INCLUDED
+#define RENDERSTATE_HPP_INCLUDED
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Saves.hpp"
+#include "Telemetry.hpp"
+
+struct ReferenceOrbit;
+
+// Everything a render reads and writes besides its files. mConfig, tConfig, pConfig, savePath and budgetHistory are references to the members
+// of the state bound to the calling thread (see bindRenderState), so threads bound to different states render independently of each other
+struct RenderState {
+    MandelbrotsetConfiguration mConfig;
+    TileConfiguration tConfig;
+    ProgressConfiguration pConfig;
+    std::filesystem::path savePath;
+    std::vector<int64_t> budgetHistory;
+
+    // Orbit every deep zoom tile is perturbed around, see shareReferenceOrbit
+    const ReferenceOrbit *sharedReferenceOrbit;
+
+    // Journal of tile completions appended to a ".mpc" file, see openProgressJournal. Guarded by progressJournalMutex
+    std::mutex progressJournalMutex;
+    std::ofstream progressJournal;
+    std::filesystem::path progressJournalPath;
+
+    // Worker counters and ETA totals, see Telemetry.hpp
+    RenderTelemetry telemetry;
+};
+
+// Binds the calling thread to state, which has to outlive the thread. A thread is bound once, before it first touches mConfig, tConfig, pConfig,
+// savePath or budgetHistory, binding it to another state afterwards throws std::logic_error
+void bindRenderState(RenderState &state);
+
+// State bound to the calling thread, throws std::logic_error if there is none
+RenderState &boundRenderState();
+
+// std::thread running function(args...) bound to the calling thread's state, every thread a render starts is one of these
+template <typename Function, typename... Args>
+std::thread boundThread(Function &&function, Args &&...args) {
+    return std::thread(
+        [&state = boundRenderState()](auto boundFunction, auto... boundArgs) {
+            bindRenderState(state);
+            std::invoke(std::move(boundFunction), std::move(boundArgs)...);
+        },
+        std::forward<Function>(function), std::forward<Args>(args)...);
+}
+
+// std::async with std::launch::async running function(args...) bound to the calling thread's state
+template <typename Function, typename... Args>
+auto boundAsync(Function &&function, Args &&...args) {
+    return std::async(
+        std::launch::async,
+        [&state = boundRenderState()](auto boundFunction, auto... boundArgs) {
+            bindRenderState(state);
+            return std::invoke(std::move(boundFunction), std::move(boundArgs)...);
+        },
+        std::forward<Function>(function), std::forward<Args>(args)...);
+}
+
+#endif  // RENDERSTATE_HPP_INCLUDED
@@ -0,0 +1,256 @@
+#include "SampleStore.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+#include "Saves.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+
+static constexpr uint64_t pageAlignment = 4096;
+// Bumped whenever the same configurations map to a different tile layout, stores of other layouts are reset
+static constexpr unsigned char layoutVersion = 1;
+static constexpr uint64_t layoutVersionOffset = 2;
+static constexpr uint64_t mConfigOffset = 8;
+static constexpr uint64_t tConfigOffset = mConfigOffset + sizeof(MandelbrotsetConfiguration);
+static constexpr uint64_t budgetCountOffset = tConfigOffset + sizeof(TileConfiguration);
+static constexpr uint64_t budgetHistoryOffset = budgetCountOffset + sizeof(uint64_t);
+static constexpr uint64_t maxBudgetHistory = 256;
+static_assert(budgetHistoryOffset + maxBudgetHistory * sizeof(int64_t) <= pageAlignment, "sample store header has to fit in its first page");
+static_assert(budgetCountOffset % alignof(uint64_t) == 0, "budget history has to be aligned");
+
+// Tile records hold their TileRecordFlag bits below this bit and the maxIterations the tile is complete for above it
+static constexpr uint64_t recordBudgetShift = 8;
+static constexpr uint64_t recordFlagsMask = (1ULL << recordBudgetShift) - 1;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) noexcept {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Whether the MandelbrotsetConfiguration stored at header belongs to samples the current mConfig can use.
+// Escalating stores are kept across maxIterations changes, their tiles remember the budget they were computed with
+static bool sameMandelbrotsetConfiguration(const char *stored) noexcept {
+    const char *current = reinterpret_cast<const char*>(&mConfig);
+    if (!mConfig.escalates()) return memcmp(stored, current, sizeof(MandelbrotsetConfiguration)) == 0;
+    constexpr uint64_t budgetOffset = offsetof(MandelbrotsetConfiguration, maxIterations);
+    constexpr uint64_t restOffset = budgetOffset + sizeof(int64_t);
+    return memcmp(stored, current, budgetOffset) == 0 && memcmp(stored + restOffset, current + restOffset, sizeof(MandelbrotsetConfiguration) - restOffset) == 0;
+}
+
+SampleStore::SampleStore(const std::filesystem::path &path)
+    : filepath(path),
+      mapping(nullptr),
+      mappingSize(0),
+      tileCount(tConfig.tileGridWidth * tConfig.tileGridHeight),
+      samplesPerTile(tConfig.tileWidth() * tConfig.tileHeight()),
+      recordsOffset(pageAlignment),
+      samplesOffset(alignUp(pageAlignment + tileCount * sizeof(uint64_t), pageAlignment)),
+      unresolvedRegionOffset(alignUp(samplesOffset + tileCount * samplesPerTile * sizeof(StoredSample), pageAlignment)),
+      unresolvedListSize(mConfig.escalates() ? sizeof(uint64_t) + samplesPerTile * sizeof(EscapeState) : 0),
+      distancesOffset(mConfig.renderFlags & DistanceRender ? unresolvedRegionOffset : 0),
+#if defined(_WIN32)
+      fileHandle(INVALID_HANDLE_VALUE),
+      mappingHandle(nullptr)
+#else
+      fileDescriptor(-1)
+#endif
+{
+    mappingSize = samplesOffset + tileCount * samplesPerTile * sizeof(StoredSample);
+    if (mConfig.escalates()) mappingSize = unresolvedRegionOffset + 2 * tileCount * unresolvedListSize;
+    if (distancesOffset != 0) mappingSize = distancesOffset + tileCount * samplesPerTile * sizeof(DistanceSample);
+
+    // An existing store is only reused if it has the expected size and was computed with the same configurations
+    bool reuse = false;
+    if (!filepath.empty() && std::filesystem::exists(filepath) && std::filesystem::file_size(filepath) == mappingSize) {
+        std::ifstream existing(filepath, std::ios::binary);
+        char header[tConfigOffset + sizeof(TileConfiguration)];
+        if (existing.read(header, sizeof(header)).gcount() == sizeof(header)) {
+            reuse = strncmp(header, "SS", 2) == 0 && static_cast<unsigned char>(header[layoutVersionOffset]) == layoutVersion &&
+                    sameMandelbrotsetConfiguration(header + mConfigOffset) &&
+                    memcmp(header + tConfigOffset, &tConfig, sizeof(TileConfiguration)) == 0;
+        }
+    }
+
+#if defined(_WIN32)
+    if (filepath.empty()) {
+        // Backed by the paging file, which reads back as zeros
+        mappingHandle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, mappingSize >> 32, mappingSize & 0xffffffff, nullptr);
+        if (mappingHandle == nullptr) throw std::system_error(GetLastError(), std::system_category(), "anonymous sample store");
+        mapping = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize));
+        if (mapping == nullptr) throw std::system_error(GetLastError(), std::system_category(), "anonymous sample store");
+    } else {
+        fileHandle = CreateFileW(filepath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) throw std::system_error(GetLastError(), std::system_category(), filepath.string());
+        if (!reuse) {
+            // Truncating first makes the extended file read back as zeros, i.e. no tile is completed
+            LARGE_INTEGER size{};
+            if (!SetFilePointerEx(fileHandle, size, nullptr, FILE_BEGIN) || !SetEndOfFile(fileHandle)) throw std::system_error(GetLastError(), std::system_category(), filepath.string());
+            size.QuadPart = mappingSize;
+            if (!SetFilePointerEx(fileHandle, size, nullptr, FILE_BEGIN) || !SetEndOfFile(fileHandle)) throw std::system_error(GetLastError(), std::system_category(), filepath.string());
+        }
+        mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READWRITE, mappingSize >> 32, mappingSize & 0xffffffff, nullptr);
+        if (mappingHandle == nullptr) throw std::system_error(GetLastError(), std::system_category(), filepath.string());
+        mapping = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize));
+        if (mapping == nullptr) throw std::system_error(GetLastError(), std::system_category(), filepath.string());
+    }
+#else
+    if (filepath.empty()) {
+        // Anonymous mappings read back as zeros like a freshly extended file
+        void *address = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "anonymous sample store");
+        mapping = static_cast<unsigned char*>(address);
+    } else {
+        fileDescriptor = open(filepath.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fileDescriptor < 0) throw std::system_error(errno, std::generic_category(), filepath.string());
+        if (!reuse) {
+            // Truncating first makes the extended (sparse) file read back as zeros, i.e. no tile is completed
+            if (ftruncate(fileDescriptor, 0) != 0 || ftruncate(fileDescriptor, mappingSize) != 0) throw std::system_error(errno, std::generic_category(), filepath.string());
+        }
+        void *address = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        if (address == MAP_FAILED) throw std::system_error(errno, std::generic_category(), filepath.string());
+        mapping = static_cast<unsigned char*>(address);
+    }
+#endif
+
+    // Fresh stores start out with an empty budget history, each run appends its maxIterations unless it repeats the last one
+    uint64_t &budgetCount = *reinterpret_cast<uint64_t*>(mapping + budgetCountOffset);
+    int64_t *budgets = reinterpret_cast<int64_t*>(mapping + budgetHistoryOffset);
+    if (!reuse || budgetCount == 0 || budgets[budgetCount - 1] != mConfig.maxIterations) {
+        if (!reuse) budgetCount = 0;
+        if (budgetCount == maxBudgetHistory) {
+            std::copy(budgets + 1, budgets + maxBudgetHistory, budgets);
+            budgetCount--;
+        }
+        budgets[budgetCount++] = mConfig.maxIterations;
+        memcpy(mapping, "SS", 2);
+        mapping[layoutVersionOffset] = layoutVersion;
+        memcpy(mapping + mConfigOffset, &mConfig, sizeof(MandelbrotsetConfiguration));
+        memcpy(mapping + tConfigOffset, &tConfig, sizeof(TileConfiguration));
+        flush(0, pageAlignment);
+    }
+}
+
+SampleStore::~SampleStore() {
+#if defined(_WIN32)
+    if (mapping != nullptr) UnmapViewOfFile(mapping);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+    if (mapping != nullptr) munmap(mapping, mappingSize);
+    if (fileDescriptor >= 0) close(fileDescriptor);
+#endif
+}
+
+StoredSample *SampleStore::tile(uint64_t tileIndex) const noexcept {
+    return reinterpret_cast<StoredSample*>(mapping + samplesOffset) + tileIndex * samplesPerTile;
+}
+
+uint64_t SampleStore::tileSampleCount() const noexcept {
+    return samplesPerTile;
+}
+
+DistanceSample *SampleStore::distances(uint64_t tileIndex) const noexcept {
+    if (distancesOffset == 0) return nullptr;
+    return reinterpret_cast<DistanceSample*>(mapping + distancesOffset) + tileIndex * samplesPerTile;
+}
+
+uint64_t &SampleStore::record(uint64_t tileIndex) const noexcept {
+    return reinterpret_cast<uint64_t*>(mapping + recordsOffset)[tileIndex];
+}
+
+bool SampleStore::tileCompleted(uint64_t tileIndex) const noexcept {
+    return (tileFlags(tileIndex) & TileCompleted) && tileBudget(tileIndex) == mConfig.maxIterations;
+}
+
+bool SampleStore::tileEscalatable(uint64_t tileIndex) const noexcept {
+    const int64_t budget = tileBudget(tileIndex);
+    return mConfig.escalates() && (tileFlags(tileIndex) & TileCompleted) && budget > 0 && budget < mConfig.maxIterations;
+}
+
+uint64_t SampleStore::tileFlags(uint64_t tileIndex) const noexcept {
+    return std::atomic_ref<uint64_t>(record(tileIndex)).load(std::memory_order_acquire) & recordFlagsMask;
+}
+
+int64_t SampleStore::tileBudget(uint64_t tileIndex) const noexcept {
+    return static_cast<int64_t>(std::atomic_ref<uint64_t>(record(tileIndex)).load(std::memory_order_acquire) >> recordBudgetShift);
+}
+
+void SampleStore::completeTile(uint64_t tileIndex, uint64_t flags) {
+    flush(samplesOffset + tileIndex * samplesPerTile * sizeof(StoredSample), samplesPerTile * sizeof(StoredSample));
+    if (distancesOffset != 0) flush(distancesOffset + tileIndex * samplesPerTile * sizeof(DistanceSample), samplesPerTile * sizeof(DistanceSample));
+
+    // The list collected while computing the tile becomes its current one, flags and budget change together in a single write
+    const uint64_t previous = std::atomic_ref<uint64_t>(record(tileIndex)).load(std::memory_order_acquire);
+    uint64_t listFlag = previous & TileUnresolvedSecond;
+    if (mConfig.escalates()) {
+        const uint64_t offset = unresolvedOffset(tileIndex, true);
+        const uint64_t count = std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(mapping + offset)).load(std::memory_order_acquire);
+        flush(offset, sizeof(uint64_t) + count * sizeof(EscapeState));
+        listFlag ^= TileUnresolvedSecond;
+    }
+    const uint64_t completed = (static_cast<uint64_t>(mConfig.maxIterations) << recordBudgetShift) | TileCompleted | listFlag | (flags & ~TileUnresolvedSecond);
+    std::atomic_ref<uint64_t>(record(tileIndex)).store(completed, std::memory_order_release);
+    flush(recordsOffset + tileIndex * sizeof(uint64_t), sizeof(uint64_t));
+}
+
+uint64_t SampleStore::unresolvedOffset(uint64_t tileIndex, bool other) const noexcept {
+    const bool second = ((tileFlags(tileIndex) & TileUnresolvedSecond) != 0) != other;
+    return unresolvedRegionOffset + (2 * tileIndex + (second ? 1 : 0)) * unresolvedListSize;
+}
+
+const EscapeState *SampleStore::unresolved(uint64_t tileIndex, uint64_t &count) const noexcept {
+    if (!mConfig.escalates() || !(tileFlags(tileIndex) & TileCompleted)) {
+        count = 0;
+        return nullptr;
+    }
+    const uint64_t offset = unresolvedOffset(tileIndex, false);
+    count = *reinterpret_cast<const uint64_t*>(mapping + offset);
+    return reinterpret_cast<const EscapeState*>(mapping + offset + sizeof(uint64_t));
+}
+
+void SampleStore::clearUnresolved(uint64_t tileIndex) noexcept {
+    if (!mConfig.escalates()) return;
+    std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(mapping + unresolvedOffset(tileIndex, true))).store(0, std::memory_order_release);
+}
+
+void SampleStore::addUnresolved(uint64_t tileIndex, const EscapeState *states, uint64_t count) noexcept {
+    if (!mConfig.escalates() || count == 0) return;
+    const uint64_t offset = unresolvedOffset(tileIndex, true);
+    const uint64_t first = std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(mapping + offset)).fetch_add(count, std::memory_order_acq_rel);
+    memcpy(mapping + offset + sizeof(uint64_t) + first * sizeof(EscapeState), states, count * sizeof(EscapeState));
+}
+
+std::vector<int64_t> SampleStore::budgetHistory() const {
+    const uint64_t count = *reinterpret_cast<const uint64_t*>(mapping + budgetCountOffset);
+    const int64_t *budgets = reinterpret_cast<const int64_t*>(mapping + budgetHistoryOffset);
+    return std::vector<int64_t>(budgets, budgets + count);
+}
+
+void SampleStore::flush(uint64_t offset, uint64_t size) {
+    if (size == 0 || filepath.empty()) return;
+#if defined(_WIN32)
+    if (!FlushViewOfFile(mapping + offset, size) || !FlushFileBuffers(fileHandle)) throw std::system_error(GetLastError(), std::system_category(), filepath.string());
+#else
+    // msync needs a page aligned start address
+    static const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    const uint64_t start = offset / pageSize * pageSize;
+    if (msync(mapping + start, offset + size - start, MS_SYNC) != 0) throw std::system_error(errno, std::generic_category(), filepath.string());
+#endif
+}
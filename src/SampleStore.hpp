@@ -0,0 +1,129 @@
+#ifndef SAMPLESTORE_HPP_INCLUDED
+#define SAMPLESTORE_HPP_INCLUDED
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "Mandelbrotset.hpp"
+
+/*
+Sample store specification:
+    Filename has to end in ".mss" which stands for Mandelbrotset Sample Store.
+    The file is memory mapped and written in place by tileGenerator, all values are in native byte order unlike the configuration files.
+    Byte layout:
+        Magic numbers:
+        byte[0, 1]                           = 'S' (0x53), 'S' (0x53) (char, char)
+        byte[2]                              = layout version = 1                (uint8_t) Note: 0 for stores whose tiles were sized by rounding down
+        byte[3, ..., 7]                      = unused, zero
+
+        Configurations the samples were computed with, the store is discarded when they don't match the loaded ones:
+        byte[8, ..., 143]                    = MandelbrotsetConfiguration, as laid out in memory
+        byte[144, ..., 191]                  = TileConfiguration, as laid out in memory
+        With EscalationRender the MandelbrotsetConfiguration is the one of the last run, stores of runs differing only in maxIterations are reused.
+
+        Iteration budget history:
+        byte[192, ..., 199]                  = budgetCount                       (uint64_t) Note: at most 256, older budgets are dropped
+        byte[200, ..., 199 + 8 * budgetCount] = budgetHistory                    (int64_t[]) Note: maxIterations of every run that opened the store, oldest first,
+                                                                                     runs with the same maxIterations as the previous one aren't repeated
+
+        Tile records, starting at byte 4096:
+        byte[4096 + 8 * i, ..., 4103 + 8 * i] = record of tile i                 (uint64_t) Note: bit 0 is set once the tile's samples are complete and on disk,
+                                                                                     bit 1 if they were iterated in single precision,
+                                                                                     bit 2 if its unresolved pixels are in its second list,
+                                                                                     bits 8 to 63 hold the maxIterations the tile is complete for
+
+        Samples, starting at the first multiple of 4096 after the tile records:
+        Tile after tile in tile index order, each tile holds tileWidth * tileHeight StoredSamples row by row.
+        Tiles at the image's right and bottom edges only fill their part within the image (see TileConfiguration::tileWidthAt), the rest stays zero
+        byte[0, ..., 7]                      = iterations                        (int64_t)
+        byte[8, ..., 15]                     = finalMagnitude2                   (double)
+
+        Unresolved pixels, only with EscalationRender, starting at the first multiple of 4096 after the samples:
+        Two lists per tile in tile index order, each 8 + tileWidth * tileHeight * 48 bytes. A tile's current list is picked by bit 2 of its record,
+        the other one is filled while the tile is computed and becomes current when it completes, so an interrupted escalation restarts from intact states
+        byte[0, ..., 7]                      = count                             (uint64_t)
+        byte[8, ..., 8 + count * 48 - 1]     = EscapeStates                      (uint64_t x, y, double zReal, zImag, oReal, oImag)
+
+        Distances, only with DistanceRender (which excludes the unresolved pixels), starting at the first multiple of 4096 after the samples:
+        Tile after tile like the samples, each tile holds tileWidth * tileHeight DistanceSamples row by row
+        byte[0, ..., 7]                      = distance                          (double)
+        byte[8, ..., 15]                     = normalAngle                       (double)
+*/
+
+// Bits of a tile record
+enum TileRecordFlag : uint64_t {
+    TileCompleted = 1ULL << 0,
+    TileSinglePrecision = 1ULL << 1,
+    TileUnresolvedSecond = 1ULL << 2
+};
+
+// Memory mapped ".mss" file holding the samples of every tile of the current mConfig and tConfig.
+// A run that gets killed keeps every tile it completed, a resumed run only has to compute the rest and recoloring needs no iterating at all.
+// With EscalationRender the store also keeps every pixel that ran out of iterations, a run with a larger maxIterations continues only those.
+// With DistanceRender it keeps every pixel's DistanceSample as well.
+class SampleStore {
+   public:
+    // Opens or creates the store at path, it is reset if it was made for different configurations. Records mConfig.maxIterations in the budget history.
+    // An empty path keeps the samples in anonymous memory only, for renders that never resume such as the frames of renderSequence
+    explicit SampleStore(const std::filesystem::path &path);
+    SampleStore(const SampleStore &) = delete;
+    SampleStore &operator=(const SampleStore &) = delete;
+    ~SampleStore();
+
+    // Samples of the tile with index tileIndex, tileWidth * tileHeight of them row by row
+    StoredSample *tile(uint64_t tileIndex) const noexcept;
+    // Number of samples in one tile
+    uint64_t tileSampleCount() const noexcept;
+    // Distances of the tile with index tileIndex laid out like its samples, nullptr without DistanceRender
+    DistanceSample *distances(uint64_t tileIndex) const noexcept;
+
+    // Whether the tile's samples are complete for mConfig.maxIterations, i.e. completeTile was called for it in this or an earlier run
+    bool tileCompleted(uint64_t tileIndex) const noexcept;
+    // Whether the tile was completed with a smaller maxIterations whose unresolved pixels can be continued, see EscalationRender
+    bool tileEscalatable(uint64_t tileIndex) const noexcept;
+    // TileRecordFlag bits of the tile
+    uint64_t tileFlags(uint64_t tileIndex) const noexcept;
+    // maxIterations the tile was last completed with, 0 if it never was
+    int64_t tileBudget(uint64_t tileIndex) const noexcept;
+    // Flushes the tile's samples, distances and unresolved pixels to disk, then sets and flushes its record to flags and mConfig.maxIterations,
+    // so a crash never leaves a completed tile with missing samples
+    void completeTile(uint64_t tileIndex, uint64_t flags);
+
+    // Unresolved pixels of the tile as of its last completion, count of them
+    const EscapeState *unresolved(uint64_t tileIndex, uint64_t &count) const noexcept;
+    // Empties the list the tile's unresolved pixels are collected in while it is computed
+    void clearUnresolved(uint64_t tileIndex) noexcept;
+    // Appends count unresolved pixels of the tile being computed, thread tiles of the same tile can add concurrently
+    void addUnresolved(uint64_t tileIndex, const EscapeState *states, uint64_t count) noexcept;
+
+    // maxIterations of the runs that opened the store, oldest first
+    std::vector<int64_t> budgetHistory() const;
+
+   private:
+    // Synchronously writes the mapped bytes [offset, offset + size) back to the file
+    void flush(uint64_t offset, uint64_t size);
+    // Byte offset of the tile's current list of unresolved pixels, or of the other one it is collecting the next list in
+    uint64_t unresolvedOffset(uint64_t tileIndex, bool other) const noexcept;
+    uint64_t &record(uint64_t tileIndex) const noexcept;
+
+    std::filesystem::path filepath;
+    unsigned char *mapping;
+    uint64_t mappingSize;
+    uint64_t tileCount;
+    uint64_t samplesPerTile;
+    uint64_t recordsOffset;
+    uint64_t samplesOffset;
+    // Start and size of one list of the unresolved pixels region, size 0 without EscalationRender
+    uint64_t unresolvedRegionOffset;
+    uint64_t unresolvedListSize;
+    // Start of the distances region, 0 without DistanceRender
+    uint64_t distancesOffset;
+#if defined(_WIN32)
+    void *fileHandle;
+    void *mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
+
+#endif  // SAMPLESTORE_HPP_INCLUDED
@@ -1,9 +1,20 @@
 #include "Saves.hpp"
 
 #include <string.h>
+#include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "RenderState.hpp"
 
 // Returns the absolute range of real part of values within this image
 double MandelbrotsetConfiguration::realRange() const noexcept {
@@ -15,19 +26,74 @@ double MandelbrotsetConfiguration::imagRange() const noexcept {
     return abs(endImag - startImag);
 }
 
-// Returns the width of a tile in pixels
+// Returns the distance between horizontally neighbouring pixels, taking the deep zoom magnification into account
+double MandelbrotsetConfiguration::pixelStepReal(uint64_t imageWidth) const noexcept {
+    const double step = (endReal - startReal) / (imageWidth - 1);
+    return (renderFlags & DeepZoomRender) ? step / zoom : step;
+}
+
+// Returns the distance between vertically neighbouring pixels, taking the deep zoom magnification into account
+double MandelbrotsetConfiguration::pixelStepImag(uint64_t imageHeight) const noexcept {
+    const double step = (endImag - startImag) / (imageHeight - 1);
+    return (renderFlags & DeepZoomRender) ? step / zoom : step;
+}
+
+bool MandelbrotsetConfiguration::escalates() const noexcept {
+    return (renderFlags & EscalationRender) && !(renderFlags & (DeepZoomRender | DistanceRender));
+}
+
+uint64_t MandelbrotsetConfiguration::formulaPower() const noexcept {
+    switch (formula) {
+        case CubicMultibrotFormula:   return 3;
+        case QuarticMultibrotFormula: return 4;
+        default:                      return 2;
+    }
+}
+
+// Returns the width of a tile in pixels, rounded up so the tiles cover every column
 uint64_t TileConfiguration::tileWidth() const noexcept {
-    return imageWidth / tileGridWidth;
+    return (imageWidth + tileGridWidth - 1) / tileGridWidth;
 }
 
-// Returns the height of a tile in pixels
+// Returns the height of a tile in pixels, rounded up so the tiles cover every row
 uint64_t TileConfiguration::tileHeight() const noexcept {
-    return imageHeight / tileGridHeight;
+    return (imageHeight + tileGridHeight - 1) / tileGridHeight;
 }
 
-// Returns the width of a thread tile in pixels
+// Returns the width of a thread tile in pixels, rounded up and at least a vector of pixels wide unless the tile is narrower
 uint64_t TileConfiguration::threadWidth() const noexcept {
-    return tileWidth() / threadGridWidth;
+    return std::max((tileWidth() + threadGridWidth - 1) / threadGridWidth, std::min(tileWidth(), threadVectorWidth));
+}
+
+// Returns the height of a thread tile in pixels, rounded up so the thread tiles cover every row of a tile
+uint64_t TileConfiguration::threadHeight() const noexcept {
+    return (tileHeight() + threadGridHeight - 1) / threadGridHeight;
+}
+
+// Returns the width of the tiles in column tileX within the image, the last column of tiles is cut off at the image's edge
+uint64_t TileConfiguration::tileWidthAt(const uint64_t tileX) const noexcept {
+    const uint64_t offset = tileWidth() * tileX;
+    return offset < imageWidth ? std::min(tileWidth(), imageWidth - offset) : 0;
+}
+
+// Returns the height of the tiles in row tileY within the image, the last row of tiles is cut off at the image's edge
+uint64_t TileConfiguration::tileHeightAt(const uint64_t tileY) const noexcept {
+    const uint64_t offset = tileHeight() * tileY;
+    return offset < imageHeight ? std::min(tileHeight(), imageHeight - offset) : 0;
+}
+
+// Returns the width of the thread tiles in column threadX of the tiles in column tileX, cut off at the tile's edge
+uint64_t TileConfiguration::threadWidthAt(const uint64_t tileX, const uint64_t threadX) const noexcept {
+    const uint64_t offset = threadWidth() * threadX;
+    const uint64_t width = tileWidthAt(tileX);
+    return offset < width ? std::min(threadWidth(), width - offset) : 0;
+}
+
+// Returns the height of the thread tiles in row threadY of the tiles in row tileY, cut off at the tile's edge
+uint64_t TileConfiguration::threadHeightAt(const uint64_t tileY, const uint64_t threadY) const noexcept {
+    const uint64_t offset = threadHeight() * threadY;
+    const uint64_t height = tileHeightAt(tileY);
+    return offset < height ? std::min(threadHeight(), height - offset) : 0;
 }
 
 // Index of a tile within an image from tileX and tileY
@@ -40,160 +106,430 @@ uint64_t TileConfiguration::threadIndex(const uint64_t threadX, const uint64_t t
     return threadY * threadGridWidth + threadX;
 }
 
-// Returns the height of a thread tile in pixels
-uint64_t TileConfiguration::threadHeight() const noexcept {
-    return tileHeight() / threadGridHeight;
+bool validConfiguration(const MandelbrotsetConfiguration &configuration) noexcept {
+    return configuration.formula < formulaCount && configuration.maxIterations >= 1;
+}
+
+bool validConfiguration(const TileConfiguration &configuration) noexcept {
+    return configuration.imageWidth >= 1 && configuration.imageHeight >= 1 &&
+           configuration.tileGridWidth >= 1 && configuration.tileGridWidth <= configuration.imageWidth &&
+           configuration.tileGridHeight >= 1 && configuration.tileGridHeight <= configuration.imageHeight &&
+           configuration.threadGridWidth >= 1 && configuration.threadGridWidth <= configuration.imageWidth &&
+           configuration.threadGridHeight >= 1 && configuration.threadGridHeight <= configuration.imageHeight;
 }
 
 ProgressConfiguration::~ProgressConfiguration() {
     delete[] tileCompletion;
     delete[] threadCompletion;
+    delete[] tileBudgets;
 }
 
-extern MandelbrotsetConfiguration mConfig;
-extern TileConfiguration tConfig;
-extern ProgressConfiguration pConfig;
-extern std::filesystem::path savePath;
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+extern thread_local std::filesystem::path &savePath;
 
-// Returns the type inferred from filepath's first two bytes. Can return Null. (ConfigurationType)
-inline ConfigurationType getConfigurationType(std::filesystem::path filepath) {
-    if (!std::filesystem::exists(filepath)) return Null;
-    std::ifstream configurationFile(filepath, std::ios::binary);
-    if (!configurationFile) throw std::system_error(errno, std::generic_category(), filepath.string());
+// Version written to and accepted from the container of every configuration file
+static constexpr uint16_t saveFormatVersion = 2;
+// Magic numbers, version and headerLength
+static constexpr uint64_t containerHeaderSize = 8;
+static constexpr uint64_t checksumSize = 4;
+// tileIndex, budget and checksum of a journal record
+static constexpr uint64_t journalRecordSize = 20;
 
-    // Infer current file configuration type from first two bytes
-    char buffer[3];
-    if (configurationFile.read(buffer, 2).gcount() != 2) return Null;
-    configurationFile.close();
-    if (strncmp(buffer, "MC", 2) == 0) {
-        return Mandelbrotset;
-    } else if (strncmp(buffer, "TC", 2) == 0 ) {
-        return Tile;
-    } else if (strncmp(buffer, "PC", 2) == 0) {
-        return Progress;
-    } else {
-        return Null;
+// Appends value to out as size little-endian bytes
+static void putLittleEndian(std::vector<unsigned char> &out, uint64_t value, uint64_t size) {
+    for (uint64_t i = 0; i < size; i++) out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+static uint64_t getLittleEndian(const unsigned char *in, uint64_t size) noexcept {
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < size; i++) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+static void putDouble(std::vector<unsigned char> &out, double value) {
+    putLittleEndian(out, std::bit_cast<uint64_t>(value), 8);
+}
+
+// Reads the little-endian fields of a configuration file in order, reading past the end fails the reader instead of the read
+class FieldReader {
+   public:
+    FieldReader(const unsigned char *fieldData, uint64_t fieldSize) : data(fieldData), size(fieldSize), position(0), failed(false) {}
+
+    uint64_t u64() noexcept {
+        const unsigned char *field = bytes(8);
+        return field != nullptr ? getLittleEndian(field, 8) : 0;
+    }
+    int64_t i64() noexcept { return static_cast<int64_t>(u64()); }
+    double f64() noexcept { return std::bit_cast<double>(u64()); }
+    // Next count bytes, nullptr if there aren't that many left
+    const unsigned char *bytes(uint64_t count) noexcept {
+        if (failed || count > size - position) {
+            failed = true;
+            return nullptr;
+        }
+        position += count;
+        return data + position - count;
+    }
+    bool ok() const noexcept { return !failed; }
+    // Whether every field has been read
+    bool atEnd() const noexcept { return position == size; }
+
+   private:
+    const unsigned char *data;
+    uint64_t size;
+    uint64_t position;
+    bool failed;
+};
+
+// Magic numbers of type's files, nullptr for Null
+static const char *configurationMagic(ConfigurationType type) noexcept {
+    switch (type) {
+        case Mandelbrotset: return "MC";
+        case Tile:          return "TC";
+        case Progress:      return "PC";
+        case Null:          return nullptr;
     }
+    return nullptr;
 }
 
-// Returns whether or not filepath is a valid configuration based on type.
-// It is okay if the file is bigger than needed, extra bytes are ignored.
-bool detectConfiguration(std::filesystem::path filepath, ConfigurationType type) {
-    if (!std::filesystem::exists(filepath)) return false;
-    std::ifstream configurationFile(filepath, std::ios::binary);
+// Whole contents of filepath in one read
+static std::vector<unsigned char> readConfigurationFile(const std::filesystem::path &filepath) {
+    std::ifstream configurationFile(filepath, std::ios::binary | std::ios::ate);
     if (!configurationFile) throw std::system_error(errno, std::generic_category(), filepath.string());
+    std::vector<unsigned char> contents(static_cast<uint64_t>(configurationFile.tellg()));
+    configurationFile.seekg(0);
+    if (!configurationFile.read(reinterpret_cast<char*>(contents.data()), contents.size())) throw std::system_error(errno, std::generic_category(), filepath.string());
+    return contents;
+}
 
-    char configurationHeader[3];
-    switch (type) {
-        case Mandelbrotset: {strncpy(configurationHeader, "MC", 3);} break;
-        case Tile:          {strncpy(configurationHeader, "TC", 3);} break;
-        case Progress:      {strncpy(configurationHeader, "PC", 3);} break;
-        case Null: {return false;}
+// Checks the container of a file with magic numbers magic, i.e. its magic numbers, version and checksum, and finds its fields and what follows them
+static bool openContainer(const std::vector<unsigned char> &contents, const char *magic, uint64_t &fieldsSize, uint64_t &trailerOffset) noexcept {
+    if (magic == nullptr || contents.size() < containerHeaderSize + checksumSize || memcmp(contents.data(), magic, 2) != 0) return false;
+    if (getLittleEndian(contents.data() + 2, 2) != saveFormatVersion) return false;
+    fieldsSize = getLittleEndian(contents.data() + 4, 4);
+    if (fieldsSize > contents.size() - containerHeaderSize - checksumSize) return false;
+    const uint64_t checksumOffset = containerHeaderSize + fieldsSize;
+    if (getLittleEndian(contents.data() + checksumOffset, 4) != crc32(0, contents.data(), checksumOffset)) return false;
+    trailerOffset = checksumOffset + checksumSize;
+    return true;
+}
+
+void putConfigurationFields(std::vector<unsigned char> &out, const MandelbrotsetConfiguration &configuration) {
+    for (const double value : {configuration.startReal, configuration.endReal, configuration.startImag, configuration.endImag}) putDouble(out, value);
+    putLittleEndian(out, static_cast<uint64_t>(configuration.maxIterations), 8);
+    putDouble(out, configuration.bailoutRadius);
+    putDouble(out, configuration.periodicityPrecision2);
+    putLittleEndian(out, configuration.periodicitySavePeriod, 8);
+    putLittleEndian(out, configuration.renderFlags, 8);
+    for (const double value : {configuration.centerRealHi, configuration.centerRealLo, configuration.centerImagHi, configuration.centerImagLo, configuration.zoom}) {
+        putDouble(out, value);
     }
-    char headerData[3];
-    if (configurationFile.read(headerData, 2).gcount() != 2) return false;
-    if (strncmp(configurationHeader, headerData, 2) != 0) {return false;}
+    putLittleEndian(out, configuration.formula, 8);
+    putDouble(out, configuration.juliaReal);
+    putDouble(out, configuration.juliaImag);
+}
+
+void putConfigurationFields(std::vector<unsigned char> &out, const TileConfiguration &configuration) {
+    for (const uint64_t value : {configuration.imageWidth, configuration.imageHeight, configuration.tileGridWidth, configuration.tileGridHeight,
+                                 configuration.threadGridWidth, configuration.threadGridHeight}) {
+        putLittleEndian(out, value, 8);
+    }
+}
+
+bool readConfigurationFields(const unsigned char *fields, MandelbrotsetConfiguration &configuration) {
+    FieldReader reader(fields, mandelbrotsetFieldsSize);
+    const MandelbrotsetConfiguration read = {
+        .startReal = reader.f64(),
+        .endReal = reader.f64(),
+        .startImag = reader.f64(),
+        .endImag = reader.f64(),
+
+        .maxIterations = reader.i64(),
+        .bailoutRadius = reader.f64(),
+        .periodicityPrecision2 = reader.f64(),
+        .periodicitySavePeriod = reader.u64(),
+
+        .renderFlags = reader.u64(),
+        .centerRealHi = reader.f64(),
+        .centerRealLo = reader.f64(),
+        .centerImagHi = reader.f64(),
+        .centerImagLo = reader.f64(),
+        .zoom = reader.f64(),
+
+        .formula = reader.u64(),
+        .juliaReal = reader.f64(),
+        .juliaImag = reader.f64()
+    };
+    if (!reader.ok() || !reader.atEnd() || !validConfiguration(read)) return false;
+    configuration = read;
+    return true;
+}
+
+bool readConfigurationFields(const unsigned char *fields, TileConfiguration &configuration) {
+    FieldReader reader(fields, tileFieldsSize);
+    const TileConfiguration read = {
+        .imageWidth = reader.u64(),
+        .imageHeight = reader.u64(),
+
+        .tileGridWidth = reader.u64(),
+        .tileGridHeight = reader.u64(),
+
+        .threadGridWidth = reader.u64(),
+        .threadGridHeight = reader.u64()
+    };
+    if (!reader.ok() || !reader.atEnd() || !validConfiguration(read)) return false;
+    configuration = read;
+    return true;
+}
+
+// Reads the configuration of a type file from its contents, and with apply replaces the corresponding global with it.
+// Nothing is replaced unless the whole file is valid. Fields past the known ones are ignored, a torn last journal record is dropped
+static bool readConfiguration(const std::vector<unsigned char> &contents, ConfigurationType type, bool apply) {
+    uint64_t fieldsSize = 0, trailerOffset = 0;
+    if (!openContainer(contents, configurationMagic(type), fieldsSize, trailerOffset)) return false;
+    FieldReader fields(contents.data() + containerHeaderSize, fieldsSize);
 
     switch (type) {
         case Mandelbrotset: {
-            constexpr size_t objectSize = sizeof(MandelbrotsetConfiguration);
-            char objectData[objectSize];
-            if (configurationFile.read(objectData, objectSize).gcount() != objectSize) return false;
+            // The formula fields follow the budget history, a second reader skips ahead to them so the configuration is still read in one go
+            FieldReader formulaFields = fields;
+            formulaFields.bytes(14 * 8);
+            const uint64_t historyCount = formulaFields.u64();
+            formulaFields.bytes(historyCount <= fieldsSize / 8 ? historyCount * 8 : fieldsSize + 1);
+            // Files from before formulas existed end with the history
+            const bool hasFormula = formulaFields.ok() && !formulaFields.atEnd();
+            const MandelbrotsetConfiguration configuration = {
+                .startReal = fields.f64(),
+                .endReal = fields.f64(),
+                .startImag = fields.f64(),
+                .endImag = fields.f64(),
+
+                .maxIterations = fields.i64(),
+                .bailoutRadius = fields.f64(),
+                .periodicityPrecision2 = fields.f64(),
+                .periodicitySavePeriod = fields.u64(),
+
+                .renderFlags = fields.u64(),
+                .centerRealHi = fields.f64(),
+                .centerRealLo = fields.f64(),
+                .centerImagHi = fields.f64(),
+                .centerImagLo = fields.f64(),
+                .zoom = fields.f64(),
+
+                .formula = hasFormula ? formulaFields.u64() : MandelbrotFormula,
+                .juliaReal = hasFormula ? formulaFields.f64() : 0.0,
+                .juliaImag = hasFormula ? formulaFields.f64() : 0.0
+            };
+            const uint64_t budgetCount = fields.u64();
+            const unsigned char *budgets = fields.bytes(budgetCount <= fieldsSize / 8 ? budgetCount * 8 : fieldsSize + 1);
+            if (!fields.ok() || !formulaFields.ok() || !validConfiguration(configuration)) return false;
+            if (apply) {
+                mConfig = configuration;
+                budgetHistory.resize(budgetCount);
+                for (uint64_t i = 0; i < budgetCount; i++) budgetHistory[i] = static_cast<int64_t>(getLittleEndian(budgets + 8 * i, 8));
+            }
             return true;
         }
         case Tile: {
-            constexpr size_t objectSize = sizeof(TileConfiguration);
-            char objectData[objectSize];
-            if (configurationFile.read(objectData, objectSize).gcount() != objectSize) return false;
+            // The file's fields are the ones putConfigurationFields writes
+            TileConfiguration configuration = {};
+            if (fieldsSize < tileFieldsSize || !readConfigurationFields(contents.data() + containerHeaderSize, configuration)) return false;
+            if (apply) tConfig = configuration;
             return true;
         }
         case Progress: {
-            // Skip first few variables
-            configurationFile.seekg(sizeof(ProgressConfiguration) - (sizeof(uint64_t) * 2 + sizeof(size_t) * 2), std::ios_base::cur);
-            uint64_t tileCount;
-            configurationFile.read(reinterpret_cast<char*>(&tileCount), sizeof(tileCount));
-            uint64_t threadCount;
-            configurationFile.read(reinterpret_cast<char*>(&threadCount), sizeof(threadCount));
-
-            configurationFile.seekg((tileCount + 7) / 8, std::ios_base::cur);
-            configurationFile.peek();
-            if (!configurationFile) return false; // Check whether character at current position is available, i.e. the file is at least current position bytes big
-            configurationFile.seekg((threadCount + 7) / 8, std::ios_base::cur);
-            configurationFile.peek();
-            if (!configurationFile) return false; // Ditto
+            const uint64_t threadsUsed = fields.u64();
+            const uint64_t currentTile = fields.u64();
+            const uint64_t tileCount = fields.u64();
+            const uint64_t threadCount = fields.u64();
+            if (!fields.ok() || threadsUsed == 0 || tileCount > fieldsSize || threadCount > 8 * fieldsSize) return false;
+            const unsigned char *tileCompletion = fields.bytes((tileCount + 7) / 8);
+            const unsigned char *threadCompletion = fields.bytes((threadCount + 7) / 8);
+            const unsigned char *tileBudgets = fields.bytes(tileCount * 8);
+            if (!fields.ok()) return false;
+            if (!apply) return true;
+
+            resetProgressConfiguration(tileCount, threadCount);
+            pConfig.threadsUsed = threadsUsed;
+            pConfig.currentTile = currentTile;
+            memcpy(pConfig.tileCompletion, tileCompletion, (tileCount + 7) / 8);
+            memcpy(pConfig.threadCompletion, threadCompletion, (threadCount + 7) / 8);
+            for (uint64_t i = 0; i < tileCount; i++) pConfig.tileBudgets[i] = static_cast<int64_t>(getLittleEndian(tileBudgets + 8 * i, 8));
+
+            // Replay the tile completions journaled since the snapshot, up to the first record that didn't make it to disk whole
+            for (uint64_t offset = trailerOffset; offset + journalRecordSize <= contents.size(); offset += journalRecordSize) {
+                const unsigned char *record = contents.data() + offset;
+                if (getLittleEndian(record + 16, 4) != crc32(0, record, 16)) break;
+                const uint64_t tileIndex = getLittleEndian(record, 8);
+                if (tileIndex >= tileCount) break;
+                pConfig.tileCompletion[tileIndex / 8] |= static_cast<unsigned char>(1 << (tileIndex % 8));
+                pConfig.tileBudgets[tileIndex] = static_cast<int64_t>(getLittleEndian(record + 8, 8));
+            }
             return true;
         }
         case Null:
             return false;
     }
+    return false;
 }
 
-// Loads filepath into the corresponding configuration variable based on type.
-// There is no checking whether the variables are clean or not or even if the type is correct, just direct memory access. (DANGEROUS)
-// The savefiles are not portable because savefiles from different systems might have different endianness.
-void loadConfiguration(std::filesystem::path filepath, ConfigurationType type) {
-    std::ifstream configurationFile(filepath, std::ios::binary);
-    if (!configurationFile) throw std::system_error(errno, std::generic_category(), filepath.string());
-
-    configurationFile.seekg(2, std::ios_base::cur);  // Skip 2 byte header.
+// Fields of the current type configuration, see the specification in Saves.hpp
+static std::vector<unsigned char> configurationFields(ConfigurationType type) {
+    std::vector<unsigned char> fields;
     switch (type) {
-        case Mandelbrotset: {
-            configurationFile.read(reinterpret_cast<char*>(&mConfig), sizeof(MandelbrotsetConfiguration));
-            return;
-        }
-        case Tile: {
-            configurationFile.read(reinterpret_cast<char*>(&tConfig), sizeof(TileConfiguration));
-            return;
-        }
-        case Progress: {
-            // Read the first three uint64_t's to get array sizes for the next two variables
-            configurationFile.read(reinterpret_cast<char*>(&pConfig), sizeof(ProgressConfiguration) - sizeof(size_t) * 2);
-
-            delete[] pConfig.tileCompletion;
-            char *buffer = new char[(pConfig.tileCount + 7) / 8]; // practically the same as std::ceil((float)pConfig.tileCount / 8)
-            configurationFile.read(buffer, (pConfig.tileCount + 7) / 8);
-            pConfig.tileCompletion = reinterpret_cast<unsigned char*>(buffer);
-
-            delete[] pConfig.threadCompletion;
-            buffer = new char[(pConfig.threadCount + 7) / 8]; // practically the same as std::ceil((float)pConfig.threadCount / 8)
-            configurationFile.read(buffer, (pConfig.threadCount + 7) / 8);
-            pConfig.threadCompletion = reinterpret_cast<unsigned char*>(buffer);
-            return;
-        }
+        case Mandelbrotset:
+            for (const double value : {mConfig.startReal, mConfig.endReal, mConfig.startImag, mConfig.endImag}) putDouble(fields, value);
+            putLittleEndian(fields, static_cast<uint64_t>(mConfig.maxIterations), 8);
+            putDouble(fields, mConfig.bailoutRadius);
+            putDouble(fields, mConfig.periodicityPrecision2);
+            putLittleEndian(fields, mConfig.periodicitySavePeriod, 8);
+            putLittleEndian(fields, mConfig.renderFlags, 8);
+            for (const double value : {mConfig.centerRealHi, mConfig.centerRealLo, mConfig.centerImagHi, mConfig.centerImagLo, mConfig.zoom}) putDouble(fields, value);
+            putLittleEndian(fields, budgetHistory.size(), 8);
+            for (const int64_t budget : budgetHistory) putLittleEndian(fields, static_cast<uint64_t>(budget), 8);
+            putLittleEndian(fields, mConfig.formula, 8);
+            putDouble(fields, mConfig.juliaReal);
+            putDouble(fields, mConfig.juliaImag);
+            break;
+        case Tile:
+            putConfigurationFields(fields, tConfig);
+            break;
+        case Progress:
+            for (const uint64_t value : {pConfig.threadsUsed, pConfig.currentTile, pConfig.tileCount, pConfig.threadCount}) putLittleEndian(fields, value, 8);
+            fields.insert(fields.end(), pConfig.tileCompletion, pConfig.tileCompletion + (pConfig.tileCount + 7) / 8);
+            fields.insert(fields.end(), pConfig.threadCompletion, pConfig.threadCompletion + (pConfig.threadCount + 7) / 8);
+            for (uint64_t i = 0; i < pConfig.tileCount; i++) putLittleEndian(fields, static_cast<uint64_t>(pConfig.tileBudgets[i]), 8);
+            break;
         case Null:
             break;
     }
+    return fields;
+}
+
+void resetProgressConfiguration(uint64_t tileCount, uint64_t threadCount) {
+    const uint64_t threadsUsed = pConfig.threadsUsed;
+    std::destroy_at(&pConfig);
+    std::construct_at(&pConfig, threadsUsed, 0ULL, tileCount, threadCount, new unsigned char[(tileCount + 7) / 8]{0}, new unsigned char[(threadCount + 7) / 8]{0},
+                      new int64_t[tileCount]{0});
+}
+
+ConfigurationType getConfigurationType(std::filesystem::path filepath) {
+    if (!std::filesystem::exists(filepath)) return Null;
+    std::ifstream configurationFile(filepath, std::ios::binary);
+    if (!configurationFile) throw std::system_error(errno, std::generic_category(), filepath.string());
+
+    // Infer current file configuration type from first two bytes
+    char buffer[2];
+    if (configurationFile.read(buffer, 2).gcount() != 2) return Null;
+    for (const ConfigurationType type : {Mandelbrotset, Tile, Progress}) {
+        if (strncmp(buffer, configurationMagic(type), 2) == 0) return type;
+    }
+    return Null;
+}
+
+bool detectConfiguration(std::filesystem::path filepath, ConfigurationType type) {
+    if (type == Null || !std::filesystem::exists(filepath)) return false;
+    return readConfiguration(readConfigurationFile(filepath), type, false);
+}
+
+void loadConfiguration(std::filesystem::path filepath, ConfigurationType type) {
+    if (!readConfiguration(readConfigurationFile(filepath), type, true)) throw std::invalid_argument("not a valid configuration file of its type: " + filepath.string());
 }
 
-// Infers and loads the configuration file type and data respectively.
-// Calls getConfiguration, detectConfiguration and loadConfiguration sequentially.
-// Inherits properties from said functions, both good and bad.
 void detectLoadConfiguration(std::filesystem::path filepath) {
-    ConfigurationType type = getConfigurationType(filepath);
-    if (detectConfiguration(filepath, type)) loadConfiguration(filepath, type);
+    if (!std::filesystem::exists(filepath)) return;
+    const std::vector<unsigned char> contents = readConfigurationFile(filepath);
+    for (const ConfigurationType type : {Mandelbrotset, Tile, Progress}) {
+        if (contents.size() >= 2 && memcmp(contents.data(), configurationMagic(type), 2) == 0) readConfiguration(contents, type, true);
+    }
+}
+
+// Container with magic numbers magic around fields, see the specification in Saves.hpp
+static std::vector<unsigned char> containerContents(const char *magic, const std::vector<unsigned char> &fields) {
+    std::vector<unsigned char> contents;
+    contents.reserve(containerHeaderSize + fields.size() + checksumSize);
+    contents.push_back(static_cast<unsigned char>(magic[0]));
+    contents.push_back(static_cast<unsigned char>(magic[1]));
+    putLittleEndian(contents, saveFormatVersion, 2);
+    putLittleEndian(contents, fields.size(), 4);
+    contents.insert(contents.end(), fields.begin(), fields.end());
+    putLittleEndian(contents, crc32(0, contents.data(), contents.size()), 4);
+    return contents;
+}
+
+// The file is written next to filepath and renamed over it, so a crash leaves either the old or the new file and never a torn one
+static void replaceFile(const std::filesystem::path &filepath, const std::vector<unsigned char> &contents) {
+    std::filesystem::path temporaryPath = filepath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream configurationFile(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!configurationFile || !configurationFile.write(reinterpret_cast<const char*>(contents.data()), contents.size()) || !configurationFile.flush()) {
+            throw std::system_error(errno, std::generic_category(), temporaryPath.string());
+        }
+    }
+    std::filesystem::rename(temporaryPath, filepath);
 }
 
-// Saves configuration to file based on type.
-// The resulting savefiles are not portable because savefiles from different systems might have different endianness.
+// Saving a ".mpc" file drops its journal, which the snapshot includes
 void saveConfiguration(std::filesystem::path filepath, ConfigurationType type) {
-    std::ofstream configurationFile(filepath, std::ios::binary);
-    if (!configurationFile) throw std::system_error(errno, std::generic_category(), filepath.string());
-    switch (type) {
-        case Mandelbrotset:
-            configurationFile.write("MC", 2);
-            configurationFile.write(reinterpret_cast<char*>(&mConfig), sizeof(mConfig));
-            return;
-        case Tile:
-            configurationFile.write("TC", 2);
-            configurationFile.write(reinterpret_cast<char*>(&tConfig), sizeof(tConfig));
-            return;
-        case Progress:
-            configurationFile.write("PC", 2);
-            configurationFile.write(reinterpret_cast<char*>(&pConfig), sizeof(pConfig) - sizeof(size_t) * 2);
-            configurationFile.write(reinterpret_cast<char*>(pConfig.tileCompletion), (pConfig.tileCount + 7) / 8);
-            configurationFile.write(reinterpret_cast<char*>(pConfig.threadCompletion), (pConfig.threadCount + 7) / 8);
-            return;
-        case Null:
-            break;
+    const char *magic = configurationMagic(type);
+    if (magic == nullptr) return;
+    const std::vector<unsigned char> contents = containerContents(magic, configurationFields(type));
+
+    RenderState &state = boundRenderState();
+    std::lock_guard<std::mutex> lock(state.progressJournalMutex);
+    const bool journaled = state.progressJournal.is_open() && state.progressJournalPath == filepath;
+    if (journaled) state.progressJournal.close();
+    replaceFile(filepath, contents);
+    if (journaled) {
+        state.progressJournal.open(filepath, std::ios::binary | std::ios::app);
+        if (!state.progressJournal) throw std::system_error(errno, std::generic_category(), filepath.string());
+    }
+}
+
+void openProgressJournal(std::filesystem::path filepath) {
+    RenderState &state = boundRenderState();
+    std::lock_guard<std::mutex> lock(state.progressJournalMutex);
+    if (state.progressJournal.is_open()) state.progressJournal.close();
+    state.progressJournal.open(filepath, std::ios::binary | std::ios::app);
+    if (!state.progressJournal) throw std::system_error(errno, std::generic_category(), filepath.string());
+    state.progressJournalPath = filepath;
+}
+
+void closeProgressJournal() {
+    RenderState &state = boundRenderState();
+    std::lock_guard<std::mutex> lock(state.progressJournalMutex);
+    if (state.progressJournal.is_open()) state.progressJournal.close();
+    state.progressJournalPath.clear();
+}
+
+void journalTileCompletion(uint64_t tileIndex) {
+    std::vector<unsigned char> record;
+    putLittleEndian(record, tileIndex, 8);
+    putLittleEndian(record, static_cast<uint64_t>(std::atomic_ref<int64_t>(pConfig.tileBudgets[tileIndex]).load()), 8);
+    putLittleEndian(record, crc32(0, record.data(), record.size()), 4);
+
+    RenderState &state = boundRenderState();
+    std::lock_guard<std::mutex> lock(state.progressJournalMutex);
+    if (!state.progressJournal.is_open()) return;
+    if (!state.progressJournal.write(reinterpret_cast<const char*>(record.data()), record.size()) || !state.progressJournal.flush()) {
+        throw std::system_error(errno, std::generic_category(), state.progressJournalPath.string());
     }
-}
\ No newline at end of file
+}
+
+void saveContainer(const std::filesystem::path &filepath, const char *magic, const std::vector<unsigned char> &fields) {
+    replaceFile(filepath, containerContents(magic, fields));
+}
+
+bool loadContainer(const std::filesystem::path &filepath, const char *magic, std::vector<unsigned char> &fields) {
+    if (!std::filesystem::exists(filepath)) return false;
+    std::vector<unsigned char> contents = readConfigurationFile(filepath);
+    uint64_t fieldsSize = 0, trailerOffset = 0;
+    if (!openContainer(contents, magic, fieldsSize, trailerOffset)) return false;
+    contents.resize(containerHeaderSize + fieldsSize);
+    contents.erase(contents.begin(), contents.begin() + containerHeaderSize);
+    fields = std::move(contents);
+    return true;
+}
@@ -2,10 +2,22 @@
 #define SAVES_HPP_INCLUDED
 #include <cstdint>
 #include <filesystem>
+#include <vector>
 
 /*
 Configuration file specifications:
 
+Every configuration file is a container around the fields of its configuration. All values are little-endian regardless of the machine writing or reading them,
+doubles are stored as their IEEE 754 bits (uint64_t). A file is read with a single read and applied only if its version and checksum match.
+    Container byte layout:
+        byte[0, 1]                           = magic numbers          (char, char) Note: see the configurations below
+        byte[2, 3]                           = version                (uint16_t) Note: 2, files of other versions aren't read
+        byte[4, 5, 6, 7]                     = headerLength           (uint32_t) Note: number of field bytes, readers ignore fields past the ones they know
+        byte[8, ..., 7 + headerLength]       = fields                 Note: see the configurations below, offsets are from the start of the file
+        byte[8 + headerLength, ..., 11 + headerLength] = checksum     (uint32_t) Note: CRC-32 (zlib crc32) of every byte before it
+        byte[12 + headerLength, ...]         = journal                Note: only in ".mpc" files, see the progress configuration
+    Buddhabrot checkpoints (".mbc") use the same container, their fields are described in Buddhabrot.hpp.
+
 Mandelbrotset configuration:
     Filename has to end in ".mc" which stands for Mandelbrotset Configuration.
     Header byte layout:
@@ -13,16 +25,33 @@ Mandelbrotset configuration:
         byte[0, 1]                           = 'M' (0x4d), 'C' (0x43) (char, char)
 
         Mandelbrotset position configurations:
-        byte[ 2,  3,  4,  5,  6,  7,  8,  9] = startReal              (double)
-        byte[10, 11, 12, 13, 14, 15, 16, 17] = endReal                (double)
-        byte[18, 19, 20, 21, 22, 23, 24, 25] = startImag              (double)
-        byte[26, 27, 28, 29, 30, 31, 32, 33] = endImag                (double)
+        byte[ 8, ...,  15]                   = startReal              (double)
+        byte[16, ...,  23]                   = endReal                (double)
+        byte[24, ...,  31]                   = startImag              (double)
+        byte[32, ...,  39]                   = endImag                (double)
 
         Mandelbrotset iterating configurations:
-        byte[34, 35, 36, 37, 38, 39, 40, 41] = maxIterations          (int64_t)
-        byte[42, 43, 44, 45, 46, 47, 48, 49] = bailoutRadius          (double)
-        byte[50, 51, 52, 53, 54, 55, 56, 57] = periodicityPrecision2  (double)
-        byte[58, 59, 60, 61, 62, 63, 64, 65] = periodicitySavePeriod  (uint64_t)
+        byte[40, ...,  47]                   = maxIterations          (int64_t)
+        byte[48, ...,  55]                   = bailoutRadius          (double)
+        byte[56, ...,  63]                   = periodicityPrecision2  (double)
+        byte[64, ...,  71]                   = periodicitySavePeriod  (uint64_t)
+
+        Mandelbrotset rendering configurations:
+        byte[72, ...,  79]                   = renderFlags            (uint64_t) Note: combination of RenderFlag bits
+        byte[80, ...,  87]                   = centerRealHi           (double)
+        byte[88, ...,  95]                   = centerRealLo           (double)
+        byte[96, ..., 103]                   = centerImagHi           (double)
+        byte[104, ..., 111]                  = centerImagLo           (double)
+        byte[112, ..., 119]                  = zoom                   (double)
+
+        Iteration budget history, see EscalationRender:
+        byte[120, ..., 127]                  = budgetCount            (uint64_t)
+        byte[128, ..., 127 + 8 * budgetCount] = budgetHistory         (int64_t[]) Note: budgetCount maxIterations the samples were computed and escalated with, oldest first
+
+        Iterated formula, with h = 128 + 8 * budgetCount:
+        byte[h, ..., h + 7]                  = formula                (uint64_t) Note: a Formula, files ending before it render MandelbrotFormula
+        byte[h + 8, ..., h + 15]             = juliaReal              (double)
+        byte[h + 16, ..., h + 23]            = juliaImag              (double)
 
 Tile configuration:
     Filename has to end in ".mtc" which stands for Mandelbrotset Tile Configuration.
@@ -31,16 +60,16 @@ Tile configuration:
         byte[0, 1]                           = 'T' (0x54), 'C' (0x43) (char, char)
 
         Image size configurations:
-        byte[ 2,  3,  4,  5,  6,  7,  8,  9] = imageWidth             (uint64_t)
-        byte[10, 11, 12, 13, 14, 15, 16, 17] = imageHeight            (uint64_t)
+        byte[ 8, ..., 15]                    = imageWidth             (uint64_t)
+        byte[16, ..., 23]                    = imageHeight            (uint64_t)
 
         Tile grid configurations:
-        byte[18, 19, 20, 21, 22, 23, 24, 25] = tileGridWidth          (uint64_t)
-        byte[26, 27, 28, 29, 30, 31, 32, 33] = tileGridHeight         (uint64_t)
+        byte[24, ..., 31]                    = tileGridWidth          (uint64_t)
+        byte[32, ..., 39]                    = tileGridHeight         (uint64_t)
 
         Thread configurations:
-        byte[34, 35, 36, 37, 38, 39, 40, 41] = threadGridWidth        (uint64_t)
-        byte[42, 43, 44, 45, 46, 47, 48, 49] = threadGridHeight       (uint64_t)
+        byte[40, ..., 47]                    = threadGridWidth        (uint64_t)
+        byte[48, ..., 55]                    = threadGridHeight       (uint64_t)
 
 Progress configuration:
     Filename has to end in ".mpc" which stands for Mandelbrotset Progress Configuration.
@@ -49,18 +78,24 @@ Progress configuration:
         byte[0, 1]                           = 'P' (0x50), 'C' (0x43) (char, char)
 
         Runtime options:
-        byte[ 2,  3,  4,  5,  6,  7,  8,  9] = threadsUsed            (uint64_t)
+        byte[ 8, ..., 15]                    = threadsUsed            (uint64_t) Note: at least 1
 
         Progress:
-        byte[10, 11, 12, 13, 14, 15, 16, 17] = currentTile            (uint64_t)
+        byte[16, ..., 23]                    = currentTile            (uint64_t)
 
         Array lengths:
-        byte[18, 19, 20, 21, 22, 23, 24, 25] = tileCount              (uint64_t)
-        byte[26, 27, 28, 29, 30, 31, 32, 33] = threadCount            (uint64_t)
+        byte[24, ..., 31]                    = tileCount              (uint64_t)
+        byte[32, ..., 39]                    = threadCount            (uint64_t)
 
         Arrays:
         byte[?, ..., ?]                      = tileCompletion         (unsigned char[]) Note: size of this array is ⌈tileCount / 8⌉, i.e. (tileCount + 7) / 8
         byte[?, ..., ?]                      = threadCompletion       (unsigned char[]) Note: size of this array is ⌈threadCount / 8⌉, i.e. (threadCount + 7) / 8
+        byte[?, ..., ?]                      = tileBudgets            (int64_t[]) Note: tileCount maxIterations the tiles are complete for, 0 for tiles that aren't
+
+    Journal records after the checksum, one per tile completed since the file was saved, replayed over the arrays in order when loading:
+        byte[0, ..., 7]                      = tileIndex              (uint64_t)
+        byte[8, ..., 15]                     = tileBudget             (int64_t)
+        byte[16, ..., 19]                    = checksum               (uint32_t) Note: CRC-32 of the record's first 16 bytes, replay stops at the first record that doesn't match
 */
 
 enum ConfigurationType {
@@ -70,57 +105,128 @@ enum ConfigurationType {
     Null
 };
 
+// Bits of MandelbrotsetConfiguration::renderFlags
+enum RenderFlag : uint64_t {
+    // Perturbation rendering around the double-double center, for zooms deeper than doubles can resolve (below about 1e-13 span)
+    DeepZoomRender = 1ULL << 0,
+    // Mariani-Silver subdivision, rectangles whose whole border is interior are filled without iterating (see threadTileGenerator). Ignored with BurningShipFormula
+    MarianiSilverRender = 1ULL << 1,
+    // Iterates every tile in double precision, even those shallow enough for single precision (see prepareTile)
+    DoublePrecisionRender = 1ULL << 2,
+    // Writes 1/16 and 1/4 resolution previews next to the image before the full resolution pass, see generateImage
+    ProgressiveRender = 1ULL << 3,
+    // Keeps the iteration state of pixels that run out of iterations in the sample store, so raising maxIterations afterwards only continues those pixels
+    // instead of recomputing the image (see SampleStore). Ignored with DeepZoomRender and DistanceRender
+    EscalationRender = 1ULL << 4,
+    // Tracks dz/dc alongside z, so every escaped pixel also gets a distance estimate to the set and a normal angle (see Sample). They are kept in the sample store
+    // next to the samples and written as "<image>.distance.png" and "<image>.normal.png" by generateImage. Iterates in double precision only.
+    // Stepping dz/dc adds little per iteration, the distance and angle computed per pixel weigh most in views of quickly escaping pixels
+    DistanceRender = 1ULL << 5
+};
+
+// Values of MandelbrotsetConfiguration::formula, the iteration z_(n+1) = f(z_n) + a every pixel starts at z_1 = c with.
+// Each one has kernels of its own (see KernelTemplates.hpp), so the inner loops don't branch on it
+enum Formula : uint64_t {
+    // z^2 + c
+    MandelbrotFormula,
+    // Multibrot sets z^3 + c and z^4 + c
+    CubicMultibrotFormula,
+    QuarticMultibrotFormula,
+    // (|z.r| + |z.i| i)^2 + c
+    BurningShipFormula,
+    // z^2 + juliaReal + juliaImag i, the filled Julia set of that constant with the pixel as the starting point
+    JuliaFormula
+};
+
+constexpr uint64_t formulaCount = JuliaFormula + 1;
+
 // Minimum amount of information for same mandelbrotset position and quality
 struct MandelbrotsetConfiguration {
     // Left-most real in image
-    const double startReal;
+    double startReal;
     // Right-most real in image
-    const double endReal;
+    double endReal;
     // Top-most imaginary in image
-    const double startImag;
+    double startImag;
     // Bottom-most imaginary in image
-    const double endImag;
+    double endImag;
 
     // Maximum amount of iterations, iteration counts are in the interval [0, maxIterations]
-    const int64_t maxIterations;
+    int64_t maxIterations;
     // Terminates further iterations when magnitude of the complex number exceeds this limit
-    const double bailoutRadius;
+    double bailoutRadius;
     // Radius of termination-circle for periodicity checks. If the complex number's resulting positions after iterations is within this radius around the last position captured by periodicitySavePeriod, then terminate further iterations
-    const double periodicityPrecision2;
+    double periodicityPrecision2;
     // The period to wait before saving the current complex number's position to compare to with subsequent iterations of the complex number
-    const uint64_t periodicitySavePeriod;
+    uint64_t periodicitySavePeriod;
+
+    // Combination of RenderFlag bits
+    uint64_t renderFlags;
+    // Center of the image as a double-double (hi + lo), only used with DeepZoomRender
+    double centerRealHi;
+    double centerRealLo;
+    double centerImagHi;
+    double centerImagLo;
+    // Magnification of the view spanned by startReal/endReal and startImag/endImag around the center, only used with DeepZoomRender
+    double zoom;
+
+    // A Formula, DeepZoomRender and renderBuddhabrot only support MandelbrotFormula
+    uint64_t formula;
+    // Constant added every iteration of JuliaFormula, unused by the other formulas
+    double juliaReal;
+    double juliaImag;
 
     // Absolute range of real part of values within this image
     double realRange() const noexcept;
     // Absolute range of imaginary part of values within this image
     double imagRange() const noexcept;
+    // Complex plane distance between horizontally neighbouring pixels, negative if startReal > endReal
+    double pixelStepReal(uint64_t imageWidth) const noexcept;
+    // Complex plane distance between vertically neighbouring pixels, negative if startImag > endImag
+    double pixelStepImag(uint64_t imageHeight) const noexcept;
+    // Whether unresolved pixels are kept for a later, larger maxIterations, i.e. EscalationRender without DeepZoomRender or DistanceRender
+    bool escalates() const noexcept;
+    // Degree d of formula's polynomial, |z| grows like |z|^d once it escapes
+    uint64_t formulaPower() const noexcept;
 };
 
+// Narrowest a thread tile is made unless its tile is narrower, doubles per AVX-512 vector. Fixed rather than the selected kernel's vectorWidth,
+// as the tile layout of sample stores and tile files must not depend on the machine
+constexpr uint64_t threadVectorWidth = 8;
+
 // Minimum amount of information for the same set of image, tiles and threads
 struct TileConfiguration {
     // Width of image in pixels
-    const uint64_t imageWidth;
+    uint64_t imageWidth;
     // Height of image in pixels
-    const uint64_t imageHeight;
+    uint64_t imageHeight;
 
     // Number of tiles horizontally
-    const uint64_t tileGridWidth;
+    uint64_t tileGridWidth;
     // Number of tiles vertically
-    const uint64_t tileGridHeight;
+    uint64_t tileGridHeight;
 
     // Number of threads horizontally per tile
-    const uint64_t threadGridWidth;
+    uint64_t threadGridWidth;
     // Number of threads horizontally per tile
-    const uint64_t threadGridHeight;
+    uint64_t threadGridHeight;
 
-    // Width of a tile in pixels
+    // Width of a tile in pixels, the stride of tiles within the image. Rounded up, so tiles in the last column may be cut off (see tileWidthAt)
     uint64_t tileWidth() const noexcept;
-    // Height of a tile in pixels
+    // Height of a tile in pixels, the stride of tiles within the image. Rounded up, so tiles in the last row may be cut off (see tileHeightAt)
     uint64_t tileHeight() const noexcept;
-    // Width of a thread tile in pixels
+    // Width of a thread tile in pixels, the stride of thread tiles within a tile. Rounded up and at least threadVectorWidth unless the tile is narrower
     uint64_t threadWidth() const noexcept;
-    // Height of a thread tile in pixels
+    // Height of a thread tile in pixels, the stride of thread tiles within a tile. Rounded up
     uint64_t threadHeight() const noexcept;
+    // Width of the tiles in column tileX that lies within the image, 0 past its edge
+    uint64_t tileWidthAt(const uint64_t tileX) const noexcept;
+    // Height of the tiles in row tileY that lies within the image, 0 past its edge
+    uint64_t tileHeightAt(const uint64_t tileY) const noexcept;
+    // Width of the thread tiles in column threadX of a tile in column tileX that lies within the tile, 0 past its edge
+    uint64_t threadWidthAt(const uint64_t tileX, const uint64_t threadX) const noexcept;
+    // Height of the thread tiles in row threadY of a tile in row tileY that lies within the tile, 0 past its edge
+    uint64_t threadHeightAt(const uint64_t tileY, const uint64_t threadY) const noexcept;
     // Index of a tile within an image from tileX and tileY
     uint64_t tileIndex(const uint64_t tileX, const uint64_t tileY) const noexcept;
     // Index of a thread tile within a tile from threadX and threadY
@@ -141,10 +247,35 @@ struct ProgressConfiguration {
     unsigned char *tileCompletion;
     // Thread completion bool/bit array represented using an unsigned char array. This array has the size ⌈threadCount / 8⌉, i.e. (threadCount + 7) / 8. Each unsigned char represents 8 booleans
     unsigned char *threadCompletion;
+    // maxIterations every tile is complete for, 0 if it isn't. This array has the size tileCount
+    int64_t *tileBudgets;
 
     ~ProgressConfiguration();
 };
 
+// Bytes putConfigurationFields appends for each configuration
+constexpr uint64_t mandelbrotsetFieldsSize = 17 * 8;
+constexpr uint64_t tileFieldsSize = 6 * 8;
+
+// Appends the members of configuration to out in the order they are declared in, 8 bytes each and little-endian like the fields of the configuration files.
+// How configurations travel between machines, see Distributed.hpp
+void putConfigurationFields(std::vector<unsigned char> &out, const MandelbrotsetConfiguration &configuration);
+void putConfigurationFields(std::vector<unsigned char> &out, const TileConfiguration &configuration);
+
+// Reads configuration from fields appended by putConfigurationFields, mandelbrotsetFieldsSize or tileFieldsSize bytes of them.
+// Returns false and leaves configuration as it was if the result fails validConfiguration
+bool readConfigurationFields(const unsigned char *fields, MandelbrotsetConfiguration &configuration);
+bool readConfigurationFields(const unsigned char *fields, TileConfiguration &configuration);
+
+// Whether configuration can be rendered, i.e. has a known formula and at least one iteration. Configurations failing it are never loaded or taken from peers
+bool validConfiguration(const MandelbrotsetConfiguration &configuration) noexcept;
+
+// Whether configuration can be rendered, i.e. has an image and grids of at least one tile and thread that are no larger than the image
+bool validConfiguration(const TileConfiguration &configuration) noexcept;
+
+// Every maxIterations the current samples were computed and escalated with, oldest first. Taken from the sample store by generateImage, saved with ".mc" files
+extern thread_local std::vector<int64_t> &budgetHistory;
+
 // Returns the configuration type stored within filepath's contents.
 ConfigurationType getConfigurationType(std::filesystem::path filepath);
 
@@ -158,6 +289,27 @@ void loadConfiguration(std::filesystem::path filepath, ConfigurationType type);
 void detectLoadConfiguration(std::filesystem::path filepath);
 
 // Saves the configuration to filepath, saving which type is based on the specified type.
+// The file is replaced atomically, saving the progress configuration to the journal's file drops the journal records it now includes.
 void saveConfiguration(std::filesystem::path filepath, ConfigurationType type);
 
+// Replaces pConfig with one of tileCount tiles and threadCount threads that are all incomplete, keeping threadsUsed.
+void resetProgressConfiguration(uint64_t tileCount, uint64_t threadCount);
+
+// Appends the tile completions passed to journalTileCompletion to the ".mpc" file at filepath from now on, which has to hold the current progress configuration.
+// Every render state (see RenderState.hpp) has a journal of its own, the calling thread's one is opened.
+void openProgressJournal(std::filesystem::path filepath);
+
+// Stops journaling tile completions.
+void closeProgressJournal();
+
+// Appends tileIndex's completion and its pConfig.tileBudgets entry to the open journal and flushes it, does nothing without one. Thread safe.
+void journalTileCompletion(uint64_t tileIndex);
+
+// Saves fields, which start at byte 8 of the file, in the container with magic numbers magic (2 chars) to filepath. Replaced atomically like the configurations.
+// For save files of other modules, e.g. the ".mbc" files of renderBuddhabrot
+void saveContainer(const std::filesystem::path &filepath, const char *magic, const std::vector<unsigned char> &fields);
+
+// Reads the fields of the container with magic numbers magic at filepath into fields. Returns false if there is no such file or it isn't a valid container.
+bool loadContainer(const std::filesystem::path &filepath, const char *magic, std::vector<unsigned char> &fields);
+
 #endif  // SAVES_HPP_INCLUDED
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "Sequence.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "Colorizer.hpp"
+#include "DoubleDouble.hpp"
+#include "Perturbation.hpp"
+#include "PngEncoder.hpp"
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+#include "TileGenerator.hpp"
+#include "TileScheduler.hpp"
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+// Frames whose pixels are closer together than this many ulps of their coordinates are rendered with DeepZoomRender
+static constexpr double deepZoomPixelUlps = 64;
+// The shared reference orbit is only used while it lies within this many image sizes of a frame's center, further away its deltas lose precision
+static constexpr double sharedOrbitImageSizes = 4;
+// Frames with fewer tiles than this per worker leave most workers waiting for a frame's last tiles, several such frames are rendered at once instead
+static constexpr uint64_t smallFrameTilesPerWorker = 4;
+
+std::vector<Keyframe> loadKeyframes(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    if (!file) throw std::system_error(errno, std::generic_category(), path.string());
+
+    std::vector<Keyframe> keyframes;
+    std::string line;
+    for (uint64_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        std::istringstream stream(line);
+        Keyframe keyframe = {};
+        stream >> keyframe.time >> keyframe.centerRealHi >> keyframe.centerRealLo >> keyframe.centerImagHi >> keyframe.centerImagLo >> keyframe.logZoom >> keyframe.maxIterations;
+        if (!stream || !(stream >> std::ws).eof()) throw std::invalid_argument("not a keyframe: " + path.string() + ":" + std::to_string(lineNumber));
+        if (keyframe.maxIterations < 1) throw std::invalid_argument("maxIterations below 1: " + path.string() + ":" + std::to_string(lineNumber));
+        if (!keyframes.empty() && keyframe.time <= keyframes.back().time) throw std::invalid_argument("keyframe times not increasing: " + path.string() + ":" + std::to_string(lineNumber));
+        keyframes.push_back(keyframe);
+    }
+    if (keyframes.empty()) throw std::invalid_argument("no keyframes: " + path.string());
+    return keyframes;
+}
+
+// Interpolated view of one frame
+struct FrameView {
+    DoubleDouble centerReal;
+    DoubleDouble centerImag;
+    double logZoom;
+    int64_t maxIterations;
+};
+
+// View at time, which lies within the keyframes' times.
+// The view size s = 10^-logZoom shrinks exponentially, moving the center by (s - sA) / (sB - sA) of the way from A to B keeps the point the two views
+// have in common at the same place in the image. The center is interpolated from the smaller view, whose offset matters at the frame's own scale
+static FrameView interpolate(const std::vector<Keyframe> &keyframes, double time) {
+    uint64_t segment = 0;
+    while (segment + 2 < keyframes.size() && keyframes[segment + 1].time <= time) segment++;
+    if (keyframes.size() == 1) {
+        const Keyframe &only = keyframes[0];
+        return {DoubleDouble(only.centerRealHi, only.centerRealLo), DoubleDouble(only.centerImagHi, only.centerImagLo), only.logZoom, only.maxIterations};
+    }
+
+    const Keyframe &a = keyframes[segment];
+    const Keyframe &b = keyframes[segment + 1];
+    const double fraction = std::clamp((time - a.time) / (b.time - a.time), 0.0, 1.0);
+    FrameView view = {
+        .centerReal = DoubleDouble(),
+        .centerImag = DoubleDouble(),
+        .logZoom = a.logZoom + fraction * (b.logZoom - a.logZoom),
+        .maxIterations = static_cast<int64_t>(std::llround(a.maxIterations + fraction * static_cast<double>(b.maxIterations - a.maxIterations)))
+    };
+
+    const DoubleDouble aReal(a.centerRealHi, a.centerRealLo), aImag(a.centerImagHi, a.centerImagLo);
+    const DoubleDouble bReal(b.centerRealHi, b.centerRealLo), bImag(b.centerImagHi, b.centerImagLo);
+    const double sizeA = std::pow(10.0, -a.logZoom), sizeB = std::pow(10.0, -b.logZoom), size = std::pow(10.0, -view.logZoom);
+    if (std::abs(sizeB - sizeA) <= 1E-9 * std::max(sizeA, sizeB)) {
+        view.centerReal = aReal + DoubleDouble(fraction) * (bReal - aReal);
+        view.centerImag = aImag + DoubleDouble(fraction) * (bImag - aImag);
+    } else if (sizeB < sizeA) {
+        const DoubleDouble remaining((size - sizeB) / (sizeA - sizeB));
+        view.centerReal = bReal + remaining * (aReal - bReal);
+        view.centerImag = bImag + remaining * (aImag - bImag);
+    } else {
+        const DoubleDouble covered((size - sizeA) / (sizeB - sizeA));
+        view.centerReal = aReal + covered * (bReal - aReal);
+        view.centerImag = aImag + covered * (bImag - aImag);
+    }
+    return view;
+}
+
+// Replaces mConfig with base moved to view. Frames shallow enough for doubles span their view directly, deeper ones keep base's span at zoom 1 around the double-double center
+static void loadFrameView(const MandelbrotsetConfiguration &base, const FrameView &view) {
+    const double spanReal = base.endReal - base.startReal;
+    const double spanImag = base.endImag - base.startImag;
+    const double size = std::pow(10.0, -view.logZoom);
+    const double pixelStep = std::min(std::abs(spanReal) / (tConfig.imageWidth > 1 ? tConfig.imageWidth - 1 : 1), std::abs(spanImag) / (tConfig.imageHeight > 1 ? tConfig.imageHeight - 1 : 1)) * size;
+    const double magnitude = std::max({2.0, std::abs(view.centerReal.hi) + std::abs(spanReal) * size, std::abs(view.centerImag.hi) + std::abs(spanImag) * size});
+    const bool deep = pixelStep < deepZoomPixelUlps * magnitude * DBL_EPSILON;
+    const double extent = deep ? 1.0 : size;
+    if (deep && base.formula != MandelbrotFormula) throw std::invalid_argument("frames too deep for doubles are perturbed, which only supports MandelbrotFormula");
+
+    mConfig = {
+        .startReal = view.centerReal.hi - extent * spanReal / 2,
+        .endReal = view.centerReal.hi + extent * spanReal / 2,
+        .startImag = view.centerImag.hi - extent * spanImag / 2,
+        .endImag = view.centerImag.hi + extent * spanImag / 2,
+
+        .maxIterations = view.maxIterations,
+        .bailoutRadius = base.bailoutRadius,
+        .periodicityPrecision2 = base.periodicityPrecision2,
+        .periodicitySavePeriod = base.periodicitySavePeriod,
+
+        .renderFlags = (base.renderFlags & ~(DeepZoomRender | ProgressiveRender | EscalationRender | DistanceRender)) | (deep ? static_cast<uint64_t>(DeepZoomRender) : 0),
+        .centerRealHi = deep ? view.centerReal.hi : 0.0,
+        .centerRealLo = deep ? view.centerReal.lo : 0.0,
+        .centerImagHi = deep ? view.centerImag.hi : 0.0,
+        .centerImagLo = deep ? view.centerImag.lo : 0.0,
+        .zoom = deep ? 1 / size : 1.0,
+
+        .formula = base.formula,
+        .juliaReal = base.juliaReal,
+        .juliaImag = base.juliaImag
+    };
+}
+
+// Colors the frame in store and writes it as a PNG at path, or to stdout if path is empty
+static void writeFrame(const std::filesystem::path &path, const SampleStore &store, const Colorizer &colorizer) {
+    const uint64_t tileWidth = tConfig.tileWidth();
+    const uint64_t tileHeight = tConfig.tileHeight();
+    const uint64_t rowSize = tConfig.imageWidth * colorizer.bytesPerPixel();
+    std::unique_ptr<PngEncoder> png = path.empty() ? nullptr : std::make_unique<PngEncoder>(path, tConfig.imageWidth, tConfig.imageHeight, colorizer.bitDepth(), PngRGB);
+
+    std::vector<unsigned char> row(rowSize);
+    for (uint64_t y = 0; y < tConfig.imageHeight; y++) {
+        for (uint64_t tileX = 0; tileX < tConfig.tileGridWidth; tileX++) {
+            const StoredSample *tile = store.tile(tConfig.tileIndex(tileX, y / tileHeight));
+            colorizer.colorize(tile + (y % tileHeight) * tileWidth, tConfig.tileWidthAt(tileX), row.data() + tileX * tileWidth * colorizer.bytesPerPixel());
+        }
+
+        if (png) {
+            png->writeRows(row.data(), 1);
+        } else if (std::fwrite(row.data(), 1, rowSize, stdout) != rowSize) {
+            throw std::system_error(errno, std::generic_category(), "stdout");
+        }
+    }
+    if (png) png->finish();
+}
+
+// What the lanes of renderSequence share, every lane renders every lanes-th frame. Frames are written strictly in order,
+// a lane's frame waits until the frame before it is written
+struct SequenceRun {
+    const std::vector<Keyframe> &keyframes;
+    const SequenceSettings &settings;
+    const ColorSettings &colorSettings;
+    // mConfig and tConfig of the caller, every frame's view is base moved to the frame
+    const MandelbrotsetConfiguration base;
+    const TileConfiguration tiles;
+    const uint64_t frameCount;
+    const uint64_t lanes;
+    const uint64_t workersPerLane;
+
+    // Every deep frame is perturbed around the deepest keyframe's center, iterated for the largest budget any frame uses. Computed by the first lane needing it
+    std::once_flag orbitComputed;
+    ReferenceOrbit orbit;
+
+    // Guards nextFrame and failed
+    std::mutex mutex;
+    std::condition_variable frameWritten;
+    uint64_t nextFrame;
+    bool failed;
+};
+
+// Stops every lane of run after its current frame
+static void failSequence(SequenceRun &run) {
+    {
+        std::lock_guard<std::mutex> lock(run.mutex);
+        run.failed = true;
+    }
+    run.frameWritten.notify_all();
+}
+
+// Path of frame number frame in directory, frame000042.png
+static std::filesystem::path framePath(const std::filesystem::path &directory, uint64_t frame) {
+    std::ostringstream filename;
+    filename << "frame" << std::setw(6) << std::setfill('0') << frame << ".png";
+    return directory / filename.str();
+}
+
+// Colors the frame in store and writes it once every earlier frame is written, see SequenceRun. Frames after a failed one aren't written
+static void writeFrameInOrder(SequenceRun &run, uint64_t frame, const SampleStore &store, const Colorizer &colorizer) {
+    {
+        std::unique_lock<std::mutex> lock(run.mutex);
+        run.frameWritten.wait(lock, [&run, frame] { return run.failed || run.nextFrame == frame; });
+        if (run.failed) return;
+    }
+    try {
+        writeFrame(run.settings.rawStdout ? std::filesystem::path() : framePath(run.settings.frameDirectory, frame), store, colorizer);
+    } catch (...) {
+        failSequence(run);
+        throw;
+    }
+    std::cerr << "frame " << frame + 1 << "/" << run.frameCount << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(run.mutex);
+        run.nextFrame++;
+    }
+    run.frameWritten.notify_all();
+}
+
+// Renders every run.lanes-th frame from firstFrame on with a render state and run.workersPerLane workers of its own.
+// Lanes bind their own state instead of the caller's, like a RenderContext's thread
+static void renderLane(SequenceRun &run, uint64_t firstFrame) {
+    RenderState state{};
+    state.mConfig = run.base;
+    state.tConfig = run.tiles;
+    bindRenderState(state);
+    pConfig.threadsUsed = run.workersPerLane;
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    resetProgressConfiguration(tileCount, tConfig.threadGridWidth * tConfig.threadGridHeight);
+
+    // The lane places a copy of the shared orbit, where its C lies differs from frame to frame
+    ReferenceOrbit placed;
+    bool orbitCopied = false;
+
+    // Every frame of the lane is computed by the same workers, which keep their scratch buffers from frame to frame
+    TileScheduler scheduler(run.workersPerLane);
+    std::future<void> writing;
+    try {
+        for (uint64_t frame = firstFrame; frame < run.frameCount; frame += run.lanes) {
+            {
+                std::lock_guard<std::mutex> lock(run.mutex);
+                if (run.failed) break;
+            }
+            loadFrameView(run.base, interpolate(run.keyframes, run.keyframes.front().time + frame / run.settings.framesPerSecond));
+
+            shareReferenceOrbit(nullptr);
+            if (mConfig.renderFlags & DeepZoomRender) {
+                std::call_once(run.orbitComputed, [&run] {
+                    const Keyframe &deepest = *std::max_element(run.keyframes.begin(), run.keyframes.end(), [](const Keyframe &a, const Keyframe &b) { return a.logZoom < b.logZoom; });
+                    const int64_t maxIterations = std::max_element(run.keyframes.begin(), run.keyframes.end(), [](const Keyframe &a, const Keyframe &b) { return a.maxIterations < b.maxIterations; })->maxIterations;
+                    computeReferenceOrbit(deepest.centerRealHi, deepest.centerRealLo, deepest.centerImagHi, deepest.centerImagLo, maxIterations, run.orbit);
+                });
+                if (!orbitCopied) {
+                    placed = run.orbit;
+                    orbitCopied = true;
+                }
+                placeReferenceOrbit(placed);
+                if (std::abs(placed.referenceX - (tConfig.imageWidth - 1) / 2.0) <= sharedOrbitImageSizes * tConfig.imageWidth &&
+                    std::abs(placed.referenceY - (tConfig.imageHeight - 1) / 2.0) <= sharedOrbitImageSizes * tConfig.imageHeight) {
+                    shareReferenceOrbit(&placed);
+                }
+            }
+
+            std::fill_n(pConfig.tileCompletion, (pConfig.tileCount + 7) / 8, 0);
+            std::fill_n(pConfig.tileBudgets, pConfig.tileCount, 0);
+            std::unique_ptr<SampleStore> store = std::make_unique<SampleStore>("");
+            {
+                const StoreAttachment attachment(scheduler, *store, false);
+                for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) scheduler.submit(tileIndex, allPasses);
+                for (uint64_t tileIndex = 0; tileIndex < tileCount; tileIndex++) scheduler.wait(tileIndex);
+            }
+
+            // The colorizer keeps this frame's maxIterations, so the frame can be written while mConfig already holds the lane's next one
+            std::unique_ptr<Colorizer> colorizer = std::make_unique<Colorizer>(run.colorSettings);
+            if (colorizer->needsHistogram()) colorizer->buildHistogram(*store);
+
+            // At most one frame of the lane waits to be written while the lane computes its next one
+            if (writing.valid()) writing.get();
+            writing = boundAsync([&run, frame, store = std::move(store), colorizer = std::move(colorizer)] { writeFrameInOrder(run, frame, *store, *colorizer); });
+        }
+        if (writing.valid()) writing.get();
+    } catch (...) {
+        // Wakes the writers waiting for a frame this lane won't write
+        failSequence(run);
+        throw;
+    }
+    shareReferenceOrbit(nullptr);
+}
+
+void renderSequence(const std::vector<Keyframe> &keyframes, const SequenceSettings &settings, const ColorSettings &colorSettings) {
+    if (keyframes.empty() || !(settings.framesPerSecond > 0)) throw std::invalid_argument("renderSequence needs keyframes and a positive frame rate");
+    const uint64_t frameCount = static_cast<uint64_t>(std::floor((keyframes.back().time - keyframes.front().time) * settings.framesPerSecond)) + 1;
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    const uint64_t threadsUsed = std::max<uint64_t>(pConfig.threadsUsed, 1);
+    // Each lane gets as many workers as its frames have tiles for, the workers left over render further frames concurrently
+    const uint64_t workersPerLane = std::clamp<uint64_t>(tileCount / smallFrameTilesPerWorker, 1, threadsUsed);
+
+    if (settings.rawStdout) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    } else {
+        std::filesystem::create_directories(settings.frameDirectory);
+    }
+
+    SequenceRun run = {
+        .keyframes = keyframes,
+        .settings = settings,
+        .colorSettings = colorSettings,
+        .base = mConfig,
+        .tiles = tConfig,
+        .frameCount = frameCount,
+        .lanes = std::min(threadsUsed / workersPerLane, frameCount),
+        .workersPerLane = workersPerLane,
+        .orbitComputed = {},
+        .orbit = {},
+        .mutex = {},
+        .frameWritten = {},
+        .nextFrame = 0,
+        .failed = false
+    };
+    std::vector<std::future<void>> lanes;
+    for (uint64_t lane = 0; lane < run.lanes; lane++) lanes.push_back(std::async(std::launch::async, renderLane, std::ref(run), lane));
+    for (std::future<void> &lane : lanes) lane.wait();
+    for (std::future<void> &lane : lanes) lane.get();
+    if (settings.rawStdout && std::fflush(stdout) != 0) throw std::system_error(errno, std::generic_category(), "stdout");
+}
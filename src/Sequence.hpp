@@ -0,0 +1,57 @@
+#ifndef SEQUENCE_HPP_INCLUDED
+#define SEQUENCE_HPP_INCLUDED
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "Colorizer.hpp"
+
+/*
+Keyframe file specification:
+    Plain text, one keyframe per line in increasing time order, empty lines and everything after a '#' are ignored.
+    Every keyframe consists of 7 whitespace separated numbers:
+        time           seconds from the start of the sequence                          (double)
+        centerRealHi   real part of the view's center as a double-double (hi + lo)    (double)
+        centerRealLo                                                                   (double)
+        centerImagHi   imaginary part of the view's center as a double-double         (double)
+        centerImagLo                                                                   (double)
+        logZoom        base 10 logarithm of the zoom relative to the view of mConfig  (double) Note: 0 spans startReal/endReal and startImag/endImag
+        maxIterations                                                                  (int64_t)
+*/
+
+// View of a zoom sequence at one point in time, see the keyframe file specification above
+struct Keyframe {
+    double time;
+    double centerRealHi;
+    double centerRealLo;
+    double centerImagHi;
+    double centerImagLo;
+    double logZoom;
+    int64_t maxIterations;
+};
+
+// How the frames of renderSequence are timed and where they go
+struct SequenceSettings {
+    double framesPerSecond;
+    // Directory the frames are written into as frame000000.png, frame000001.png, ...
+    std::filesystem::path frameDirectory;
+    // Writes the frames to stdout as one raw video stream of tConfig.imageWidth x tConfig.imageHeight frames instead,
+    // rgb24 with an 8 bit colorSettings.bitDepth and rgb48be with a 16 bit one
+    bool rawStdout;
+};
+
+// Reads the keyframes of the file at path, throws if it can't be read or a line isn't a keyframe
+std::vector<Keyframe> loadKeyframes(const std::filesystem::path &path);
+
+// Renders one frame every 1 / framesPerSecond seconds from the first keyframe's time to the last one's.
+// Every frame is a whole image of the tile pipeline with mConfig replaced by the interpolated view: logZoom and maxIterations are interpolated linearly,
+// the center so that zooming between two keyframes keeps one point of the image fixed instead of sweeping past the target.
+// Every other setting comes from mConfig, which stays as it is. Frames too deep for doubles are rendered with DeepZoomRender around one
+// reference orbit at the deepest keyframe's center that every frame shares while it lies near enough to the frame, instead of an orbit per tile and frame.
+// Frames with plenty of tiles per worker are computed one after another by the workers of a single TileScheduler. Smaller frames split the workers
+// into lanes with a render state and TileScheduler each, and every lane computes every lanes-th frame. Each frame is colored and written, in order,
+// while its lane computes the next one.
+// ProgressiveRender, EscalationRender and DistanceRender are ignored, the samples of a frame only live in memory.
+void renderSequence(const std::vector<Keyframe> &keyframes, const SequenceSettings &settings, const ColorSettings &colorSettings);
+
+#endif  // SEQUENCE_HPP_INCLUDED
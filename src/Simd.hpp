@@ -0,0 +1,327 @@
+#ifndef SIMD_HPP_INCLUDED
+#define SIMD_HPP_INCLUDED
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/*
+SIMD traits used by the kernel templates in KernelTemplates.hpp.
+
+Every traits struct exposes the same static interface so a kernel can be written once and instantiated per instruction set:
+    Vector                 register type holding `width` lanes of Scalar
+    Mask                   per-lane boolean type returned by comparisons
+    set1, zero, iota       broadcast, all zeros, and {0, 1, 2, ...}
+    load, store            unaligned memory access of `width` lanes
+    add, sub, mul, div     arithmetic
+    fmadd                  fmadd(a, b, c) = a * b + c
+    min, max               per lane minimum and maximum
+    truncate               rounds towards zero, for |a| < 2^31
+    log2                   base 2 logarithm of positive normal numbers, accurate to about 1e-7
+    gather                 {base[index[0]], base[index[1]], ...} for a vector of non-negative whole numbers below 2^31
+    cmplt                  a < b per lane
+    blend(m, a, b)         m ? b : a per lane (same argument order as _mm512_mask_blend_pd)
+    maskAnd, maskAndNot    a & b, a & ~b
+    bits, fromBits         lane mask to and from the low `width` bits of an unsigned integer
+
+The *Float traits hold twice as many lanes of float and only cover what the iteration kernels need, they have no log2 and gather.
+
+Each traits struct only exists in translation units compiled for its instruction set, and everything lives in an anonymous namespace
+so that instantiations from translation units compiled with different -m flags never get merged by the linker.
+*/
+
+namespace {
+
+// log2(m) for mantissas m in [1, 2) through the series ln(m) = 2 * atanh(t) with t = (m - 1) / (m + 1) <= 1 / 3
+template <typename V>
+inline typename V::Vector log2Mantissa(typename V::Vector m) noexcept {
+    const typename V::Vector t = V::div(V::sub(m, V::set1(1)), V::add(m, V::set1(1)));
+    const typename V::Vector t2 = V::mul(t, t);
+    typename V::Vector series = V::set1(1.0 / 11);
+    series = V::fmadd(series, t2, V::set1(1.0 / 9));
+    series = V::fmadd(series, t2, V::set1(1.0 / 7));
+    series = V::fmadd(series, t2, V::set1(1.0 / 5));
+    series = V::fmadd(series, t2, V::set1(1.0 / 3));
+    series = V::fmadd(series, t2, V::set1(1));
+    return V::mul(V::mul(series, t), V::set1(2 / 0.69314718055994530942));
+}
+
+struct ScalarDouble {
+    using Scalar = double;
+    using Vector = double;
+    using Mask = bool;
+    static constexpr uint64_t width = 1;
+
+    static inline Vector set1(Scalar a) noexcept { return a; }
+    static inline Vector zero() noexcept { return 0; }
+    static inline Vector iota() noexcept { return 0; }
+    static inline Vector load(const Scalar *p) noexcept { return *p; }
+    static inline void store(Scalar *p, Vector a) noexcept { *p = a; }
+    static inline Vector add(Vector a, Vector b) noexcept { return a + b; }
+    static inline Vector sub(Vector a, Vector b) noexcept { return a - b; }
+    static inline Vector mul(Vector a, Vector b) noexcept { return a * b; }
+    static inline Vector div(Vector a, Vector b) noexcept { return a / b; }
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return a * b + c; }
+    static inline Vector min(Vector a, Vector b) noexcept { return a < b ? a : b; }
+    static inline Vector max(Vector a, Vector b) noexcept { return a < b ? b : a; }
+    static inline Vector truncate(Vector a) noexcept { return std::trunc(a); }
+    static inline Vector log2(Vector a) noexcept { return std::log2(a); }
+    static inline Vector gather(const Scalar *base, Vector index) noexcept { return base[static_cast<int64_t>(index)]; }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return a < b; }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return m ? b : a; }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return a && b; }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return a && !b; }
+    static inline Mask fullMask() noexcept { return true; }
+    static inline unsigned bits(Mask m) noexcept { return m ? 1u : 0u; }
+    static inline Mask fromBits(unsigned b) noexcept { return b & 1; }
+};
+
+struct ScalarFloat {
+    using Scalar = float;
+    using Vector = float;
+    using Mask = bool;
+    static constexpr uint64_t width = 1;
+
+    static inline Vector set1(Scalar a) noexcept { return a; }
+    static inline Vector zero() noexcept { return 0; }
+    static inline Vector iota() noexcept { return 0; }
+    static inline Vector load(const Scalar *p) noexcept { return *p; }
+    static inline void store(Scalar *p, Vector a) noexcept { *p = a; }
+    static inline Vector add(Vector a, Vector b) noexcept { return a + b; }
+    static inline Vector sub(Vector a, Vector b) noexcept { return a - b; }
+    static inline Vector mul(Vector a, Vector b) noexcept { return a * b; }
+    static inline Vector div(Vector a, Vector b) noexcept { return a / b; }
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return a * b + c; }
+    static inline Vector min(Vector a, Vector b) noexcept { return a < b ? a : b; }
+    static inline Vector max(Vector a, Vector b) noexcept { return a < b ? b : a; }
+    static inline Vector truncate(Vector a) noexcept { return std::trunc(a); }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return a < b; }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return m ? b : a; }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return a && b; }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return a && !b; }
+    static inline Mask fullMask() noexcept { return true; }
+    static inline unsigned bits(Mask m) noexcept { return m ? 1u : 0u; }
+    static inline Mask fromBits(unsigned b) noexcept { return b & 1; }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+struct SSE2Double {
+    using Scalar = double;
+    using Vector = __m128d;
+    using Mask = __m128d;
+    static constexpr uint64_t width = 2;
+
+    static inline Vector set1(Scalar a) noexcept { return _mm_set1_pd(a); }
+    static inline Vector zero() noexcept { return _mm_setzero_pd(); }
+    static inline Vector iota() noexcept { return _mm_set_pd(1, 0); }
+    static inline Vector load(const Scalar *p) noexcept { return _mm_loadu_pd(p); }
+    static inline void store(Scalar *p, Vector a) noexcept { _mm_storeu_pd(p, a); }
+    static inline Vector add(Vector a, Vector b) noexcept { return _mm_add_pd(a, b); }
+    static inline Vector sub(Vector a, Vector b) noexcept { return _mm_sub_pd(a, b); }
+    static inline Vector mul(Vector a, Vector b) noexcept { return _mm_mul_pd(a, b); }
+    static inline Vector div(Vector a, Vector b) noexcept { return _mm_div_pd(a, b); }
+    // SSE2 has no fused multiply-add
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static inline Vector min(Vector a, Vector b) noexcept { return _mm_min_pd(a, b); }
+    static inline Vector max(Vector a, Vector b) noexcept { return _mm_max_pd(a, b); }
+    static inline Vector truncate(Vector a) noexcept { return _mm_cvtepi32_pd(_mm_cvttpd_epi32(a)); }
+    static inline Vector log2(Vector a) noexcept {
+        const __m128i bits = _mm_castpd_si128(a);
+        // Converted through 32 bit integers, adding and subtracting a magic number wouldn't survive -Ofast reassociation
+        const __m128i biasedExponent = _mm_shuffle_epi32(_mm_srli_epi64(bits, 52), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m128d exponent = _mm_sub_pd(_mm_cvtepi32_pd(biasedExponent), _mm_set1_pd(1023));
+        const __m128d mantissa = _mm_or_pd(_mm_castsi128_pd(_mm_and_si128(bits, _mm_set1_epi64x(0x000fffffffffffff))), _mm_set1_pd(1));
+        return _mm_add_pd(exponent, log2Mantissa<SSE2Double>(mantissa));
+    }
+    static inline Vector gather(const Scalar *base, Vector index) noexcept {
+        const __m128i i = _mm_cvttpd_epi32(index);
+        return _mm_set_pd(base[_mm_cvtsi128_si32(_mm_shuffle_epi32(i, 1))], base[_mm_cvtsi128_si32(i)]);
+    }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return _mm_cmplt_pd(a, b); }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a)); }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return _mm_and_pd(a, b); }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return _mm_andnot_pd(b, a); }
+    static inline Mask fullMask() noexcept { return _mm_castsi128_pd(_mm_set1_epi32(-1)); }
+    static inline unsigned bits(Mask m) noexcept { return static_cast<unsigned>(_mm_movemask_pd(m)); }
+    static inline Mask fromBits(unsigned b) noexcept { return _mm_castsi128_pd(_mm_set_epi64x(-int64_t((b >> 1) & 1), -int64_t(b & 1))); }
+};
+
+struct SSE2Float {
+    using Scalar = float;
+    using Vector = __m128;
+    using Mask = __m128;
+    static constexpr uint64_t width = 4;
+
+    static inline Vector set1(Scalar a) noexcept { return _mm_set1_ps(a); }
+    static inline Vector zero() noexcept { return _mm_setzero_ps(); }
+    static inline Vector iota() noexcept { return _mm_set_ps(3, 2, 1, 0); }
+    static inline Vector load(const Scalar *p) noexcept { return _mm_loadu_ps(p); }
+    static inline void store(Scalar *p, Vector a) noexcept { _mm_storeu_ps(p, a); }
+    static inline Vector add(Vector a, Vector b) noexcept { return _mm_add_ps(a, b); }
+    static inline Vector sub(Vector a, Vector b) noexcept { return _mm_sub_ps(a, b); }
+    static inline Vector mul(Vector a, Vector b) noexcept { return _mm_mul_ps(a, b); }
+    static inline Vector div(Vector a, Vector b) noexcept { return _mm_div_ps(a, b); }
+    // SSE2 has no fused multiply-add
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static inline Vector min(Vector a, Vector b) noexcept { return _mm_min_ps(a, b); }
+    static inline Vector max(Vector a, Vector b) noexcept { return _mm_max_ps(a, b); }
+    static inline Vector truncate(Vector a) noexcept { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return _mm_cmplt_ps(a, b); }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a)); }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return _mm_and_ps(a, b); }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return _mm_andnot_ps(b, a); }
+    static inline Mask fullMask() noexcept { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static inline unsigned bits(Mask m) noexcept { return static_cast<unsigned>(_mm_movemask_ps(m)); }
+    static inline Mask fromBits(unsigned b) noexcept {
+        const __m128i laneBits = _mm_set_epi32(8, 4, 2, 1);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(static_cast<int>(b)), laneBits), laneBits));
+    }
+};
+#endif
+
+#if defined(__AVX2__)
+struct AVX2Double {
+    using Scalar = double;
+    using Vector = __m256d;
+    using Mask = __m256d;
+    static constexpr uint64_t width = 4;
+
+    static inline Vector set1(Scalar a) noexcept { return _mm256_set1_pd(a); }
+    static inline Vector zero() noexcept { return _mm256_setzero_pd(); }
+    static inline Vector iota() noexcept { return _mm256_set_pd(3, 2, 1, 0); }
+    static inline Vector load(const Scalar *p) noexcept { return _mm256_loadu_pd(p); }
+    static inline void store(Scalar *p, Vector a) noexcept { _mm256_storeu_pd(p, a); }
+    static inline Vector add(Vector a, Vector b) noexcept { return _mm256_add_pd(a, b); }
+    static inline Vector sub(Vector a, Vector b) noexcept { return _mm256_sub_pd(a, b); }
+    static inline Vector mul(Vector a, Vector b) noexcept { return _mm256_mul_pd(a, b); }
+    static inline Vector div(Vector a, Vector b) noexcept { return _mm256_div_pd(a, b); }
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return _mm256_fmadd_pd(a, b, c); }
+    static inline Vector min(Vector a, Vector b) noexcept { return _mm256_min_pd(a, b); }
+    static inline Vector max(Vector a, Vector b) noexcept { return _mm256_max_pd(a, b); }
+    static inline Vector truncate(Vector a) noexcept { return _mm256_round_pd(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+    static inline Vector log2(Vector a) noexcept {
+        const __m256i bits = _mm256_castpd_si256(a);
+        // Converted through 32 bit integers, adding and subtracting a magic number wouldn't survive -Ofast reassociation
+        const __m256i biasedExponent = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(bits, 52), _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+        const __m256d exponent = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(biasedExponent)), _mm256_set1_pd(1023));
+        const __m256d mantissa = _mm256_or_pd(_mm256_castsi256_pd(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffff))), _mm256_set1_pd(1));
+        return _mm256_add_pd(exponent, log2Mantissa<AVX2Double>(mantissa));
+    }
+    static inline Vector gather(const Scalar *base, Vector index) noexcept {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, _mm256_cvttpd_epi32(index), fullMask(), 8);
+    }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return _mm256_blendv_pd(a, b, m); }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return _mm256_and_pd(a, b); }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return _mm256_andnot_pd(b, a); }
+    static inline Mask fullMask() noexcept { return _mm256_castsi256_pd(_mm256_set1_epi32(-1)); }
+    static inline unsigned bits(Mask m) noexcept { return static_cast<unsigned>(_mm256_movemask_pd(m)); }
+    static inline Mask fromBits(unsigned b) noexcept {
+        return _mm256_castsi256_pd(_mm256_set_epi64x(-int64_t((b >> 3) & 1), -int64_t((b >> 2) & 1), -int64_t((b >> 1) & 1), -int64_t(b & 1)));
+    }
+};
+
+struct AVX2Float {
+    using Scalar = float;
+    using Vector = __m256;
+    using Mask = __m256;
+    static constexpr uint64_t width = 8;
+
+    static inline Vector set1(Scalar a) noexcept { return _mm256_set1_ps(a); }
+    static inline Vector zero() noexcept { return _mm256_setzero_ps(); }
+    static inline Vector iota() noexcept { return _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0); }
+    static inline Vector load(const Scalar *p) noexcept { return _mm256_loadu_ps(p); }
+    static inline void store(Scalar *p, Vector a) noexcept { _mm256_storeu_ps(p, a); }
+    static inline Vector add(Vector a, Vector b) noexcept { return _mm256_add_ps(a, b); }
+    static inline Vector sub(Vector a, Vector b) noexcept { return _mm256_sub_ps(a, b); }
+    static inline Vector mul(Vector a, Vector b) noexcept { return _mm256_mul_ps(a, b); }
+    static inline Vector div(Vector a, Vector b) noexcept { return _mm256_div_ps(a, b); }
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return _mm256_fmadd_ps(a, b, c); }
+    static inline Vector min(Vector a, Vector b) noexcept { return _mm256_min_ps(a, b); }
+    static inline Vector max(Vector a, Vector b) noexcept { return _mm256_max_ps(a, b); }
+    static inline Vector truncate(Vector a) noexcept { return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return _mm256_blendv_ps(a, b, m); }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return _mm256_and_ps(a, b); }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return _mm256_andnot_ps(b, a); }
+    static inline Mask fullMask() noexcept { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static inline unsigned bits(Mask m) noexcept { return static_cast<unsigned>(_mm256_movemask_ps(m)); }
+    static inline Mask fromBits(unsigned b) noexcept {
+        const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(b)), laneBits), laneBits));
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct AVX512Double {
+    using Scalar = double;
+    using Vector = __m512d;
+    using Mask = __mmask8;
+    static constexpr uint64_t width = 8;
+
+    static inline Vector set1(Scalar a) noexcept { return _mm512_set1_pd(a); }
+    static inline Vector zero() noexcept { return _mm512_setzero_pd(); }
+    // Vectors read from right to left when converted to native types
+    static inline Vector iota() noexcept { return _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0); }
+    static inline Vector load(const Scalar *p) noexcept { return _mm512_loadu_pd(p); }
+    static inline void store(Scalar *p, Vector a) noexcept { _mm512_storeu_pd(p, a); }
+    static inline Vector add(Vector a, Vector b) noexcept { return _mm512_add_pd(a, b); }
+    static inline Vector sub(Vector a, Vector b) noexcept { return _mm512_sub_pd(a, b); }
+    static inline Vector mul(Vector a, Vector b) noexcept { return _mm512_mul_pd(a, b); }
+    static inline Vector div(Vector a, Vector b) noexcept { return _mm512_div_pd(a, b); }
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return _mm512_fmadd_pd(a, b, c); }
+    static inline Vector min(Vector a, Vector b) noexcept { return _mm512_maskz_min_pd(fullMask(), a, b); }
+    static inline Vector max(Vector a, Vector b) noexcept { return _mm512_maskz_max_pd(fullMask(), a, b); }
+    static inline Vector truncate(Vector a) noexcept { return _mm512_maskz_roundscale_pd(fullMask(), a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+    static inline Vector log2(Vector a) noexcept {
+        const __m512d exponent = _mm512_maskz_getexp_pd(fullMask(), a);
+        const __m512d mantissa = _mm512_maskz_getmant_pd(fullMask(), a, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero);
+        return _mm512_add_pd(exponent, log2Mantissa<AVX512Double>(mantissa));
+    }
+    static inline Vector gather(const Scalar *base, Vector index) noexcept {
+        return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), fullMask(), _mm512_maskz_cvttpd_epi32(fullMask(), index), base, 8);
+    }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return _mm512_mask_blend_pd(m, a, b); }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return a & b; }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return a & ~b; }
+    static inline Mask fullMask() noexcept { return 0b11111111; }
+    static inline unsigned bits(Mask m) noexcept { return m; }
+    static inline Mask fromBits(unsigned b) noexcept { return static_cast<Mask>(b); }
+};
+
+struct AVX512Float {
+    using Scalar = float;
+    using Vector = __m512;
+    using Mask = __mmask16;
+    static constexpr uint64_t width = 16;
+
+    static inline Vector set1(Scalar a) noexcept { return _mm512_set1_ps(a); }
+    static inline Vector zero() noexcept { return _mm512_setzero_ps(); }
+    static inline Vector iota() noexcept { return _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0); }
+    static inline Vector load(const Scalar *p) noexcept { return _mm512_loadu_ps(p); }
+    static inline void store(Scalar *p, Vector a) noexcept { _mm512_storeu_ps(p, a); }
+    static inline Vector add(Vector a, Vector b) noexcept { return _mm512_add_ps(a, b); }
+    static inline Vector sub(Vector a, Vector b) noexcept { return _mm512_sub_ps(a, b); }
+    static inline Vector mul(Vector a, Vector b) noexcept { return _mm512_mul_ps(a, b); }
+    static inline Vector div(Vector a, Vector b) noexcept { return _mm512_div_ps(a, b); }
+    static inline Vector fmadd(Vector a, Vector b, Vector c) noexcept { return _mm512_fmadd_ps(a, b, c); }
+    static inline Vector min(Vector a, Vector b) noexcept { return _mm512_maskz_min_ps(fullMask(), a, b); }
+    static inline Vector max(Vector a, Vector b) noexcept { return _mm512_maskz_max_ps(fullMask(), a, b); }
+    static inline Vector truncate(Vector a) noexcept { return _mm512_maskz_roundscale_ps(fullMask(), a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+    static inline Mask cmplt(Vector a, Vector b) noexcept { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static inline Vector blend(Mask m, Vector a, Vector b) noexcept { return _mm512_mask_blend_ps(m, a, b); }
+    static inline Mask maskAnd(Mask a, Mask b) noexcept { return a & b; }
+    static inline Mask maskAndNot(Mask a, Mask b) noexcept { return a & ~b; }
+    static inline Mask fullMask() noexcept { return 0xffff; }
+    static inline unsigned bits(Mask m) noexcept { return m; }
+    static inline Mask fromBits(unsigned b) noexcept { return static_cast<Mask>(b); }
+};
+#endif
+
+}  // namespace
+
+#endif  // SIMD_HPP_INCLUDED
@@ -0,0 +1,236 @@
+#include "Telemetry.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "RenderState.hpp"
+#include "Saves.hpp"
+
+extern thread_local ProgressConfiguration &pConfig;
+
+static thread_local WorkerCounters *boundCounters = nullptr;
+
+WorkerCounters &workerCounters(uint64_t worker) {
+    RenderTelemetry &telemetry = boundRenderState().telemetry;
+    std::lock_guard<std::mutex> lock(telemetry.countersMutex);
+    while (telemetry.counters.size() <= worker) telemetry.counters.emplace_back();
+    return telemetry.counters[worker];
+}
+
+void bindWorkerCounters(WorkerCounters *workerCounters) noexcept {
+    boundCounters = workerCounters;
+}
+
+WorkerCounters *boundWorkerCounters() noexcept {
+    return boundCounters;
+}
+
+void countKernelWork(uint64_t pixels, uint64_t iterations) noexcept {
+    if (boundCounters == nullptr) return;
+    boundCounters->pixels.fetch_add(pixels, std::memory_order_relaxed);
+    boundCounters->iterations.fetch_add(iterations, std::memory_order_relaxed);
+}
+
+void countOutputTime(std::chrono::steady_clock::duration duration) noexcept {
+    boundRenderState().telemetry.outputNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), std::memory_order_relaxed);
+}
+
+void countTileCompleted(uint64_t iterations, double estimatedCost) noexcept {
+    RenderTelemetry &telemetry = boundRenderState().telemetry;
+    telemetry.tilesComputed.fetch_add(1, std::memory_order_relaxed);
+    telemetry.tileIterations.fetch_add(iterations, std::memory_order_relaxed);
+    telemetry.tileEstimatedCost.fetch_add(estimatedCost, std::memory_order_relaxed);
+}
+
+void setTileCostEstimate(const std::vector<double> &tileCosts) {
+    RenderTelemetry &telemetry = boundRenderState().telemetry;
+    std::lock_guard<std::mutex> lock(telemetry.estimateMutex);
+    telemetry.estimatedTileCosts = tileCosts;
+}
+
+// Estimated cost of the tiles pConfig.tileCompletion doesn't mark, 0 without an estimate
+static double remainingEstimatedCost(RenderTelemetry &telemetry) {
+    std::lock_guard<std::mutex> lock(telemetry.estimateMutex);
+    if (telemetry.estimatedTileCosts.size() != pConfig.tileCount) return 0;
+    double remaining = 0;
+    for (uint64_t i = 0; i < pConfig.tileCount; i++) {
+        if (!(std::atomic_ref<unsigned char>(pConfig.tileCompletion[i / 8]).load(std::memory_order_relaxed) & (1 << (i % 8)))) remaining += telemetry.estimatedTileCosts[i];
+    }
+    return remaining;
+}
+
+// Tiles pConfig.tileCompletion marks, while workers set further bits
+static uint64_t completedTiles() noexcept {
+    uint64_t completed = 0;
+    for (uint64_t i = 0; i < (pConfig.tileCount + 7) / 8; i++) completed += std::popcount(std::atomic_ref<unsigned char>(pConfig.tileCompletion[i]).load(std::memory_order_relaxed));
+    return completed;
+}
+
+static double seconds(std::chrono::steady_clock::duration duration) noexcept {
+    return std::chrono::duration<double>(duration).count();
+}
+
+// value with an SI prefix and 3 significant digits, e.g. 1.23 G
+static std::string formatQuantity(double value) {
+    static const char *const prefixes[] = {"", "k", "M", "G", "T", "P"};
+    uint64_t prefix = 0;
+    while (value >= 1000 && prefix + 1 < std::size(prefixes)) {
+        value /= 1000;
+        prefix++;
+    }
+    std::ostringstream text;
+    text << std::setprecision(3) << value << " " << prefixes[prefix];
+    return text.str();
+}
+
+// h:mm:ss
+static std::string formatDuration(double duration) {
+    const uint64_t total = static_cast<uint64_t>(duration + 0.5);
+    std::ostringstream text;
+    text << total / 3600 << ":" << std::setfill('0') << std::setw(2) << total / 60 % 60 << ":" << std::setw(2) << total % 60;
+    return text.str();
+}
+
+TelemetryReporter::TelemetryReporter(const TelemetrySettings &telemetrySettings)
+    : settings(telemetrySettings), telemetry(boundRenderState().telemetry), start(snapshot()), previous(start), stopping(false), mutex(), stopped(), reporter() {
+    if (settings.progressBar || !settings.metricsPath.empty()) reporter = boundThread(&TelemetryReporter::run, this);
+}
+
+TelemetryReporter::~TelemetryReporter() {
+    if (!reporter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopped.notify_all();
+    reporter.join();
+    try {
+        report();
+    } catch (const std::exception &error) {
+        std::cerr << "telemetry: " << error.what() << std::endl;
+    }
+    if (settings.progressBar) std::cerr << std::endl;
+}
+
+TelemetryReporter::Snapshot TelemetryReporter::snapshot() const {
+    Snapshot current = {.time = std::chrono::steady_clock::now(), .workerIterations = {}, .iterations = 0,
+                        .tilesComputed = telemetry.tilesComputed.load(std::memory_order_relaxed), .tileIterations = telemetry.tileIterations.load(std::memory_order_relaxed),
+                        .tileEstimatedCost = telemetry.tileEstimatedCost.load(std::memory_order_relaxed)};
+    std::lock_guard<std::mutex> lock(telemetry.countersMutex);
+    for (const WorkerCounters &worker : telemetry.counters) {
+        current.workerIterations.push_back(worker.iterations.load(std::memory_order_relaxed));
+        current.iterations += current.workerIterations.back();
+    }
+    return current;
+}
+
+void TelemetryReporter::run() {
+    const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(settings.interval, 0.01)));
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped.wait_for(lock, interval, [this] { return stopping; })) {
+        lock.unlock();
+        try {
+            report();
+        } catch (const std::exception &error) {
+            std::cerr << "telemetry: " << error.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+void TelemetryReporter::report() {
+    const Snapshot current = snapshot();
+    const double intervalSeconds = std::max(seconds(current.time - previous.time), 1e-9);
+    const double elapsedSeconds = std::max(seconds(current.time - start.time), 1e-9);
+    const uint64_t tileCount = pConfig.tileCount;
+    const uint64_t completed = completedTiles();
+
+    // Remaining tiles take as long per estimated cost as this run's tiles did, or without an estimate cost what this run's tiles cost on average,
+    // at the rate this run iterated them
+    const uint64_t runTiles = current.tilesComputed - start.tilesComputed;
+    const double runRate = (current.iterations - start.iterations) / elapsedSeconds;
+    const double runEstimatedCost = current.tileEstimatedCost - start.tileEstimatedCost;
+    const double remainingCost = completed < tileCount ? remainingEstimatedCost(telemetry) : 0;
+    // Unknown until this run completes a tile, tracked separately as -Ofast assumes NaN never occurs
+    const bool etaKnown = completed == tileCount || (runTiles > 0 && (runRate > 0 || (runEstimatedCost > 0 && remainingCost > 0)));
+    double eta = 0;
+    if (completed < tileCount && etaKnown) {
+        if (runEstimatedCost > 0 && remainingCost > 0) {
+            eta = remainingCost * elapsedSeconds / runEstimatedCost;
+        } else {
+            eta = (tileCount - completed) * (static_cast<double>(current.tileIterations - start.tileIterations) / runTiles) / runRate;
+        }
+    }
+
+    // Rates over the last interval, workers without any iterations in it are idle rather than slow
+    const double intervalRate = (current.iterations - previous.iterations) / intervalSeconds;
+    std::vector<double> workerRates(current.workerIterations.size(), 0);
+    uint64_t slowest = UINT64_MAX;
+    uint64_t activeWorkers = 0;
+    for (uint64_t worker = 0; worker < workerRates.size(); worker++) {
+        const uint64_t before = worker < previous.workerIterations.size() ? previous.workerIterations[worker] : 0;
+        workerRates[worker] = (current.workerIterations[worker] - before) / intervalSeconds;
+        if (workerRates[worker] == 0) continue;
+        activeWorkers++;
+        if (slowest == UINT64_MAX || workerRates[worker] < workerRates[slowest]) slowest = worker;
+    }
+
+    if (settings.progressBar) {
+        constexpr uint64_t barWidth = 30;
+        const double fraction = tileCount > 0 ? static_cast<double>(completed) / tileCount : 1;
+        const uint64_t filled = static_cast<uint64_t>(fraction * barWidth);
+        std::ostringstream line;
+        line << "\r[" << std::string(filled, '#') << std::string(barWidth - filled, '.') << "] " << std::fixed << std::setprecision(1) << std::setw(5) << fraction * 100
+             << "% " << completed << "/" << tileCount << " tiles  " << formatQuantity(intervalRate) << "iter/s  ETA " << (etaKnown ? formatDuration(eta) : "--");
+        if (activeWorkers > 1) line << "  slowest: worker " << slowest << " at " << formatQuantity(workerRates[slowest]) << "iter/s";
+        // Pads over whatever is left of a longer previous line
+        line << "   ";
+        std::cerr << line.str() << std::flush;
+    }
+
+    if (!settings.metricsPath.empty()) {
+        std::ostringstream metrics;
+        metrics << "# TYPE mig_tiles gauge\nmig_tiles " << tileCount << "\n"
+                << "# TYPE mig_tiles_completed gauge\nmig_tiles_completed " << completed << "\n"
+                << "# TYPE mig_eta_seconds gauge\nmig_eta_seconds " << (etaKnown ? std::to_string(eta) : "NaN") << "\n"
+                << "# TYPE mig_iterations_per_second gauge\nmig_iterations_per_second " << intervalRate << "\n"
+                << "# TYPE mig_output_seconds_total counter\nmig_output_seconds_total " << telemetry.outputNanoseconds.load(std::memory_order_relaxed) * 1e-9 << "\n";
+        {
+            std::lock_guard<std::mutex> lock(telemetry.countersMutex);
+            const std::deque<WorkerCounters> &counters = telemetry.counters;
+            const auto perWorker = [&metrics, &counters](const char *name, const char *type, auto value) {
+                metrics << "# TYPE " << name << " " << type << "\n";
+                for (uint64_t worker = 0; worker < counters.size(); worker++) metrics << name << "{worker=\"" << worker << "\"} " << value(worker) << "\n";
+            };
+            perWorker("mig_worker_thread_tiles_total", "counter", [&counters](uint64_t worker) { return counters[worker].threadTiles.load(std::memory_order_relaxed); });
+            perWorker("mig_worker_pixels_total", "counter", [&counters](uint64_t worker) { return counters[worker].pixels.load(std::memory_order_relaxed); });
+            perWorker("mig_worker_iterations_total", "counter", [&counters](uint64_t worker) { return counters[worker].iterations.load(std::memory_order_relaxed); });
+            perWorker("mig_worker_compute_seconds_total", "counter",
+                      [&counters](uint64_t worker) { return counters[worker].computeNanoseconds.load(std::memory_order_relaxed) * 1e-9; });
+            perWorker("mig_worker_iterations_per_second", "gauge", [&workerRates](uint64_t worker) { return worker < workerRates.size() ? workerRates[worker] : 0.0; });
+        }
+
+        // Scrapers never see a half written file
+        std::filesystem::path temporaryPath = settings.metricsPath;
+        temporaryPath += ".tmp";
+        {
+            std::ofstream metricsFile(temporaryPath, std::ios::trunc);
+            if (!metricsFile || !(metricsFile << metrics.str()) || !metricsFile.flush()) throw std::system_error(errno, std::generic_category(), temporaryPath.string());
+        }
+        std::filesystem::rename(temporaryPath, settings.metricsPath);
+    }
+    previous = current;
+}
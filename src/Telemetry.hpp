@@ -0,0 +1,122 @@
+#ifndef TELEMETRY_HPP_INCLUDED
+#define TELEMETRY_HPP_INCLUDED
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Metrics file specification:
+    Prometheus text exposition format, rewritten as a whole every interval (see TelemetrySettings), e.g. for node_exporter's textfile collector.
+    Counters ending in _total count from the creation of the render state (see RenderState.hpp), per worker ones are labelled with the worker's index.
+        mig_tiles                                      tiles of the image
+        mig_tiles_completed                            tiles complete in pConfig.tileCompletion
+        mig_eta_seconds                                estimated time until every tile is complete, NaN until the first tile of the run completes
+        mig_iterations_per_second                      iterations of every worker per second over the last interval
+        mig_output_seconds_total                       time spent coloring and encoding output
+        mig_worker_thread_tiles_total{worker="i"}      thread tiles computed
+        mig_worker_pixels_total{worker="i"}            pixels iterated, subsamples included
+        mig_worker_iterations_total{worker="i"}        iterations the kernels ran, pixels caught in a period count up to the iteration that caught them
+        mig_worker_compute_seconds_total{worker="i"}   time spent computing thread tiles
+        mig_worker_iterations_per_second{worker="i"}   iterations of the worker per second over the last interval
+*/
+
+// Counters of one worker thread. Only the worker writes them and the reporter reads them concurrently, both with relaxed atomics on a cache line of their own
+struct alignas(64) WorkerCounters {
+    std::atomic<uint64_t> threadTiles{0};
+    std::atomic<uint64_t> pixels{0};
+    std::atomic<uint64_t> iterations{0};
+    std::atomic<uint64_t> computeNanoseconds{0};
+};
+
+// Every counter of one render state, so renders of different states (e.g. concurrent RenderContexts) don't count into each other's totals and ETA
+struct RenderTelemetry {
+    // Counters of every worker index used so far, a deque keeps them in place while it grows. Guarded by countersMutex
+    std::mutex countersMutex;
+    std::deque<WorkerCounters> counters;
+
+    std::atomic<uint64_t> outputNanoseconds{0};
+    std::atomic<uint64_t> tilesComputed{0};
+    std::atomic<uint64_t> tileIterations{0};
+    std::atomic<double> tileEstimatedCost{0};
+
+    // Guarded by estimateMutex
+    std::mutex estimateMutex;
+    std::vector<double> estimatedTileCosts;
+};
+
+// Counters of worker worker in the calling thread's render state, which live as long as the state. Workers of successive TileSchedulers share the counters of their index
+WorkerCounters &workerCounters(uint64_t worker);
+
+// Makes countKernelWork on the calling thread count into counters, nullptr stops counting
+void bindWorkerCounters(WorkerCounters *counters) noexcept;
+
+// Counters bound to the calling thread, nullptr if there are none
+WorkerCounters *boundWorkerCounters() noexcept;
+
+// Adds pixels iterated pixels, which actually ran iterations iterations between them, to the calling thread's counters if it has any
+void countKernelWork(uint64_t pixels, uint64_t iterations) noexcept;
+
+// Adds the time spent coloring or encoding output
+void countOutputTime(std::chrono::steady_clock::duration duration) noexcept;
+
+// Records a tile completed by computing it with iterations iterations, which the cost estimate expected to take estimatedCost (0 without one).
+// The ETA extrapolates the remaining tiles from these
+void countTileCompleted(uint64_t iterations, double estimatedCost) noexcept;
+
+// Estimated cost of every tile by tile index for the ETA (see CostEstimate), empty to extrapolate from the tiles computed so far instead
+void setTileCostEstimate(const std::vector<double> &tileCosts);
+
+// What a TelemetryReporter shows and where
+struct TelemetrySettings {
+    // Redraws a progress bar on stderr every interval
+    bool progressBar;
+    // Rewrites the metrics file at this path every interval, unless it is empty
+    std::filesystem::path metricsPath;
+    // Seconds between reports
+    double interval;
+};
+
+// Reports the progress of pConfig.tileCompletion and the counters of the constructing thread's render state on its own thread while it lives.
+// The ETA is an iteration cost model: with a tile cost estimate the remaining tiles take their estimated cost at the time per estimated cost
+// of the tiles this run computed, without one they are expected to cost the mean iterations of the tiles this run computed, at the rate of iterations per second this run reached. The slowest active worker of an interval is shown next to the bar, to spot stragglers.
+// pConfig must not be replaced while a reporter lives
+class TelemetryReporter {
+   public:
+    explicit TelemetryReporter(const TelemetrySettings &telemetrySettings);
+    TelemetryReporter(const TelemetryReporter &) = delete;
+    TelemetryReporter &operator=(const TelemetryReporter &) = delete;
+    // Reports a last time and ends the progress bar's line
+    ~TelemetryReporter();
+
+   private:
+    // Totals of every counter at one point in time
+    struct Snapshot {
+        std::chrono::steady_clock::time_point time;
+        std::vector<uint64_t> workerIterations;
+        uint64_t iterations;
+        uint64_t tilesComputed;
+        uint64_t tileIterations;
+        double tileEstimatedCost;
+    };
+
+    Snapshot snapshot() const;
+    void run();
+    void report();
+
+    TelemetrySettings settings;
+    RenderTelemetry &telemetry;
+    Snapshot start;
+    Snapshot previous;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable stopped;
+    std::thread reporter;
+};
+
+#endif  // TELEMETRY_HPP_INCLUDED
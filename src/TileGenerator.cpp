@@ -1,54 +1,465 @@
 #include "Mandelbrotset.hpp"
+#include "Perturbation.hpp"
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
 #include "Saves.hpp"
+#include "TileGenerator.hpp"
 
-#include <omp.h>
-
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <cstdint>
+#include <vector>
+
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+// Thread tiles are subdivided until a side is at most this many pixels, leaves are computed completely
+static constexpr uint64_t marianiSilverLeafSize = 16;
+
+// Single precision is picked when neighbouring pixels lie at least this many float ulps apart at the tile's largest coordinate,
+// rounding errors amplified by the iteration then stay well below the pixel spacing
+static constexpr double singlePrecisionPixelUlps = 64;
+// Iteration counts are kept in float as well, they are exact up to 2^24
+static constexpr int64_t singlePrecisionMaxIterations = 1LL << 24;
+// Orbits can't be compared closer than a few float ulps of |z| <= 2, periodicity checks of single precision tiles use at least this precision
+static constexpr double singlePrecisionPeriodicityPrecision2 = (8 * FLT_EPSILON) * (8 * FLT_EPSILON);
+
+// Rectangle of thread tile pixels with inclusive bounds
+struct PixelRectangle {
+    uint64_t x0;
+    uint64_t y0;
+    uint64_t x1;
+    uint64_t y1;
+};
+
+// Computes every queued pixel with the kernel the render mode asks for. Unless unresolved is nullptr it receives the pixels that ran out of iterations
+static void computeQueue(const PreparedTile &tile, const std::vector<QueuedPixel> &queue, std::vector<Sample> &samples, std::vector<EscapeState> *unresolved) noexcept {
+    if (mConfig.renderFlags & DeepZoomRender) {
+        computeIterationsPerturbed(tile.reference, queue.data(), queue.size(), samples.data());
+    } else if (unresolved != nullptr) {
+        unresolved->resize(queue.size());
+        unresolved->resize(computeIterationsQueue(tile.context, queue.data(), queue.size(), samples.data(), unresolved->data()));
+    } else {
+        computeIterationsQueue(tile.context, queue.data(), queue.size(), samples.data(), nullptr);
+    }
+}
+
+// Mariani-Silver subdivision of the thread tile at pixel xOffset and yOffset. The level's rectangles have their border pixels computed together,
+// a rectangle whose border is entirely interior is filled, because the Mandelbrot set is simply connected nothing inside it can escape.
+// Rectangles with any escaping border pixel are split into quadrants sharing their middle row and column, small ones are computed completely.
+// Border pixels with the same whole iteration count still differ in finalMagnitude2, so exterior rectangles are never filled.
+// With unresolved every pixel that ran out of iterations is appended to it, such pixels may still escape with a larger budget and never let a rectangle be filled.
+static void marianiSilver(uint64_t xOffset, uint64_t yOffset, uint64_t width, uint64_t height, const PreparedTile &tile,
+                          std::vector<QueuedPixel> &queue, std::vector<Sample> &samples, std::vector<EscapeState> *unresolved) noexcept {
+    // 0 for pixels not computed yet, 1 for computed ones and 2 for unresolved ones
+    thread_local std::vector<unsigned char> known;
+    thread_local std::vector<EscapeState> levelUnresolved;
+    known.assign(width * height, 0);
+    samples.resize(width * height);
+    if (unresolved != nullptr) unresolved->clear();
+
+    // Queues the pixels of the rectangle [x0, x1] x [y0, y1] that aren't known yet
+    const auto enqueue = [&](uint64_t x0, uint64_t y0, uint64_t x1, uint64_t y1) {
+        for (uint64_t j = y0; j <= y1; j++) {
+            for (uint64_t i = x0; i <= x1; i++) {
+                const uint64_t index = j * width + i;
+                if (known[index]) continue;
+                known[index] = 1;
+                queue.push_back({.x = xOffset + i, .y = yOffset + j, .index = index});
+            }
+        }
+    };
+
+    std::vector<PixelRectangle> level = {{.x0 = 0, .y0 = 0, .x1 = width - 1, .y1 = height - 1}};
+    std::vector<PixelRectangle> nextLevel;
+    while (!level.empty()) {
+        queue.clear();
+        for (const PixelRectangle &rectangle : level) {
+            if (rectangle.x1 - rectangle.x0 < marianiSilverLeafSize || rectangle.y1 - rectangle.y0 < marianiSilverLeafSize) {
+                enqueue(rectangle.x0, rectangle.y0, rectangle.x1, rectangle.y1);
+            } else {
+                enqueue(rectangle.x0, rectangle.y0, rectangle.x1, rectangle.y0);
+                enqueue(rectangle.x0, rectangle.y1, rectangle.x1, rectangle.y1);
+                enqueue(rectangle.x0, rectangle.y0, rectangle.x0, rectangle.y1);
+                enqueue(rectangle.x1, rectangle.y0, rectangle.x1, rectangle.y1);
+            }
+        }
+        computeQueue(tile, queue, samples, unresolved != nullptr ? &levelUnresolved : nullptr);
+        if (unresolved != nullptr) {
+            for (const EscapeState &state : levelUnresolved) known[(state.y - yOffset) * width + (state.x - xOffset)] = 2;
+            unresolved->insert(unresolved->end(), levelUnresolved.begin(), levelUnresolved.end());
+        }
+
+        nextLevel.clear();
+        for (const PixelRectangle &rectangle : level) {
+            if (rectangle.x1 - rectangle.x0 < marianiSilverLeafSize || rectangle.y1 - rectangle.y0 < marianiSilverLeafSize) continue;
+
+            const auto isInterior = [&](uint64_t index) { return samples[index].iterations == mConfig.maxIterations && known[index] != 2; };
+            bool interior = true;
+            for (uint64_t i = rectangle.x0; i <= rectangle.x1 && interior; i++) {
+                interior = isInterior(rectangle.y0 * width + i) && isInterior(rectangle.y1 * width + i);
+            }
+            for (uint64_t j = rectangle.y0; j <= rectangle.y1 && interior; j++) {
+                interior = isInterior(j * width + rectangle.x0) && isInterior(j * width + rectangle.x1);
+            }
+
+            if (interior) {
+                for (uint64_t j = rectangle.y0 + 1; j < rectangle.y1; j++) {
+                    for (uint64_t i = rectangle.x0 + 1; i < rectangle.x1; i++) {
+                        known[j * width + i] = 1;
+                        samples[j * width + i].iterations = mConfig.maxIterations;
+                        samples[j * width + i].finalMagnitude2 = 0;
+                        samples[j * width + i].distance = 0;
+                        samples[j * width + i].normalAngle = 0;
+                    }
+                }
+                continue;
+            }
+
+            const uint64_t xMiddle = (rectangle.x0 + rectangle.x1) / 2;
+            const uint64_t yMiddle = (rectangle.y0 + rectangle.y1) / 2;
+            nextLevel.push_back({.x0 = rectangle.x0, .y0 = rectangle.y0, .x1 = xMiddle, .y1 = yMiddle});
+            nextLevel.push_back({.x0 = xMiddle, .y0 = rectangle.y0, .x1 = rectangle.x1, .y1 = yMiddle});
+            nextLevel.push_back({.x0 = rectangle.x0, .y0 = yMiddle, .x1 = xMiddle, .y1 = rectangle.y1});
+            nextLevel.push_back({.x0 = xMiddle, .y0 = yMiddle, .x1 = rectangle.x1, .y1 = rectangle.y1});
+        }
+        level.swap(nextLevel);
+    }
+}
+
+// Whether pixels pixelStep apart stay far enough apart in single precision at the tile's largest coordinate, see singlePrecisionPixelUlps
+static bool singlePrecisionResolves(const PreparedTile &tile, double pixelStep) noexcept {
+    // Orbits of points that don't escape stay within |z| <= 2, so coordinates smaller than that don't lower the ulp that matters
+    double magnitude = 2;
+    for (const double cReal : tile.cReal) magnitude = std::max(magnitude, std::abs(cReal));
+    for (const double cImag : tile.cImag) magnitude = std::max(magnitude, std::abs(cImag));
+    return pixelStep >= singlePrecisionPixelUlps * magnitude * FLT_EPSILON;
+}
 
-extern MandelbrotsetConfiguration mConfig;
-extern TileConfiguration tConfig;
-extern ProgressConfiguration pConfig;
+void prepareTile(uint64_t tileIndex, PreparedTile &tile) {
+    const uint64_t tileXOffset = tConfig.tileWidth() * (tileIndex % tConfig.tileGridWidth);
+    const uint64_t tileYOffset = tConfig.tileHeight() * (tileIndex / tConfig.tileGridWidth);
 
-void tileGenerator(uint64_t tileIndex, unsigned char* output) noexcept {
+    // Same interpolation as computeIterationsVector: ((1 - (x / m)) * a) + ((x / m) * b). The view is read into locals first, the loops would reload it through the bound state
+    const uint64_t imageWidth = tConfig.imageWidth;
+    const uint64_t imageHeight = tConfig.imageHeight;
+    const double startReal = mConfig.startReal, endReal = mConfig.endReal, startImag = mConfig.startImag, endImag = mConfig.endImag;
+    tile.cReal.resize(tConfig.tileWidth());
+    for (uint64_t i = 0; i < tile.cReal.size(); i++) {
+        const double t = static_cast<double>(tileXOffset + i) / (imageWidth - 1);
+        tile.cReal[i] = (1 - t) * startReal + t * endReal;
+    }
+    tile.cImag.resize(tConfig.tileHeight());
+    for (uint64_t j = 0; j < tile.cImag.size(); j++) {
+        const double t = static_cast<double>(tileYOffset + j) / (imageHeight - 1);
+        tile.cImag[j] = (1 - t) * startImag + t * endImag;
+    }
+    const double pixelStep = std::min(std::abs(mConfig.pixelStepReal(tConfig.imageWidth)), std::abs(mConfig.pixelStepImag(tConfig.imageHeight)));
+    const bool singlePrecision = !(mConfig.renderFlags & (DeepZoomRender | DoublePrecisionRender | DistanceRender)) && mConfig.maxIterations <= singlePrecisionMaxIterations &&
+                                 singlePrecisionResolves(tile, pixelStep);
+
+    tile.context = {
+        .cReal = tile.cReal.data(),
+        .cImag = tile.cImag.data(),
+        .x = tileXOffset,
+        .y = tileYOffset,
+        .maxIterations = mConfig.maxIterations,
+        .bailoutRadius = mConfig.bailoutRadius,
+        .periodicityPrecision2 = singlePrecision ? std::max(mConfig.periodicityPrecision2, singlePrecisionPeriodicityPrecision2) : mConfig.periodicityPrecision2,
+        .periodicitySavePeriod = mConfig.periodicitySavePeriod,
+        .precision = singlePrecision ? SinglePrecision : DoublePrecision,
+        .formula = mConfig.formula,
+        .juliaReal = mConfig.juliaReal,
+        .juliaImag = mConfig.juliaImag,
+        .distances = (mConfig.renderFlags & DistanceRender) != 0
+    };
+
+    // Deep zooms share one high precision reference orbit at the center of the tile, or the one shared by every tile
+    const ReferenceOrbit *orbit = &tile.orbit;
+    if (mConfig.renderFlags & DeepZoomRender) {
+        const ReferenceOrbit *sharedReferenceOrbit = boundRenderState().sharedReferenceOrbit;
+        if (sharedReferenceOrbit != nullptr) {
+            orbit = sharedReferenceOrbit;
+        } else {
+            computeTileReferenceOrbit(tileIndex, tile.orbit);
+        }
+    }
+    tile.reference = orbit->reference(mConfig.pixelStepReal(tConfig.imageWidth), mConfig.pixelStepImag(tConfig.imageHeight));
+    tile.reference.distances = tile.context.distances;
+}
+
+void shareReferenceOrbit(const ReferenceOrbit *orbit) {
+    boundRenderState().sharedReferenceOrbit = orbit;
+}
+
+void threadTileGenerator(uint64_t tileIndex, uint64_t threadIndex, const PreparedTile &tile, StoredSample* output, uint64_t pass, SampleStore *store) noexcept {
     const uint64_t tileWidth     = tConfig.tileWidth();
     const uint64_t tileHeight    = tConfig.tileHeight();
-    const uint64_t threadWidth   = tConfig.threadWidth();
-    const uint64_t threadHeight  = tConfig.threadHeight();
 
     const uint64_t tileX         = tileIndex % tConfig.tileGridWidth;
     const uint64_t tileY         = tileIndex / tConfig.tileGridWidth;
     const uint64_t tileXOffset   = tileWidth * tileX;
     const uint64_t tileYOffset   = tileHeight * tileY;
 
-    omp_set_num_threads(pConfig.threadsUsed);
-    #pragma omp parallel for schedule(dynamic, 1)
-    for (uint64_t threadIndex = 0; threadIndex < pConfig.threadCount; threadIndex++) {
-        const uint64_t threadX       = threadIndex % tConfig.threadGridWidth;
-        const uint64_t threadY       = threadIndex / tConfig.threadGridWidth;
-        const uint64_t threadXOffset = threadWidth * threadX;
-        const uint64_t threadYOffset = threadHeight * threadY;
+    const uint64_t threadX       = threadIndex % tConfig.threadGridWidth;
+    const uint64_t threadY       = threadIndex / tConfig.threadGridWidth;
+    const uint64_t threadXOffset = tConfig.threadWidth() * threadX;
+    const uint64_t threadYOffset = tConfig.threadHeight() * threadY;
+    // Thread tiles at the image's right and bottom edges are cut off, the ones entirely past it are empty
+    const uint64_t threadWidth   = tConfig.threadWidthAt(tileX, threadX);
+    const uint64_t threadHeight  = tConfig.threadHeightAt(tileY, threadY);
+
+    // Every worker keeps its own queue and sample buffer, reused between thread tiles
+    thread_local std::vector<QueuedPixel> queue;
+    thread_local std::vector<Sample> samples;
+    thread_local std::vector<EscapeState> unresolvedStates;
+    std::vector<EscapeState> *unresolved = store != nullptr && mConfig.escalates() ? &unresolvedStates : nullptr;
+    // Distances only have a place to go in a store
+    DistanceSample *distances = store != nullptr ? store->distances(tileIndex) : nullptr;
+
+    // The tile's unresolved pixels are dealt out evenly over its thread tiles within the image, wherever they lie in the tile
+    if (pass == escalationPass) {
+        if (unresolved == nullptr || threadWidth == 0 || threadHeight == 0) return;
+        const uint64_t columns = (tConfig.tileWidthAt(tileX) + tConfig.threadWidth() - 1) / tConfig.threadWidth();
+        const uint64_t rows = (tConfig.tileHeightAt(tileY) + tConfig.threadHeight() - 1) / tConfig.threadHeight();
+        const uint64_t share = threadY * columns + threadX;
+        uint64_t count = 0;
+        const EscapeState *states = store->unresolved(tileIndex, count);
+        const uint64_t begin = count * share / (columns * rows);
+        const uint64_t end = count * (share + 1) / (columns * rows);
+        unresolvedStates.resize(end - begin);
+        unresolvedStates.resize(computeIterationsResumed(tile.context, states + begin, end - begin, store->tileBudget(tileIndex), output, tileWidth, unresolvedStates.data()));
+        store->addUnresolved(tileIndex, unresolvedStates.data(), unresolvedStates.size());
+        return;
+    }
+    if (threadWidth == 0 || threadHeight == 0) return;
+
+    // A progressive pass only computes its own pixels of the thread tile, there is nothing to subdivide
+    if (pass != allPasses) {
+        const uint64_t stride = progressiveStride(pass);
+        queue.clear();
+        samples.resize(threadWidth * threadHeight);
+        for (uint64_t j = 0; j < threadHeight; j++) {
+            const uint64_t y = tileYOffset + threadYOffset + j;
+            if (y % stride != 0) continue;
+            for (uint64_t i = 0; i < threadWidth; i++) {
+                const uint64_t x = tileXOffset + threadXOffset + i;
+                if (x % stride != 0) continue;
+                // Pixels on the grid of the previous pass are already computed
+                if (pass > 0 && x % (2 * stride) == 0 && y % (2 * stride) == 0) continue;
+                queue.push_back({.x = x, .y = y, .index = j * threadWidth + i});
+            }
+        }
+        computeQueue(tile, queue, samples, unresolved);
+        if (unresolved != nullptr) store->addUnresolved(tileIndex, unresolved->data(), unresolved->size());
+
+        for (const QueuedPixel &pixel : queue) {
+            const Sample &sample = samples[pixel.index];
+            const uint64_t pixelIndex = (pixel.y - tileYOffset) * tileWidth + (pixel.x - tileXOffset);
+            output[pixelIndex] = {.iterations = sample.iterations, .finalMagnitude2 = sample.finalMagnitude2};
+            if (distances != nullptr) distances[pixelIndex] = {.distance = sample.distance, .normalAngle = sample.normalAngle};
+        }
+        return;
+    }
 
-        Sample samples[8];
+    // Subdivision relies on the set's interior being simply connected, which isn't known for the Burning Ship, so it is rendered plainly
+    const bool subdivides = (mConfig.renderFlags & MarianiSilverRender) && mConfig.formula != BurningShipFormula;
+    // Plain renders iterate the thread tile's rows straight into the tile, StoredSamples have no room for distances
+    if (!(mConfig.renderFlags & DeepZoomRender) && !subdivides && !tile.context.distances) {
+        EscapeState *states = nullptr;
+        if (unresolved != nullptr) {
+            unresolved->resize(threadWidth * threadHeight);
+            states = unresolved->data();
+        }
+        const uint64_t count = computeIterationsRows(tile.context, tileXOffset + threadXOffset, tileYOffset + threadYOffset, threadWidth, threadHeight,
+                                                     output + threadYOffset * tileWidth + threadXOffset, tileWidth, states);
+        if (unresolved != nullptr) store->addUnresolved(tileIndex, states, count);
+        return;
+    }
+
+    if (subdivides) {
+        marianiSilver(tileXOffset + threadXOffset, tileYOffset + threadYOffset, threadWidth, threadHeight, tile, queue, samples, unresolved);
+        if (unresolved != nullptr) store->addUnresolved(tileIndex, unresolved->data(), unresolved->size());
+    } else {
+        queue.clear();
+        samples.resize(threadWidth * threadHeight);
         for (uint64_t j = 0; j < threadHeight; j++) {
             const uint64_t y = tileYOffset + threadYOffset + j;
-            for (uint64_t i = 0; i < threadWidth; i += 8) {
+            for (uint64_t i = 0; i < threadWidth; i++) {
                 const uint64_t x = tileXOffset + threadXOffset + i;
+                queue.push_back({.x = x, .y = y, .index = j * threadWidth + i});
+            }
+        }
+        computeQueue(tile, queue, samples, nullptr);
+    }
 
-                computeIterationsVector(x, y, samples);
+    for (uint64_t j = 0; j < threadHeight; j++) {
+        for (uint64_t i = 0; i < threadWidth; i++) {
+            const uint64_t pixelIndex = ((threadYOffset + j) * tileWidth + (threadXOffset + i));
+            const Sample &sample = samples[j * threadWidth + i];
+            output[pixelIndex] = {.iterations = sample.iterations, .finalMagnitude2 = sample.finalMagnitude2};
+            if (distances != nullptr) distances[pixelIndex] = {.distance = sample.distance, .normalAngle = sample.normalAngle};
+        }
+    }
+}
 
-                uint64_t outX = i;
-                const uint64_t &outY = j;
-                int sampleIndex = 0;
-                for (; sampleIndex < 8 && outX < threadWidth; outX++) {
-                    const uint64_t pixelIndex = ((threadYOffset + outY) * tileWidth + (threadXOffset + outX));
-                    Sample &sample = samples[sampleIndex];
+// Uniform number in [0, 1) derived from index by the splitmix64 finalizer, the same in every thread tile and run
+static double jitter(uint64_t index) noexcept {
+    index += 0x9E3779B97F4A7C15ULL;
+    index = (index ^ (index >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    index = (index ^ (index >> 27)) * 0x94D049BB133111EBULL;
+    index ^= index >> 31;
+    return static_cast<double>(index >> 11) * 0x1.0p-53;
+}
 
-                    char brightness = sample.iterations == mConfig.maxIterations ? 0 : std::min(255LL * sample.iterations / 200LL, 255LL);
-                    output[pixelIndex] = brightness;
-                    sampleIndex++;
-                }
+// Channel of a colored pixel, 16 bit channels are big-endian
+static uint64_t channelValue(const unsigned char *pixel, uint64_t channel, bool sixteenBit) noexcept {
+    return sixteenBit ? (static_cast<uint64_t>(pixel[2 * channel]) << 8) | pixel[2 * channel + 1] : pixel[channel];
+}
+
+// Largest difference of a channel between two colored pixels as a fraction of the channel's range
+static double colorDifference(const unsigned char *a, const unsigned char *b, bool sixteenBit) noexcept {
+    uint64_t difference = 0;
+    for (uint64_t channel = 0; channel < 3; channel++) {
+        const uint64_t valueA = channelValue(a, channel, sixteenBit), valueB = channelValue(b, channel, sixteenBit);
+        difference = std::max(difference, valueA > valueB ? valueA - valueB : valueB - valueA);
+    }
+    return static_cast<double>(difference) / (sixteenBit ? 65535 : 255);
+}
+
+void supersampleThreadTile(uint64_t tileIndex, uint64_t threadIndex, const PreparedTile &tile, const SupersampleTarget &target) noexcept {
+    const uint64_t tileWidth     = tConfig.tileWidth();
+    const uint64_t tileHeight    = tConfig.tileHeight();
+
+    const uint64_t tileX         = tileIndex % tConfig.tileGridWidth;
+    const uint64_t tileY         = tileIndex / tConfig.tileGridWidth;
+    const uint64_t tileXOffset   = tileWidth * tileX;
+    const uint64_t tileYOffset   = tileHeight * tileY;
+    const uint64_t threadX       = threadIndex % tConfig.threadGridWidth;
+    const uint64_t threadY       = threadIndex / tConfig.threadGridWidth;
+    const uint64_t threadXOffset = tConfig.threadWidth() * threadX;
+    const uint64_t threadYOffset = tConfig.threadHeight() * threadY;
+    // Only the part of the tile within the image was colored, neighbours past its edge don't exist
+    const uint64_t threadWidth   = tConfig.threadWidthAt(tileX, threadX);
+    const uint64_t threadHeight  = tConfig.threadHeightAt(tileY, threadY);
+    const uint64_t tileColumns   = tConfig.tileWidthAt(tileX);
+    const uint64_t tileRows      = tConfig.tileHeightAt(tileY);
+
+    const SupersampleSettings &settings = *target.settings;
+    const uint64_t factor = settings.factor;
+    const uint64_t subsamples = factor * factor;
+    const uint64_t bytesPerPixel = target.colorizer->bytesPerPixel();
+    const bool sixteenBit = target.colorizer->bitDepth() == 16;
+    const bool deep = mConfig.renderFlags & DeepZoomRender;
+    if (threadWidth == 0 || threadHeight == 0 || factor < 2) return;
+
+    // Tile pixels of the thread tile that differ enough from a neighbour
+    thread_local std::vector<uint64_t> pixels;
+    pixels.clear();
+    for (uint64_t y = threadYOffset; y < threadYOffset + threadHeight; y++) {
+        for (uint64_t x = threadXOffset; x < threadXOffset + threadWidth; x++) {
+            const uint64_t index = y * tileWidth + x;
+            const unsigned char *color = target.colors + index * bytesPerPixel;
+            const auto differs = [&](uint64_t neighbour) { return colorDifference(color, target.colors + neighbour * bytesPerPixel, sixteenBit) > settings.adaptiveThreshold; };
+            if (settings.adaptiveThreshold <= 0 || (x > 0 && differs(index - 1)) || (x + 1 < tileColumns && differs(index + 1)) ||
+                (y > 0 && differs(index - tileWidth)) || (y + 1 < tileRows && differs(index + tileWidth))) {
+                pixels.push_back(index);
             }
         }
     }
-}
\ No newline at end of file
+    if (pixels.empty()) return;
+
+    // The subsamples form an image factor times the size of the real one, subsample s of image pixel x lies in column x * factor + s.
+    // Each of the pixel's factor columns lies at the center of its cell, or anywhere within it when jittered
+    thread_local std::vector<double> subsampleReal;
+    thread_local std::vector<double> subsampleImag;
+    const double stepReal = mConfig.pixelStepReal(tConfig.imageWidth);
+    const double stepImag = mConfig.pixelStepImag(tConfig.imageHeight);
+    subsampleReal.resize(threadWidth * factor);
+    for (uint64_t i = 0; i < subsampleReal.size(); i++) {
+        const uint64_t column = (tileXOffset + threadXOffset) * factor + i;
+        const double offset = settings.jittered ? jitter(2 * column) : 0.5;
+        subsampleReal[i] = tile.cReal[threadXOffset + i / factor] + stepReal * ((i % factor + offset) / factor - 0.5);
+    }
+    subsampleImag.resize(threadHeight * factor);
+    for (uint64_t j = 0; j < subsampleImag.size(); j++) {
+        const uint64_t row = (tileYOffset + threadYOffset) * factor + j;
+        const double offset = settings.jittered ? jitter(2 * row + 1) : 0.5;
+        subsampleImag[j] = tile.cImag[threadYOffset + j / factor] + stepImag * ((j % factor + offset) / factor - 0.5);
+    }
+
+    thread_local std::vector<QueuedPixel> queue;
+    thread_local std::vector<Sample> samples;
+    queue.clear();
+    for (uint64_t pixel = 0; pixel < pixels.size(); pixel++) {
+        const uint64_t x = tileXOffset + pixels[pixel] % tileWidth;
+        const uint64_t y = tileYOffset + pixels[pixel] / tileWidth;
+        for (uint64_t j = 0; j < factor; j++) {
+            for (uint64_t i = 0; i < factor; i++) queue.push_back({.x = x * factor + i, .y = y * factor + j, .index = pixel * subsamples + j * factor + i});
+        }
+    }
+    samples.resize(queue.size());
+
+    if (deep) {
+        // The reference point keeps its place in the subsample image, which has factor times finer steps
+        PerturbationReference reference = tile.reference;
+        reference.referenceX = reference.referenceX * factor + (factor - 1) / 2.0;
+        reference.referenceY = reference.referenceY * factor + (factor - 1) / 2.0;
+        reference.stepReal /= factor;
+        reference.stepImag /= factor;
+        // Subsamples only go into colors
+        reference.distances = false;
+        computeIterationsPerturbed(reference, queue.data(), queue.size(), samples.data());
+    } else {
+        TileContext context = tile.context;
+        context.cReal = subsampleReal.data();
+        context.cImag = subsampleImag.data();
+        context.x = (tileXOffset + threadXOffset) * factor;
+        context.y = (tileYOffset + threadYOffset) * factor;
+        context.distances = false;
+        // Subsamples lie factor times closer than the pixels single precision was picked for, which it may no longer resolve
+        if (context.precision == SinglePrecision && !singlePrecisionResolves(tile, std::min(std::abs(stepReal), std::abs(stepImag)) / factor)) {
+            context.precision = DoublePrecision;
+            context.periodicityPrecision2 = mConfig.periodicityPrecision2;
+        }
+        computeIterationsQueue(context, queue.data(), queue.size(), samples.data(), nullptr);
+    }
+
+    thread_local std::vector<StoredSample> stored;
+    thread_local std::vector<unsigned char> colors;
+    stored.resize(samples.size());
+    for (uint64_t i = 0; i < samples.size(); i++) stored[i] = {.iterations = samples[i].iterations, .finalMagnitude2 = samples[i].finalMagnitude2};
+    colors.resize(stored.size() * bytesPerPixel);
+    target.colorizer->colorize(stored.data(), stored.size(), colors.data());
+
+    // Box filter over each pixel's subsamples
+    for (uint64_t pixel = 0; pixel < pixels.size(); pixel++) {
+        unsigned char *out = target.out + (pixels[pixel] / tileWidth) * target.rowSize + (pixels[pixel] % tileWidth) * bytesPerPixel;
+        for (uint64_t channel = 0; channel < 3; channel++) {
+            uint64_t sum = 0;
+            for (uint64_t s = 0; s < subsamples; s++) sum += channelValue(colors.data() + (pixel * subsamples + s) * bytesPerPixel, channel, sixteenBit);
+            const uint64_t value = (sum + subsamples / 2) / subsamples;
+            if (sixteenBit) {
+                out[2 * channel] = static_cast<unsigned char>(value >> 8);
+                out[2 * channel + 1] = static_cast<unsigned char>(value);
+            } else {
+                out[channel] = static_cast<unsigned char>(value);
+            }
+        }
+    }
+}
+
+void escalateTile(StoredSample *output, int64_t budget) noexcept {
+    const uint64_t count = tConfig.tileWidth() * tConfig.tileHeight();
+    for (uint64_t i = 0; i < count; i++) {
+        if (output[i].iterations == budget) output[i].iterations = mConfig.maxIterations;
+    }
+}
+
+void tileGenerator(uint64_t tileIndex, StoredSample* output) noexcept {
+    thread_local PreparedTile tile;
+    prepareTile(tileIndex, tile);
+    for (uint64_t threadIndex = 0; threadIndex < pConfig.threadCount; threadIndex++) threadTileGenerator(tileIndex, threadIndex, tile, output, allPasses, nullptr);
+}
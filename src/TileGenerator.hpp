@@ -1,7 +1,82 @@
 #ifndef TILEGENERATOR_HPP_INCLUDED
-#define TILEGENERATOR_HPP_INLCUDED
+#define TILEGENERATOR_HPP_INCLUDED
 #include <cstdint>
+#include <vector>
 
-void tileGenerator(uint64_t tileIndex, unsigned char* output) noexcept ;
+#include "Mandelbrotset.hpp"
+#include "Perturbation.hpp"
+#include "Colorizer.hpp"
+#include "SampleStore.hpp"
 
-#endif  // TILEGENERATOR_HPP_INLCUDED
\ No newline at end of file
+// Everything the thread tiles of one tile share, computed once per tile by prepareTile
+struct PreparedTile {
+    std::vector<double> cReal;
+    std::vector<double> cImag;
+    ReferenceOrbit orbit;
+    TileContext context;
+    PerturbationReference reference;
+
+    PreparedTile() : cReal(), cImag(), orbit(), context(), reference() {}
+};
+
+// Passes of a ProgressiveRender. Pass p computes the pixels whose image x and y are multiples of progressiveStride(p) that no earlier pass computed:
+// 1/16 of the pixels, then 3/16 more for 1/4 of them, then the remaining 3/4. Every pass reuses the samples of the coarser ones
+constexpr uint64_t progressivePassCount = 3;
+constexpr uint64_t progressiveStride(uint64_t pass) noexcept { return 1ULL << (progressivePassCount - 1 - pass); }
+// Pass computing every pixel at once, used when rendering without ProgressiveRender
+constexpr uint64_t allPasses = UINT64_MAX;
+// Pass continuing only the unresolved pixels of a tile completed with a smaller maxIterations, see EscalationRender
+constexpr uint64_t escalationPass = UINT64_MAX - 1;
+// Pass supersampling the colored pixels of a completed tile, see supersampleThreadTile
+constexpr uint64_t supersamplePass = UINT64_MAX - 2;
+
+// Anti-aliasing by averaging the colors of a grid of subsamples per pixel
+struct SupersampleSettings {
+    // Subsamples per pixel along each axis, factor * factor per pixel. 1 disables supersampling
+    uint64_t factor;
+    // Moves every subsample column and row to a random position within its cell instead of its center, trades aliasing patterns for noise.
+    // Deep zooms always use the regular grid
+    bool jittered;
+    // Only pixels whose color differs from a neighbour's by more than this fraction of a channel's range are supersampled, 0 supersamples every pixel
+    double adaptiveThreshold;
+};
+
+// Colors of a tile supersampleThreadTile reads and refines
+struct SupersampleTarget {
+    const SupersampleSettings *settings;
+    const Colorizer *colorizer;
+    // The tile's pixels as colored from its samples, tileWidth * tileHeight of them row by row
+    const unsigned char *colors;
+    // Top left pixel of the tile in the output rows, which are rowSize bytes apart
+    unsigned char *out;
+    uint64_t rowSize;
+};
+
+// Fills tile with the kernel context of the tile with index tileIndex, and for deep zooms with the reference orbit its pixels are perturbed around
+void prepareTile(uint64_t tileIndex, PreparedTile &tile);
+
+// Makes prepareTile perturb the pixels of deep zoom tiles around orbit instead of computing an orbit per tile, nullptr goes back to orbits per tile.
+// orbit has to be placed in the current image (see placeReferenceOrbit) and outlive every tile prepared with it. Shared within the calling thread's render state
+void shareReferenceOrbit(const ReferenceOrbit *orbit);
+
+// Computes the pixels of progressive pass pass, or every pixel for allPasses, of thread tile threadIndex of the tile with index tileIndex into output,
+// which holds the tile's tileWidth * tileHeight samples row by row (the layout of a SampleStore tile). tile has to be prepared for the same tile index.
+// With EscalationRender the pixels that run out of iterations are added to the tile's unresolved pixels in store, and escalationPass continues
+// the thread tile's share of the unresolved pixels store holds for the tile. With DistanceRender the distances go to the tile's distances in store.
+// store can be nullptr when nothing is to be kept.
+void threadTileGenerator(uint64_t tileIndex, uint64_t threadIndex, const PreparedTile &tile, StoredSample* output, uint64_t pass, SampleStore *store) noexcept;
+
+// Supersamples the pixels of thread tile threadIndex of the completed tile with index tileIndex that target's settings pick and writes the average color of their subsamples to target.out.
+// The subsamples of all of them are queued into one computeIterationsQueue call (computeIterationsPerturbed for deep zooms), keeping every lane busy,
+// in double precision when the tile is single precision but its subsamples lie too close together for it
+// Neighbours are only compared within the tile, so a pixel on the tile's border is picked by its neighbours inside the tile
+void supersampleThreadTile(uint64_t tileIndex, uint64_t threadIndex, const PreparedTile &tile, const SupersampleTarget &target) noexcept;
+
+// Raises the samples in output, a tile completed with maxIterations budget, that reached budget to mConfig.maxIterations before its escalationPass.
+// These are the interior pixels, which keep their result, and the unresolved ones, which the escalationPass overwrites
+void escalateTile(StoredSample *output, int64_t budget) noexcept;
+
+// Computes the tile with index tileIndex into output on the calling thread, see TileScheduler for computing many tiles in parallel
+void tileGenerator(uint64_t tileIndex, StoredSample* output) noexcept ;
+
+#endif  // TILEGENERATOR_HPP_INCLUDED
@@ -0,0 +1,360 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "RenderState.hpp"
+#include "SampleStore.hpp"
+#include "Saves.hpp"
+#include "Telemetry.hpp"
+#include "TileGenerator.hpp"
+
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+
+// Sets bit index of a completion bit array that other threads set bits of concurrently
+static void setCompletionBit(unsigned char *completion, uint64_t index) noexcept {
+    std::atomic_ref<unsigned char>(completion[index / 8]).fetch_or(static_cast<unsigned char>(1 << (index % 8)));
+}
+
+TileScheduler::TileScheduler(uint64_t workerCount)
+    : store(nullptr),
+      queues(),
+      workers(),
+      pending(0),
+      nextQueue(0),
+      stopping(false),
+      canceled(false),
+      tileCallback(),
+      mutex(),
+      workAvailable(),
+      tileCompleted(),
+      jobs(),
+      costEstimate(nullptr),
+      unitCost(0),
+      keepPrepared(false),
+      preparedTiles() {
+    if (workerCount == 0) workerCount = 1;
+    for (uint64_t worker = 0; worker < workerCount; worker++) queues.push_back(std::make_unique<WorkerQueue>());
+    for (uint64_t worker = 0; worker < workerCount; worker++) workers.push_back(boundThread(&TileScheduler::work, this, worker));
+}
+
+TileScheduler::TileScheduler(SampleStore &sampleStore, uint64_t workerCount, bool keepPreparedTiles) : TileScheduler(workerCount) {
+    attach(sampleStore, keepPreparedTiles);
+}
+
+TileScheduler::~TileScheduler() {
+    detach();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread &worker : workers) worker.join();
+}
+
+void TileScheduler::attach(SampleStore &sampleStore, bool keepPreparedTiles) {
+    detach();
+    store = &sampleStore;
+    keepPrepared = keepPreparedTiles;
+}
+
+void TileScheduler::detach() {
+    drop();
+    std::unique_lock<std::mutex> lock(mutex);
+    tileCompleted.wait(lock, [this] { return std::ranges::all_of(jobs, [](const auto &job) { return job.second->completed; }); });
+    jobs.clear();
+    preparedTiles.clear();
+    costEstimate = nullptr;
+    unitCost = 0;
+    store = nullptr;
+}
+
+void TileScheduler::cancel() {
+    canceled = true;
+    drop();
+}
+
+void TileScheduler::resume() {
+    canceled = false;
+}
+
+void TileScheduler::setTileCallback(TileCallback callback) {
+    tileCallback = std::move(callback);
+}
+
+void TileScheduler::drop() {
+    std::vector<ThreadTile> dropped;
+    for (const std::unique_ptr<WorkerQueue> &queue : queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        pending -= queue->threadTiles.size();
+        dropped.insert(dropped.end(), queue->threadTiles.begin(), queue->threadTiles.end());
+        queue->threadTiles.clear();
+    }
+    // A job is only settled by whoever takes its remaining count to 0, a worker finishing its last running thread tile or this
+    for (const ThreadTile &threadTile : dropped) {
+        threadTile.job->dropped = true;
+        if (threadTile.job->remaining.fetch_sub(threadTile.count) == threadTile.count) settle(*threadTile.job);
+    }
+}
+
+// Whether pass leaves every pixel of the tile computed
+static bool completesTile(uint64_t pass) noexcept {
+    return pass == allPasses || pass == escalationPass || pass + 1 == progressivePassCount;
+}
+
+// Marks the tile as complete for the budget the store holds it for, journaling it unless pConfig already had it
+static void markCompleted(const SampleStore &store, uint64_t tileIndex) {
+    setCompletionBit(pConfig.tileCompletion, tileIndex);
+    const int64_t budget = store.tileBudget(tileIndex);
+    if (std::atomic_ref<int64_t>(pConfig.tileBudgets[tileIndex]).exchange(budget) != budget) journalTileCompletion(tileIndex);
+}
+
+// Error of tiles that were canceled or dropped
+static std::system_error canceledError(uint64_t tileIndex) {
+    return std::system_error(std::make_error_code(std::errc::operation_canceled), "tile " + std::to_string(tileIndex));
+}
+
+void TileScheduler::submit(uint64_t tileIndex, uint64_t pass) {
+    if (canceled) throw canceledError(tileIndex);
+    if (store->tileCompleted(tileIndex)) {
+        markCompleted(*store, tileIndex);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.contains(tileIndex)) return;
+    }
+    // Tiles completed with a smaller budget only continue their unresolved pixels, whichever pass asked for them.
+    // Raising the interior happens before any thread tile starts, as those continue unresolved pixels anywhere in the tile
+    if (store->tileEscalatable(tileIndex)) {
+        pass = escalationPass;
+        escalateTile(store->tile(tileIndex), store->tileBudget(tileIndex));
+    }
+    // The first pass over a tile starts a new list of unresolved pixels, later progressive passes add to it
+    if (pass == 0 || pass == allPasses || pass == escalationPass) store->clearUnresolved(tileIndex);
+
+    // A tile too small to hold a single thread tile has nothing to compute
+    const uint64_t threadCount = pConfig.threadCount;
+    if (threadCount == 0) {
+        if (!completesTile(pass)) return;
+        store->completeTile(tileIndex, 0);
+        markCompleted(*store, tileIndex);
+        if (tileCallback) tileCallback(tileIndex, store->tile(tileIndex));
+        return;
+    }
+
+    std::unique_ptr<TileJob> job = std::make_unique<TileJob>(tileIndex, pass, threadCount);
+    if (costEstimate != nullptr && !costEstimate->empty()) job->estimatedCost = costEstimate->tileCosts()[tileIndex];
+    prepareTile(tileIndex, job->tile);
+    enqueue(std::move(job));
+}
+
+void TileScheduler::setCostEstimate(const CostEstimate *estimate) {
+    costEstimate = estimate;
+    unitCost = 0;
+    if (estimate == nullptr || estimate->empty() || pConfig.threadCount == 0) return;
+    unitCost = std::accumulate(estimate->tileCosts().begin(), estimate->tileCosts().end(), 0.0) / (estimate->tileCosts().size() * pConfig.threadCount);
+}
+
+void TileScheduler::supersample(uint64_t tileIndex, const SupersampleSettings &settings, const Colorizer &colorizer, unsigned char *out, uint64_t rowSize) {
+    const uint64_t threadCount = pConfig.threadCount;
+    if (canceled) throw canceledError(tileIndex);
+    if (settings.factor < 2 || threadCount == 0) return;
+
+    // Tiles taken from the store without computing them are prepared again, others reuse the PreparedTile (and reference orbit) their computation had
+    std::unique_ptr<TileJob> job = std::make_unique<TileJob>(tileIndex, supersamplePass, threadCount);
+    bool prepared = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.contains(tileIndex)) throw std::logic_error("supersampling tile " + std::to_string(tileIndex) + " before waiting for its pending job");
+        const auto found = preparedTiles.find(tileIndex);
+        if (found != preparedTiles.end()) {
+            job->tile = std::move(found->second);
+            preparedTiles.erase(found);
+            prepared = true;
+        }
+    }
+    if (!prepared) prepareTile(tileIndex, job->tile);
+
+    // Every thread tile compares its pixels with their neighbours before any of them is overwritten, only the part of the tile within the image was colored
+    const uint64_t tileRowSize = tConfig.tileWidth() * colorizer.bytesPerPixel();
+    const uint64_t copiedRowSize = tConfig.tileWidthAt(tileIndex % tConfig.tileGridWidth) * colorizer.bytesPerPixel();
+    job->colors.resize(tileRowSize * tConfig.tileHeight());
+    for (uint64_t row = 0; row < tConfig.tileHeightAt(tileIndex / tConfig.tileGridWidth); row++) memcpy(job->colors.data() + row * tileRowSize, out + row * rowSize, copiedRowSize);
+    job->target = {.settings = &settings, .colorizer = &colorizer, .colors = job->colors.data(), .out = out, .rowSize = rowSize};
+    enqueue(std::move(job));
+}
+
+void TileScheduler::enqueue(std::unique_ptr<TileJob> job) {
+    TileJob *submitted = job.get();
+    const uint64_t threadCount = job->remaining.load();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.emplace(job->tileIndex, std::move(job));
+    }
+
+    // Cheap consecutive thread tiles are packed into one unit up to unitCost, the costliest units go first.
+    // Supersampling and escalation spread their work over the thread tiles differently than the estimate, they keep a unit per thread tile
+    std::vector<ThreadTile> units;
+    if (unitCost > 0 && submitted->pass != supersamplePass && submitted->pass != escalationPass) {
+        std::vector<double> threadTileCosts;
+        costEstimate->threadTileCosts(submitted->tileIndex, threadTileCosts);
+        std::vector<double> unitCosts;
+        for (uint64_t threadIndex = 0; threadIndex < threadCount; threadIndex++) {
+            if (units.empty() || unitCosts.back() + threadTileCosts[threadIndex] > unitCost) {
+                units.push_back({.job = submitted, .threadIndex = threadIndex, .count = 0});
+                unitCosts.push_back(0);
+            }
+            units.back().count++;
+            unitCosts.back() += threadTileCosts[threadIndex];
+        }
+        std::vector<uint64_t> order(units.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&unitCosts](uint64_t a, uint64_t b) { return unitCosts[a] > unitCosts[b]; });
+        std::vector<ThreadTile> sorted;
+        for (const uint64_t unit : order) sorted.push_back(units[unit]);
+        units = std::move(sorted);
+    } else {
+        // Thread tiles past the image's edge are empty and join the unit before them
+        const uint64_t tileX = submitted->tileIndex % tConfig.tileGridWidth;
+        const uint64_t tileY = submitted->tileIndex / tConfig.tileGridWidth;
+        for (uint64_t threadIndex = 0; threadIndex < threadCount; threadIndex++) {
+            const bool empty = tConfig.threadWidthAt(tileX, threadIndex % tConfig.threadGridWidth) == 0 || tConfig.threadHeightAt(tileY, threadIndex / tConfig.threadGridWidth) == 0;
+            if (units.empty() || !empty) units.push_back({.job = submitted, .threadIndex = threadIndex, .count = 0});
+            units.back().count++;
+        }
+    }
+
+    // Deal the units out round robin, neighbouring thread tiles end up with different workers
+    pending += units.size();
+    for (const ThreadTile &unit : units) {
+        WorkerQueue &queue = *queues[nextQueue];
+        nextQueue = (nextQueue + 1) % queues.size();
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.threadTiles.push_back(unit);
+    }
+    {
+        // A worker checks pending while holding the mutex, taking it here means no worker can miss the notification in between
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    workAvailable.notify_all();
+}
+
+void TileScheduler::wait(uint64_t tileIndex) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto found = jobs.find(tileIndex);
+    if (found == jobs.end()) return;
+    TileJob &job = *found->second;
+
+    // The previous current tile is completed, none of its workers touch pConfig.threadCompletion anymore
+    const uint64_t threadCompletionSize = (pConfig.threadCount + 7) / 8;
+    for (uint64_t i = 0; i < threadCompletionSize; i++) std::atomic_ref<unsigned char>(pConfig.threadCompletion[i]).store(0);
+    std::atomic_ref<uint64_t>(pConfig.currentTile).store(tileIndex);
+    for (uint64_t i = 0; i < threadCompletionSize && i < job.threadCompletion.size(); i++) {
+        std::atomic_ref<unsigned char>(pConfig.threadCompletion[i]).fetch_or(std::atomic_ref<unsigned char>(job.threadCompletion[i]).load());
+    }
+
+    tileCompleted.wait(lock, [&job] { return job.completed; });
+    const std::exception_ptr error = job.error;
+    if (keepPrepared && job.pass != supersamplePass) preparedTiles.insert_or_assign(tileIndex, std::move(job.tile));
+    jobs.erase(found);
+    if (error) std::rethrow_exception(error);
+}
+
+void TileScheduler::work(uint64_t worker) {
+    // The kernels count the pixels and iterations of this worker into its counters
+    WorkerCounters &counters = workerCounters(worker);
+    bindWorkerCounters(&counters);
+    while (true) {
+        ThreadTile threadTile = {.job = nullptr, .threadIndex = 0, .count = 0};
+        if (take(worker, threadTile)) {
+            TileJob &job = *threadTile.job;
+            // The job can be gone once its last thread tile is finished, which is the unit's last one. Canceled thread tiles are only counted down
+            for (uint64_t threadIndex = threadTile.threadIndex; threadIndex < threadTile.threadIndex + threadTile.count; threadIndex++) {
+                if (canceled.load(std::memory_order_relaxed)) {
+                    if (job.remaining.fetch_sub(1) == 1) settle(job);
+                    continue;
+                }
+                const uint64_t iterations = counters.iterations.load(std::memory_order_relaxed);
+                const auto start = std::chrono::steady_clock::now();
+                if (job.pass == supersamplePass) {
+                    supersampleThreadTile(job.tileIndex, threadIndex, job.tile, job.target);
+                } else {
+                    threadTileGenerator(job.tileIndex, threadIndex, job.tile, store->tile(job.tileIndex), job.pass, store);
+                }
+                counters.computeNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+                                                      std::memory_order_relaxed);
+                counters.threadTiles.fetch_add(1, std::memory_order_relaxed);
+                job.iterations.fetch_add(counters.iterations.load(std::memory_order_relaxed) - iterations, std::memory_order_relaxed);
+                finish(job, threadIndex);
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopping) return;
+        workAvailable.wait(lock, [this] { return stopping || pending != 0; });
+    }
+}
+
+bool TileScheduler::take(uint64_t worker, ThreadTile &threadTile) {
+    for (uint64_t i = 0; i < queues.size(); i++) {
+        WorkerQueue &queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.threadTiles.empty()) continue;
+        threadTile = queue.threadTiles.front();
+        queue.threadTiles.pop_front();
+        pending--;
+        return true;
+    }
+    return false;
+}
+
+void TileScheduler::finish(TileJob &job, uint64_t threadIndex) {
+    setCompletionBit(job.threadCompletion.data(), threadIndex);
+    if (std::atomic_ref<uint64_t>(pConfig.currentTile).load() == job.tileIndex) setCompletionBit(pConfig.threadCompletion, threadIndex);
+    if (job.remaining.fetch_sub(1) == 1) settle(job);
+}
+
+void TileScheduler::settle(TileJob &job) {
+    // Earlier progressive passes leave the tile incomplete
+    std::exception_ptr error;
+    try {
+        if (job.dropped || canceled) throw canceledError(job.tileIndex);
+        if (completesTile(job.pass)) {
+            store->completeTile(job.tileIndex, job.tile.context.precision == SinglePrecision ? static_cast<uint64_t>(TileSinglePrecision) : 0);
+            markCompleted(*store, job.tileIndex);
+            countTileCompleted(job.iterations.load(), job.estimatedCost);
+            if (tileCallback) tileCallback(job.tileIndex, store->tile(job.tileIndex));
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.error = error;
+        job.completed = true;
+    }
+    tileCompleted.notify_all();
+}
+
+StoreAttachment::StoreAttachment(TileScheduler &tileScheduler, SampleStore &store, bool keepPreparedTiles) : scheduler(tileScheduler) {
+    scheduler.attach(store, keepPreparedTiles);
+}
+
+StoreAttachment::~StoreAttachment() {
+    scheduler.detach();
+}
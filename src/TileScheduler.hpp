@@ -0,0 +1,159 @@
+#ifndef TILESCHEDULER_HPP_INCLUDED
+#define TILESCHEDULER_HPP_INCLUDED
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CostModel.hpp"
+#include "SampleStore.hpp"
+#include "TileGenerator.hpp"
+
+// Persistent worker pool computing the thread tiles of many tiles at once with work stealing.
+// Every submitted tile's thread tiles are dealt out over per worker deques, a worker that runs out of work steals from the others,
+// so the thread tiles of the next submitted tiles fill the cores while the slowest thread tiles of the current one finish, there is no barrier per tile.
+// A tile is completed in the store and in pConfig.tileCompletion as soon as its last thread tile is done.
+// The workers stay for one store after another (see attach), a RenderContext renders every image with the same ones.
+class TileScheduler {
+   public:
+    // Called with a tile's tileWidth() * tileHeight() samples once it is completed in the store
+    using TileCallback = std::function<void(uint64_t tileIndex, const StoredSample *samples)>;
+
+    // Starts workerCount workers bound to the calling thread's render state, attach a store before submitting tiles.
+    // The workers and their scratch buffers stay for every store attached later
+    explicit TileScheduler(uint64_t workerCount);
+    // Starts workerCount workers and attaches store
+    TileScheduler(SampleStore &sampleStore, uint64_t workerCount, bool keepPreparedTiles);
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+    // Detaches and stops the workers
+    ~TileScheduler();
+
+    // Writes the tiles submitted from now on into store, detaching from the previous one first. With keepPreparedTiles every waited for tile keeps its PreparedTile for supersample
+    void attach(SampleStore &sampleStore, bool keepPreparedTiles);
+    // Drops the thread tiles no worker has started yet and waits for the started ones, the tiles they belong to fail like canceled ones.
+    // Forgets every tile, cost estimate and PreparedTile of the store, it can go away afterwards
+    void detach();
+    // Drops the thread tiles no worker has started yet, every tile that isn't completed yet fails with std::errc::operation_canceled instead and
+    // submitting does as well until resume. Thread tiles already running are finished, but their tiles aren't completed in the store either. Thread safe
+    void cancel();
+    // Accepts tiles again after cancel
+    void resume();
+    // Calls callback for every tile completed in the store from now on, on the thread completing it (a worker unless the tile is too small for one).
+    // Tiles the store already held aren't reported, an error the callback throws fails the tile.
+    // Not thread safe, set it while no tile is submitted. An empty callback stops calling
+    void setTileCallback(TileCallback callback);
+
+    // Queues every thread tile of the tile to compute the pixels of progressive pass pass, or all of them for allPasses (see TileGenerator.hpp).
+    // Tiles are worked on roughly in the order they are submitted, a tile is only completed by allPasses or its last progressive pass.
+    // Tiles the store already holds are only marked in pConfig.tileCompletion, submitting a tile that is still queued does nothing.
+    // Tiles the store holds for a smaller maxIterations with EscalationRender run escalationPass instead of pass and are completed by it
+    void submit(uint64_t tileIndex, uint64_t pass);
+    // Queues every thread tile of supersampling the completed tile, see supersampleThreadTile. out holds the tile's pixels colored by colorizer from the store,
+    // in rows rowSize bytes apart, and the pixels settings picks are overwritten with their supersampled colors. Wait for the tile before reading out,
+    // settings and colorizer have to stay alive until then. Does nothing if settings.factor is below 2.
+    // The tile's computation (or earlier supersampling) has to be waited for first, throws std::logic_error while a job for the tile is pending
+    void supersample(uint64_t tileIndex, const SupersampleSettings &settings, const Colorizer &colorizer, unsigned char *out, uint64_t rowSize);
+    // Groups the thread tiles of tiles submitted from now on into units of similar cost according to estimate: consecutive cheap thread tiles
+    // are taken as one unit until they add up to the mean estimated thread tile cost, costlier ones stay on their own, and a tile's costliest units are dealt out first.
+    // estimate has to outlive the scheduler, nullptr goes back to one unit per thread tile
+    void setCostEstimate(const CostEstimate *estimate);
+    // Blocks until the submitted tile is completed and makes it pConfig.currentTile while waiting.
+    // Rethrows the error if completing the tile in the store failed
+    void wait(uint64_t tileIndex);
+
+   private:
+    // Submitted tile that isn't completed yet
+    struct TileJob {
+        uint64_t tileIndex;
+        uint64_t pass;
+        PreparedTile tile;
+        // Only used by supersamplePass, colors holds the tile's colors target points to
+        SupersampleTarget target;
+        std::vector<unsigned char> colors;
+        std::atomic<uint64_t> remaining;
+        // Iterations its thread tiles computed so far and what the cost estimate expected of it, see Telemetry.hpp
+        std::atomic<uint64_t> iterations;
+        double estimatedCost;
+        // Finished thread tiles, copied to pConfig.threadCompletion when this becomes the current tile
+        std::vector<unsigned char> threadCompletion;
+        // Set once thread tiles of it were dropped, the tile fails instead of being completed
+        std::atomic<bool> dropped;
+        // Set once the tile is completed in the store or failed to be, guarded by TileScheduler::mutex
+        bool completed;
+        std::exception_ptr error;
+
+        TileJob(uint64_t index, uint64_t tilePass, uint64_t threadCount)
+              : tileIndex(index), pass(tilePass), tile(), target(), colors(), remaining(threadCount), iterations(0), estimatedCost(0), threadCompletion((threadCount + 7) / 8, 0),
+                dropped(false), completed(false), error() {}
+    };
+
+    // Unit of work of a job, count consecutive thread tiles starting at threadIndex
+    struct ThreadTile {
+        TileJob *job;
+        uint64_t threadIndex;
+        uint64_t count;
+    };
+
+    // Deque of one worker, the owner and thieves both take from the front so earlier tiles drain first
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<ThreadTile> threadTiles;
+
+        WorkerQueue() : mutex(), threadTiles() {}
+    };
+
+    // Registers job and deals its thread tiles out to the workers
+    void enqueue(std::unique_ptr<TileJob> job);
+    void work(uint64_t worker);
+    // Takes the next unit of worker's own deque, or steals one from another worker. Returns false if every deque is empty
+    bool take(uint64_t worker, ThreadTile &threadTile);
+    void finish(TileJob &job, uint64_t threadIndex);
+    // Completes the job once none of its thread tiles is left, or fails it if any were dropped or the scheduler is canceled
+    void settle(TileJob &job);
+    // Drops every thread tile no worker has started yet, settling the jobs that have none running anymore
+    void drop();
+
+    // nullptr while detached
+    SampleStore *store;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    // Submitted units that no worker has taken yet
+    std::atomic<uint64_t> pending;
+    uint64_t nextQueue;
+    bool stopping;
+    std::atomic<bool> canceled;
+    TileCallback tileCallback;
+    // Guards jobs, stopping and the sleeping workers
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable tileCompleted;
+    std::map<uint64_t, std::unique_ptr<TileJob>> jobs;
+    // See setCostEstimate, unitCost is the mean estimated thread tile cost
+    const CostEstimate *costEstimate;
+    double unitCost;
+    // PreparedTiles of waited for tiles that supersample takes, only kept with keepPreparedTiles
+    bool keepPrepared;
+    std::map<uint64_t, PreparedTile> preparedTiles;
+};
+
+// Attaches a scheduler to a store while it lives, so the store can't go away under the scheduler's workers when a render throws
+class StoreAttachment {
+   public:
+    StoreAttachment(TileScheduler &tileScheduler, SampleStore &store, bool keepPreparedTiles);
+    StoreAttachment(const StoreAttachment &) = delete;
+    StoreAttachment &operator=(const StoreAttachment &) = delete;
+    ~StoreAttachment();
+
+   private:
+    TileScheduler &scheduler;
+};
+
+#endif  // TILESCHEDULER_HPP_INCLUDED
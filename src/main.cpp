@@ -1,59 +1,285 @@
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "Buddhabrot.hpp"
+#include "Colorizer.hpp"
+#include "Distributed.hpp"
+#include "ImageGenerator.hpp"
 #include "Mandelbrotset.hpp"
+#include "RenderState.hpp"
 #include "Saves.hpp"
+#include "Sequence.hpp"
+#include "Telemetry.hpp"
+#include "TileGenerator.hpp"
 
-MandelbrotsetConfiguration mConfig = {
-    .startReal = -20.0L / 9.0L,
-    .endReal = 20.0L / 9.0L,
-    .startImag = 1.25L,
-    .endImag = -1.25L,
+// Everything the command line renders, the main thread and every thread it starts are bound to it
+static RenderState renderState = {
+    .mConfig = {
+        .startReal = -20.0L / 9.0L,
+        .endReal = 20.0L / 9.0L,
+        .startImag = 1.25L,
+        .endImag = -1.25L,
 
-    .maxIterations = 1000LL,
-    .bailoutRadius = 1 << 8,
-    .periodicityPrecision2 = 1E-14L,
-    .periodicitySavePeriod = 200
+        .maxIterations = 1000LL,
+        .bailoutRadius = 1 << 8,
+        .periodicityPrecision2 = 1E-14L,
+        .periodicitySavePeriod = 200,
+
+        .renderFlags = 0,
+        .centerRealHi = 0.0,
+        .centerRealLo = 0.0,
+        .centerImagHi = 0.0,
+        .centerImagLo = 0.0,
+        .zoom = 1.0,
+
+        .formula = MandelbrotFormula,
+        .juliaReal = 0.0,
+        .juliaImag = 0.0
+    },
+    .tConfig = {
+        .imageWidth = 1920ULL,
+        .imageHeight = 1080ULL,
+
+        .tileGridWidth = 64ULL,
+        .tileGridHeight = 64ULL,
+
+        .threadGridWidth = 128ULL,
+        .threadGridHeight = 72ULL
+    },
+    // The completion arrays are allocated for tConfig's grids by resetProgressConfiguration at the start of main
+    .pConfig = {
+        .threadsUsed = 8ULL,
+        .currentTile = 0ULL,
+        .tileCount = 0ULL,
+        .threadCount = 0ULL,
+        .tileCompletion = nullptr,
+        .threadCompletion = nullptr,
+        .tileBudgets = nullptr
+    },
+    .savePath = "mandelbrotset/",
+    .budgetHistory = {},
+    .sharedReferenceOrbit = nullptr,
+    .progressJournalMutex = {},
+    .progressJournal = {},
+    .progressJournalPath = {},
+    .telemetry = {}
 };
-TileConfiguration tConfig = {
-    .imageWidth = 1920ULL,
-    .imageHeight = 1080ULL,
 
-    .tileGridWidth = 64ULL,
-    .tileGridHeight = 64ULL,
+extern thread_local MandelbrotsetConfiguration &mConfig;
+extern thread_local TileConfiguration &tConfig;
+extern thread_local ProgressConfiguration &pConfig;
+extern thread_local std::filesystem::path &savePath;
 
-    .threadGridWidth = 128ULL,
-    .threadGridHeight = 72ULL
+const ColorSettings colorSettings = {
+    .palette = UltraFractalPalette,
+    .smooth = true,
+    .histogramEqualization = true,
+    .paletteDensity = 1.0 / 64,
+    .bitDepth = 8
 };
-ProgressConfiguration pConfig = {
-    .threadsUsed = 8ULL,
-    .currentTile = 0ULL,
-    .tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight,
-    .threadCount = tConfig.threadGridWidth * tConfig.threadGridHeight,
-    .tileCompletion = (new unsigned char[(pConfig.tileCount + 7) / 8]{0}),
-    .threadCompletion = (new unsigned char[(pConfig.threadCount + 7) / 8]{0})
+
+const SupersampleSettings supersampleSettings = {
+    .factor = 1,
+    .jittered = true,
+    .adaptiveThreshold = 1.0 / 16
 };
 
-std::filesystem::path savePath = "mandelbrotset/";
+// Names of the Formula values and RenderFlag bits on the command line, in the order of their enums
+static const char *const formulaNames[formulaCount] = {"mandelbrot", "cubic", "quartic", "burningship", "julia"};
+static const char *const renderFlagNames[] = {"deepzoom", "marianisilver", "double", "progressive", "escalation", "distance"};
+
+// Index of name in names, throws std::invalid_argument if it isn't one of them
+template <size_t count>
+static uint64_t nameIndex(const char *const (&names)[count], const std::string &name) {
+    const auto found = std::find(std::begin(names), std::end(names), name);
+    if (found == std::end(names)) throw std::invalid_argument("unknown name \"" + name + "\"");
+    return static_cast<uint64_t>(found - std::begin(names));
+}
+
+// RenderFlag bits of a comma separated list of renderFlagNames, "none" for no flags
+static uint64_t parseRenderFlags(const std::string &list) {
+    uint64_t flags = 0;
+    if (list == "none") return flags;
+    for (size_t start = 0; start <= list.size();) {
+        const size_t comma = std::min(list.find(',', start), list.size());
+        flags |= 1ULL << nameIndex(renderFlagNames, list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return flags;
+}
+
+int main(int argc, char **argv) {
+    bindRenderState(renderState);
+    resetProgressConfiguration(tConfig.tileGridWidth * tConfig.tileGridHeight, tConfig.threadGridWidth * tConfig.threadGridHeight);
+
+    // Orbit density render of mConfig's view instead of the escape time image, see renderBuddhabrot
+    BuddhabrotSettings buddhabrotSettings = {
+        .samples = 0,
+        .stratified = true,
+        .bandIterations = {1000, 200, 50},
+        .minIterations = 20,
+        .checkpointInterval = 60
+    };
+    std::filesystem::path keyframePath;
+    SequenceSettings sequenceSettings = {
+        .framesPerSecond = 30,
+        .frameDirectory = savePath / "frames",
+        .rawStdout = false
+    };
+    uint16_t coordinatorPort = 0;
+    uint64_t rangeSize = 16;
+    std::string coordinatorAddress;
+    std::filesystem::path tileFilePath;
+    std::vector<std::filesystem::path> mergedTileFiles;
+    // Changes to the formula, flags and budget of save.mc, applied once it is loaded and kept in it for later runs
+    std::vector<std::function<void(MandelbrotsetConfiguration &)>> configurationChanges;
+    TelemetrySettings telemetrySettings = {
+        .progressBar = true,
+        .metricsPath = {},
+        .interval = 0.5
+    };
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        if (argument == "--coordinate" && i + 1 < argc) {
+            coordinatorPort = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (argument == "--range" && i + 1 < argc) {
+            rangeSize = std::max(std::stoull(argv[++i]), 1ULL);
+        } else if (argument == "--work" && i + 1 < argc) {
+            coordinatorAddress = argv[++i];
+        } else if (argument == "--tiles" && i + 1 < argc) {
+            tileFilePath = argv[++i];
+        } else if (argument == "--merge" && i + 1 < argc) {
+            while (i + 1 < argc) mergedTileFiles.push_back(argv[++i]);
+        } else if (argument == "--sequence" && i + 1 < argc) {
+            keyframePath = argv[++i];
+        } else if (argument == "--fps" && i + 1 < argc) {
+            sequenceSettings.framesPerSecond = std::stod(argv[++i]);
+        } else if (argument == "--frames" && i + 1 < argc) {
+            sequenceSettings.frameDirectory = argv[++i];
+        } else if (argument == "--stdout") {
+            sequenceSettings.rawStdout = true;
+        } else if (argument == "--buddhabrot" && i + 1 < argc) {
+            buddhabrotSettings.samples = std::stoull(argv[++i]);
+        } else if (argument == "--bands" && i + 3 < argc) {
+            for (int64_t &band : buddhabrotSettings.bandIterations) band = std::stoll(argv[++i]);
+        } else if (argument == "--random") {
+            buddhabrotSettings.stratified = false;
+        } else if (argument == "--metrics" && i + 1 < argc) {
+            telemetrySettings.metricsPath = argv[++i];
+        } else if (argument == "--interval" && i + 1 < argc) {
+            telemetrySettings.interval = std::stod(argv[++i]);
+        } else if (argument == "--quiet") {
+            telemetrySettings.progressBar = false;
+        } else if (argument == "--formula" && i + 1 < argc) {
+            const uint64_t formula = nameIndex(formulaNames, argv[++i]);
+            configurationChanges.push_back([formula](MandelbrotsetConfiguration &configuration) { configuration.formula = formula; });
+        } else if (argument == "--julia" && i + 2 < argc) {
+            const double juliaReal = std::stod(argv[++i]);
+            const double juliaImag = std::stod(argv[++i]);
+            configurationChanges.push_back([juliaReal, juliaImag](MandelbrotsetConfiguration &configuration) {
+                configuration.formula = JuliaFormula;
+                configuration.juliaReal = juliaReal;
+                configuration.juliaImag = juliaImag;
+            });
+        } else if (argument == "--iterations" && i + 1 < argc) {
+            const int64_t maxIterations = std::max(std::stoll(argv[++i]), 1LL);
+            configurationChanges.push_back([maxIterations](MandelbrotsetConfiguration &configuration) { configuration.maxIterations = maxIterations; });
+        } else if (argument == "--flags" && i + 1 < argc) {
+            const uint64_t flags = parseRenderFlags(argv[++i]);
+            configurationChanges.push_back([flags](MandelbrotsetConfiguration &configuration) { configuration.renderFlags = flags; });
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--formula mandelbrot|cubic|quartic|burningship|julia] [--julia real imag]"
+                      << " [--flags deepzoom,marianisilver,double,progressive,escalation,distance | --flags none]\n"
+                      << "       " << argv[0] << " [--sequence keyframes [--fps n] [--frames directory | --stdout]]\n"
+                      << "       " << argv[0] << " --buddhabrot samples [--bands red green blue] [--random]\n"
+                      << "       " << argv[0] << " [--metrics file.prom] [--interval seconds] [--quiet]"
+                      << " [--coordinate port [--range tiles] | --work host:port [--tiles file.mtf] | --merge file.mtf...]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Zoom sequences only report to stderr, stdout may carry the raw frames
+    if (!keyframePath.empty()) {
+        std::cerr << "kernel: " << kernelName(selectedKernel()) << std::endl;
+        renderSequence(loadKeyframes(keyframePath), sequenceSettings, colorSettings);
+        return 0;
+    }
+
+    // Buddhabrots checkpoint their own accumulators, the tile pipeline's saves aren't involved
+    if (buddhabrotSettings.samples > 0) {
+        std::filesystem::create_directories(savePath);
+        renderBuddhabrot(savePath / "buddhabrot.png", savePath / "buddhabrot.mbc", buddhabrotSettings, colorSettings.bitDepth);
+        return 0;
+    }
+
+    // Workers take their configurations from the coordinator and never touch savePath
+    if (!coordinatorAddress.empty()) {
+        const size_t colon = coordinatorAddress.rfind(':');
+        if (colon == std::string::npos) {
+            std::cerr << "--work expects host:port" << std::endl;
+            return 1;
+        }
+        workForCoordinator(coordinatorAddress.substr(0, colon), static_cast<uint16_t>(std::stoul(coordinatorAddress.substr(colon + 1))), tileFilePath);
+        return 0;
+    }
+
+    // The view, formula, flags and image are whatever save.mc and save.mtc hold, the configurations above are only written where they are missing or invalid
+    std::filesystem::create_directories(savePath);
+    const bool resumed = detectConfiguration(savePath / "save.mc", Mandelbrotset) && detectConfiguration(savePath / "save.mtc", Tile) && configurationChanges.empty();
+    if (!detectConfiguration(savePath / "save.mc", Mandelbrotset)) saveConfiguration(savePath / "save.mc", Mandelbrotset);
+    if (!detectConfiguration(savePath / "save.mtc", Tile)) saveConfiguration(savePath / "save.mtc", Tile);
+    detectLoadConfiguration(savePath / "save.mc");
+    detectLoadConfiguration(savePath / "save.mtc");
+    if (!configurationChanges.empty()) {
+        for (const auto &change : configurationChanges) change(mConfig);
+        saveConfiguration(savePath / "save.mc", Mandelbrotset);
+    }
 
-int main() {
+    // An interrupted run's progress snapshot and the tiles journaled after it are only kept for the same configurations and grids.
+    // Saving it compacts the journal into the snapshot before journaling starts again
+    const uint64_t tileCount = tConfig.tileGridWidth * tConfig.tileGridHeight;
+    const uint64_t threadCount = tConfig.threadGridWidth * tConfig.threadGridHeight;
+    resetProgressConfiguration(tileCount, threadCount);
+    if (resumed) detectLoadConfiguration(savePath / "save.mpc");
+    if (pConfig.tileCount != tileCount || pConfig.threadCount != threadCount) resetProgressConfiguration(tileCount, threadCount);
+    saveConfiguration(savePath / "save.mpc", Progress);
+
+    std::cout << "kernel: " << kernelName(selectedKernel()) << std::endl;
     std::cout << "startReal: " << mConfig.startReal << std::endl;
     std::cout << "endReal: " << mConfig.endReal << std::endl;
     std::cout << "startImag: " << mConfig.startImag << std::endl;
     std::cout << "endImag: " << mConfig.endImag << std::endl;
 
-    saveConfiguration(savePath / "save.mc", Mandelbrotset);
-    saveConfiguration(savePath / "save.mtc", Tile);
-    saveConfiguration(savePath / "save.mpc", Progress);
-
-    detectLoadConfiguration(savePath / "save.mc");
-    detectLoadConfiguration(savePath / "save.mtc");
-    detectLoadConfiguration(savePath / "save.mpc");
+    // Tiles completed from here on are appended to "save.mpc" as they finish, so an interrupted run keeps them
+    openProgressJournal(savePath / "save.mpc");
 
     Sample samples[8];
     computeIterationsVector(1920 / 2, 1080 / 2, samples);
     for (const Sample& sample : samples) {
         std::cout << sample.cReal << " " << sample.cImag << " " << sample.iterations << " " << sample.finalMagnitude2 << std::endl;
     }
+
+    // Distributed renders fill the sample store first, generateImage then only encodes (and computes whatever tiles merged files lack)
+    if (coordinatorPort == 0 && !mergedTileFiles.empty()) {
+        std::cout << "tiles missing from the merged files: " << mergeTileFiles(mergedTileFiles, savePath / "samples.mss") << std::endl;
+        saveConfiguration(savePath / "save.mtc", Tile);
+        saveConfiguration(savePath / "save.mpc", Progress);
+    }
+    {
+        // Merging replaces pConfig, the reporter only watches the render afterwards
+        TelemetryReporter reporter(telemetrySettings);
+        if (coordinatorPort != 0) coordinateRender(coordinatorPort, rangeSize, savePath / "samples.mss");
+        generateImage(savePath / "image.png", savePath / "samples.mss", colorSettings, supersampleSettings);
+    }
+
+    // Records the budget history and compacts the journaled tiles into a new progress snapshot
+    saveConfiguration(savePath / "save.mc", Mandelbrotset);
+    saveConfiguration(savePath / "save.mpc", Progress);
+    closeProgressJournal();
 }
\ No newline at end of file